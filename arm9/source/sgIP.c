@@ -32,6 +32,7 @@ int sgIP_errno;
 void sgIP_Init() {
 	sgIP_timems = 0;
 	sgIP_memblock_Init();
+	sgIP_TimerWheel_Init();
 	sgIP_Hub_Init();
 	sgIP_sockets_Init();
 	sgIP_ARP_Init();
@@ -43,23 +44,15 @@ void sgIP_Init() {
 }
 
 
-unsigned long count_100ms;
 unsigned long count_1000ms;
 void sgIP_Timer(int num_ms) {
    sgIP_timems+=num_ms;
-   count_100ms+=num_ms;
-   if(count_100ms>=100) {
-      count_100ms-=100;
-      if(count_100ms>=100) count_100ms=0;
-      sgIP_ARP_Timer100ms();
-   }
    count_1000ms+=num_ms;
    if(count_1000ms>=1000) {
       count_1000ms-=1000;
       if(count_1000ms>=1000) count_1000ms=0;
-      sgIP_DNS_Timer1000ms();
 	  sgIP_sockets_Timer1000ms();
    }
-   sgIP_TCP_Timer();
+   sgIP_TimerWheel_Run(); // TCP, ARP and DNS timeouts
 }
 
@@ -26,6 +26,9 @@ SOFTWARE.
 #include "sgIP_ARP.h"
 
 sgIP_ARP_Record ArpRecords[SGIP_ARP_MAXENTRIES];
+extern unsigned long volatile sgIP_timems;
+
+void sgIP_ARP_RetryTimer(void * data);
 
 
 int sgIP_FindArpSlot(sgIP_Hub_HWInterface * hw, unsigned long destip) {
@@ -38,24 +41,24 @@ int sgIP_FindArpSlot(sgIP_Hub_HWInterface * hw, unsigned long destip) {
 	return -1;
 }
 int sgIP_GetArpSlot() {
-	int i,m,midle;
+	int i,m;
+	unsigned long midle;
 	m=0;
 	midle=0;
 	for(i=0;i<SGIP_ARP_MAXENTRIES;i++) {
 		if(ArpRecords[i].flags&SGIP_ARP_FLAG_ACTIVE) {
-			if(ArpRecords[i].idletime>=midle) {
-				midle=ArpRecords[i].idletime; m=i;
+			if(sgIP_timems-ArpRecords[i].lastused>=midle) {
+				midle=sgIP_timems-ArpRecords[i].lastused; m=i;
 			}
 		} else {
 			return i;
 		}
 	}
 	// this slot *was* in use, so let's fix that situation.
-	if(ArpRecords[m].queued_packet) sgIP_memblock_free(ArpRecords[m].queued_packet);
+	sgIP_ARP_FreeQueue(ArpRecords+m);
+	sgIP_TimerWheel_Cancel(&ArpRecords[m].timer);
 	ArpRecords[m].flags=0;
 	ArpRecords[m].retrycount=0;
-	ArpRecords[m].idletime=0;
-	ArpRecords[m].queued_packet=0;
 	return m;
 }
 
@@ -73,37 +76,44 @@ void	sgIP_ARP_Init() {
 	int i;
 	for(i=0;i<SGIP_ARP_MAXENTRIES;i++) {
 		ArpRecords[i].flags=0;
-		ArpRecords[i].idletime=0;
+		ArpRecords[i].lastused=0;
 		ArpRecords[i].queued_packet=0;
+		sgIP_TimerWheel_InitEntry(&ArpRecords[i].timer,sgIP_ARP_RetryTimer,ArpRecords+i);
 	}
 }
-void sgIP_ARP_Timer100ms() {
-	int i;
-	for(i=0;i<SGIP_ARP_MAXENTRIES;i++) {
-		if(ArpRecords[i].flags & SGIP_ARP_FLAG_ACTIVE) {
-			ArpRecords[i].idletime++;
-			if(!(ArpRecords[i].flags&SGIP_ARP_FLAG_HAVEHWADDR)) {
-				ArpRecords[i].retrycount++;
-				if(ArpRecords[i].retrycount>125) { // it's a lost cause.
-					if(ArpRecords[i].queued_packet) { // if there is already a queued packet, kill it.
-						sgIP_memblock_free(ArpRecords[i].queued_packet);
-					}
-					ArpRecords[i].flags=0;
-					continue;
-				}
-				if((ArpRecords[i].retrycount&7)==7) { // attempt retransmit of ARP frame.
-					sgIP_ARP_SendARPRequest(ArpRecords[i].linked_interface, ArpRecords[i].linked_protocol, ArpRecords[i].protocol_address);
-				}
-			}
-		}
+// an ARP request went unanswered; ask again, or give up on it.
+void sgIP_ARP_RetryTimer(void * data) {
+	sgIP_ARP_Record * rec;
+	rec=(sgIP_ARP_Record *)data;
+	if(!(rec->flags & SGIP_ARP_FLAG_ACTIVE) || (rec->flags&SGIP_ARP_FLAG_HAVEHWADDR)) return;
+	rec->retrycount++;
+	if(rec->retrycount>SGIP_ARP_MAXRETRY) { // it's a lost cause.
+		sgIP_ARP_FreeQueue(rec);
+		rec->flags=0;
+		return;
+	}
+	sgIP_ARP_SendARPRequest(rec->linked_interface, rec->linked_protocol, rec->protocol_address);
+	sgIP_TimerWheel_Set(&rec->timer,sgIP_timems+SGIP_ARP_RETRYMS);
+}
+
+// drop the packets waiting on an address.
+void sgIP_ARP_FreeQueue(sgIP_ARP_Record * rec) {
+	sgIP_memblock * mb;
+	while((mb=rec->queued_packet)) {
+		rec->queued_packet=mb->nextpacket;
+		mb->nextpacket=0;
+		sgIP_memblock_free(mb);
 	}
 }
 
 void sgIP_ARP_FlushInterface(sgIP_Hub_HWInterface * hw) {
 	int i;
 	for(i=0;i<SGIP_ARP_MAXENTRIES;i++) {
-		if(ArpRecords[i].linked_interface==hw) ArpRecords[i].flags=0;
-		if(hw==0) ArpRecords[i].flags=0; // flush all interfaces
+		if(ArpRecords[i].linked_interface==hw || hw==0) { // hw==0: flush all interfaces
+			sgIP_ARP_FreeQueue(ArpRecords+i);
+			ArpRecords[i].flags=0;
+			sgIP_TimerWheel_Cancel(&ArpRecords[i].timer);
+		}
 	}
 }
  // don't *really* need to process this, but it helps.
@@ -140,10 +150,16 @@ int sgIP_ARP_ProcessARPFrame(sgIP_Hub_HWInterface * hw, sgIP_memblock * mb) {
 		if(i!=-1) { // we've been waiting for you...
 			for(j=0;j<arp->hw_addr_len;j++) ArpRecords[i].hw_address[j]=arp->addresses[j];
 			ArpRecords[i].flags|=SGIP_ARP_FLAG_HAVEHWADDR;
-			sgIP_memblock * mb2;
+			sgIP_TimerWheel_Cancel(&ArpRecords[i].timer);
+			sgIP_memblock * mb2, * mb3;
 			mb2=ArpRecords[i].queued_packet;
 			ArpRecords[i].queued_packet=0;
-			if(mb2) sgIP_ARP_SendProtocolFrame(hw,mb2,ArpRecords[i].linked_protocol,ip);
+			while(mb2) { // send them all, oldest first
+				mb3=mb2->nextpacket;
+				mb2->nextpacket=0;
+				sgIP_ARP_SendProtocolFrame(hw,mb2,ArpRecords[i].linked_protocol,ip);
+				mb2=mb3;
+			}
 		}
 	}
 
@@ -171,7 +187,7 @@ int sgIP_ARP_SendProtocolFrame(sgIP_Hub_HWInterface * hw, sgIP_memblock * mb, un
 	i=sgIP_FindArpSlot(hw,destaddr);
 	if(i!=-1) {
 		if(ArpRecords[i].flags & SGIP_ARP_FLAG_HAVEHWADDR) { // we have the adddress
-			ArpRecords[i].idletime=0;
+			ArpRecords[i].lastused=sgIP_timems;
 			// construct ethernet header
 			ether = (sgIP_Header_Ethernet *) mb->datastart;
 			for(j=0;j<6;j++) {
@@ -181,12 +197,16 @@ int sgIP_ARP_SendProtocolFrame(sgIP_Hub_HWInterface * hw, sgIP_memblock * mb, un
 			ether->protocol=protocol;
 			return sgIP_Hub_SendRawPacket(hw,mb); // this function will free the memory block when it's done.
 		} else { // we don't have the address, but are looking for it.
-			if(ArpRecords[i].queued_packet) { // if there is already a queued packet, reject the new one.
+			sgIP_memblock * tail;
+			tail=ArpRecords[i].queued_packet;
+			for(j=1;tail && tail->nextpacket;j++) tail=tail->nextpacket;
+			if(tail && j>=SGIP_ARP_MAXQUEUED) { // if the queue is already full, reject the new one.
 				sgIP_memblock_free(mb);
 				return 0; // couldn't send.
 			} else {		
 				sgIP_memblock_exposeheader(mb,-14); // re-hide ethernet header.
-				ArpRecords[i].queued_packet=mb; // queue packet.
+				mb->nextpacket=0;
+				if(tail) tail->nextpacket=mb; else ArpRecords[i].queued_packet=mb; // queue packet.
 				ArpRecords[i].linked_protocol=protocol; // queue packet.
 				return 0;
 			}
@@ -195,14 +215,16 @@ int sgIP_ARP_SendProtocolFrame(sgIP_Hub_HWInterface * hw, sgIP_memblock * mb, un
 	m=sgIP_GetArpSlot(); // gets and cleans out an arp slot for us
 		// build new record
 	ArpRecords[m].flags=SGIP_ARP_FLAG_ACTIVE;
-	ArpRecords[m].idletime=0;
+	ArpRecords[m].lastused=sgIP_timems;
 	ArpRecords[m].retrycount=0;
 	ArpRecords[m].linked_interface=hw;
 	ArpRecords[m].protocol_address=destaddr;
 	sgIP_memblock_exposeheader(mb,-14); // re-hide ethernet header.
+	mb->nextpacket=0;
 	ArpRecords[m].queued_packet=mb;
 	ArpRecords[m].linked_protocol=protocol;
 	sgIP_ARP_SendARPRequest(hw,protocol,destaddr);
+	sgIP_TimerWheel_Set(&ArpRecords[m].timer,sgIP_timems+SGIP_ARP_RETRYMS);
 	return 0; // queued, but not sent yet.
 }
 
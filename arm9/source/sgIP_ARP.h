@@ -28,15 +28,17 @@ SOFTWARE.
 #include "sgIP_Config.h"
 #include "sgIP_memblock.h"
 #include "sgIP_Hub.h"
+#include "sgIP_TimerWheel.h"
 
 #define SGIP_ARP_FLAG_ACTIVE		0x0001
 #define SGIP_ARP_FLAG_HAVEHWADDR	0x0002
 
 typedef struct SGIP_ARP_RECORD {
 	unsigned short flags, retrycount;
-	unsigned long idletime;
+	unsigned long lastused; // sgIP_timems of the last packet sent to this address
+	sgIP_TimerEntry timer; // resends the request until it's answered
 	sgIP_Hub_HWInterface * linked_interface;
-	sgIP_memblock * queued_packet;
+	sgIP_memblock * queued_packet; // packets waiting for the address, linked by nextpacket
 	int linked_protocol;
 	unsigned long protocol_address;
 	char hw_address[SGIP_MAXHWADDRLEN];
@@ -59,8 +61,8 @@ extern "C" {
 #endif
 
 	extern void	sgIP_ARP_Init();
-	extern void sgIP_ARP_Timer100ms();
 	extern void sgIP_ARP_FlushInterface(sgIP_Hub_HWInterface * hw);
+	extern void sgIP_ARP_FreeQueue(sgIP_ARP_Record * rec);
 
 	extern int sgIP_ARP_ProcessIPFrame(sgIP_Hub_HWInterface * hw, sgIP_memblock * mb);
 	extern int sgIP_ARP_ProcessARPFrame(sgIP_Hub_HWInterface * hw, sgIP_memblock * mb);
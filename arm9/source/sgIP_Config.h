@@ -81,6 +81,15 @@ SOFTWARE.
 // Generate all memblocks by mallocing 'em.
 #define SGIP_MEMBLOCK_DYNAMIC_MALLOC_ALL
 
+// SGIP_MEMBLOCK_SLABS: With SGIP_MEMBLOCK_DYNAMIC_MALLOC_ALL, take memblocks from slabs of
+//  SGIP_MEMBLOCK_STEPNUM same-sized blocks (in a few size classes) instead of a malloc each.
+//  Slabs are allocated as they're needed and freed again once they're empty and there are spares.
+#define SGIP_MEMBLOCK_SLABS
+
+// SGIP_MEMBLOCK_TICKS: Define this as a read of a free-running 32-bit counter to have the time
+//  spent in memblock alloc/free added up in sgIP_memblock_GetStats().
+//#define SGIP_MEMBLOCK_TICKS		my_read_counter()
+
 //////////////////////////////////////////////////////////////////////////
 // Hardware layer settings
 
@@ -102,7 +111,8 @@ SOFTWARE.
 // Connection settings - can be tuned to change memory usage and performance
 
 // SGIP_TCP_STATELESS_LISTEN: Uses a technique to prevent syn-flooding from blocking listen
-//  ports by using all the connection blocks/memory.
+//  ports by using all the connection blocks/memory. Listening sockets answer SYNs with a
+//  SYN cookie and keep no state until the handshake completes, so the SYN-ACK is not resent.
 #define SGIP_TCP_STATELESS_LISTEN
 
 // SGIP_TCP_STEALTH: Only sends packets in response to connections to active ports. Doing so
@@ -114,20 +124,63 @@ SOFTWARE.
 //  manually override this value.
 #define SGIP_IP_TTL								128
 
-// SGIP_TCPRECEIVEBUFFERLENGTH: The size (in bytes) of the receive FIFO in a TCP connection
+// SGIP_TCPRECEIVEBUFFERLENGTH: The default size (in bytes) of the receive FIFO in a TCP
+//  connection. SO_RCVBUF changes it per socket.
 #define SGIP_TCP_RECEIVEBUFFERLENGTH			8192
 
-// SGIP_TCPTRANSMITBUFFERLENGTH: The size (in bytes) of the transmit FIFO in a TCP connection
+// SGIP_TCPTRANSMITBUFFERLENGTH: The default size (in bytes) of the transmit FIFO in a TCP
+//  connection. SO_SNDBUF changes it per socket.
 #define SGIP_TCP_TRANSMITBUFFERLENGTH			8192
 
-// SGIP_TCPOOBBUFFERLENGTH: The size (in bytes) of the receive OOB data FIFO in a TCP connection
-#define SGIP_TCP_OOBBUFFERLENGTH				256
+// SGIP_TCP_MINBUFFERLENGTH/SGIP_TCP_MAXBUFFERLENGTH: The range SO_RCVBUF and SO_SNDBUF are
+//  clamped to. The FIFOs are allocated from the heap when a connection is set up, so a
+//  listening socket or an unconnected one costs no buffer memory. Receive buffers over 64KB
+//  are offered to the remote end with TCP window scaling.
+#define SGIP_TCP_MINBUFFERLENGTH				512
+#define SGIP_TCP_MAXBUFFERLENGTH				262144
+
+// SGIP_UDP_RECEIVEBUFFERLENGTH: The default limit (in bytes, headers included) on the datagrams
+//  waiting to be read on one UDP socket; SO_RCVBUF changes it per socket, within
+//  SGIP_TCP_MINBUFFERLENGTH..SGIP_TCP_MAXBUFFERLENGTH. A datagram that doesn't fit is dropped
+//  (or, with SO_RCVDROPOLDEST, the oldest ones are) and counted in SO_RCVDROPPED. One datagram
+//  is always let into an empty queue, however big.
+#define SGIP_UDP_RECEIVEBUFFERLENGTH			8192
+
+// SGIP_UDP_MAXQUEUED: The most datagrams that can wait on one UDP socket, whatever their size.
+#define SGIP_UDP_MAXQUEUED						16
+
+// SGIP_TCP_MAXOOOSEGMENTS: The maximum number of out-of-order segments held per TCP connection
+//  while waiting for a lost segment to be retransmitted. The data held is also bounded by the
+//  free space in the receive FIFO.
+#define SGIP_TCP_MAXOOOSEGMENTS					16
+
+// SGIP_TCP_MAXSACKBLOCKS: The maximum number of SACK blocks sent in one segment (at most 4 fit
+//  in the TCP option space).
+#define SGIP_TCP_MAXSACKBLOCKS					4
+
+// SGIP_TCP_SACKSCOREBOARD: The number of SACKed ranges remembered per TCP connection, used to
+//  retransmit only the data the remote end is missing.
+#define SGIP_TCP_SACKSCOREBOARD					8
 
 // SGIP_ARP_MAXENTRIES: The maximum number of cached ARP entries - this is defined staticly
 //  because it's somewhat impractical to dynamicly allocate memory for such a small structure
 //  (at least on most smaller systems)
 #define SGIP_ARP_MAXENTRIES						32
 
+// SGIP_ARP_RETRYMS: How often an unanswered ARP request is resent, and SGIP_ARP_MAXRETRY: how
+//  many times before the address is given up on (and the packets waiting for it dropped).
+#define SGIP_ARP_RETRYMS						800
+#define SGIP_ARP_MAXRETRY						15
+
+// SGIP_ARP_MAXQUEUED: How many packets can wait for one address to be resolved; more than that
+//  and the newest are dropped.
+#define SGIP_ARP_MAXQUEUED						4
+
+// SGIP_TIMERWHEEL_TICKMS: The resolution (in ms) of the timer wheel that runs TCP, ARP and DNS
+//  timeouts. Deadlines are rounded up to a whole tick; there is no point in this being finer
+//  than the period sgIP_Timer() is called at.
+#define SGIP_TIMERWHEEL_TICKMS					50
+
 // SGIP_HUB_MAXHWINTERFACES: The maximum number of hardware interfaces the sgIP hub will 
 //  connect to. A hardware interface being some port (ethernet, wifi, etc) that will relay
 //  packets to the outside world.
@@ -138,21 +191,38 @@ SOFTWARE.
 //  (such as IP)
 #define SGIP_HUB_MAXPROTOCOLINTERFACES			1
 
+// SGIP_HUB_RXBATCH: How many received frames Wifi_Update collects before handing them to the stack
+//  with sgIP_Hub_ReceiveHardwarePackets; acks for a batch go out once, at the end of it.
+#define SGIP_HUB_RXBATCH						8
+
+// SGIP_TCP_HASHSIZE: The number of buckets in the hash table used to find the TCP record for
+//  an incoming segment by (remote ip, local port, remote port). Must be a power of 2.
+#define SGIP_TCP_HASHSIZE						64
+
+// SGIP_TCP_PORTHASHSIZE: The number of buckets in the local port hash tables (listening
+//  records, and all bound records for outgoing port selection). Must be a power of 2.
+#define SGIP_TCP_PORTHASHSIZE					32
+
+// SGIP_UDP_PORTHASHSIZE: The number of buckets in the hash table used to find the UDP records
+//  bound to a local port. Must be a power of 2.
+#define SGIP_UDP_PORTHASHSIZE					32
+
 #define SGIP_TCP_FIRSTOUTGOINGPORT				40000
 #define SGIP_TCP_LASTOUTGOINGPORT				65000
 #define SGIP_UDP_FIRSTOUTGOINGPORT				40000
 #define SGIP_UDP_LASTOUTGOINGPORT				65000
 
 #define SGIP_TCP_GENTIMEOUTMS                6000
-#define SGIP_TCP_TRANSMIT_DELAY              25
-#define SGIP_TCP_TRANSMIT_IMMTHRESH          40
 #define SGIP_TCP_TIMEMS_2MSL                 1000*60*2
 #define SGIP_TCP_MAXRETRY                    7
-#define SGIP_TCP_MAXSYNS                     64
 #define SGIP_TCP_REACK_THRESH                   1000
 
-#define SGIP_TCP_SYNRETRYMS						250
-#define SGIP_TCP_GENRETRYMS						500
+#define SGIP_TCP_COOKIE_TIMESHIFT				16 // SYN cookie time counter is sgIP_timems>>16 (~65s)
+#define SGIP_TCP_COOKIE_MAXAGE					1 // counter steps a SYN cookie stays valid for (at most 2, the cookie holds 2 bits of the counter)
+#define SGIP_TCP_GENRETRYMS						500 // retransmit timeout until a round trip time has been measured
+#define SGIP_TCP_MINRTOMS						100 // lower bound on the measured retransmit timeout
+#define SGIP_TCP_TIMERGRANULARITYMS				50 // how often sgIP_Timer() runs; an RTO can't be shorter than this
+#define SGIP_TCP_DELACKMS						50 // longest an ack for in-order data is held back (plus up to a timer tick)
 #define SGIP_TCP_BACKOFFMAX						6000
 
 #define SGIP_SOCKET_MAXSOCKETS					32
@@ -169,6 +239,7 @@ SOFTWARE.
 #define SGIP_DNS_TIMEOUTMS                   5000
 #define SGIP_DNS_MAXRETRY                    3
 #define SGIP_DNS_MAXSERVERRETRY              4
+#define SGIP_DNS_MAXTTL                      86400 // longest time (seconds) a DNS answer is cached
 
 //////////////////////////////////////////////////////////////////////////
 
@@ -225,6 +296,14 @@ extern int sgIP_errno;
 // External option-based dependencies
 #include <nds/interrupts.h>
 
+// SGIP_ENTROPY(): some hard to predict bits, mixed into the SYN cookie secrets (see
+//  sgIP_TCP_AddEntropy).  On the DS: the scanline counter and timer counters.  The wifi driver
+//  adds the wifi chip's random number generator and received signal strengths on top.
+#ifndef SGIP_ENTROPY
+#define SGIP_ENTROPY() ( *(volatile unsigned short *)0x04000006 ^ (*(volatile unsigned short *)0x04000100<<4) \
+	^ (*(volatile unsigned short *)0x04000104<<10) ^ (*(volatile unsigned short *)0x04000108<<16) ^ (*(volatile unsigned short *)0x0400010C<<22) )
+#endif
+
 #ifdef SGIP_INTERRUPT_THREADING_MODEL
 #ifdef __cplusplus
 extern "C" {
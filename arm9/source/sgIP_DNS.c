@@ -29,7 +29,6 @@ SOFTWARE.
 #include "sys/socket.h"
 
 int   dns_sock;
-int   time_count;
 int   last_id;
 int   query_time_start;
 extern unsigned long volatile sgIP_timems;
@@ -48,24 +47,17 @@ volatile sgIP_DNS_Hostent dnsrecord_hostent;
 unsigned char querydata[512];
 unsigned char responsedata[512];
 
-void sgIP_DNS_Init() {
-   int i;
-   for(i=0;i<SGIP_DNS_MAXRECORDSCACHE;i++) dnsrecords[i].flags=0;
-   dns_sock=-1;
-   time_count=0;
+void sgIP_DNS_ExpireTimer(void * data) {
+   ((sgIP_DNS_Record *)data)->flags=0;
 }
 
-void sgIP_DNS_Timer1000ms() {
+void sgIP_DNS_Init() {
    int i;
-   time_count++;
    for(i=0;i<SGIP_DNS_MAXRECORDSCACHE;i++) {
-      if(dnsrecords[i].flags & SGIP_DNS_FLAG_RESOLVED) {
-         dnsrecords[i].TTL-=1;
-         if(dnsrecords[i].TTL<=0) {
-            dnsrecords[i].flags=0;
-         }
-      }
+      dnsrecords[i].flags=0;
+      sgIP_TimerWheel_InitEntry(&dnsrecords[i].timer,sgIP_DNS_ExpireTimer,dnsrecords+i);
    }
+   dns_sock=-1;
 }
 
 int sgIP_DNS_isipaddress(const char * name, unsigned long * ipdest) {
@@ -175,13 +167,14 @@ sgIP_DNS_Record * sgIP_DNS_GetUnusedRecord() {
          return dnsrecords+i;
       }
    }
-   minttl=dnsrecords[0].TTL; j=0;
-   for(i=1;i<SGIP_DNS_MAXRECORDSCACHE;i++) {
-      if(dnsrecords[i].TTL<minttl && !(dnsrecords[i].flags&SGIP_DNS_FLAG_BUSY)) {
+   minttl=dnsrecords[0].timer.expires-sgIP_timems; j=0;
+   for(i=1;i<SGIP_DNS_MAXRECORDSCACHE;i++) { // evict whichever expires first
+      if((int)(dnsrecords[i].timer.expires-sgIP_timems)<minttl && !(dnsrecords[i].flags&SGIP_DNS_FLAG_BUSY)) {
          j=i;
-         minttl=dnsrecords[i].TTL;
+         minttl=dnsrecords[i].timer.expires-sgIP_timems;
       }
    }
+   sgIP_TimerWheel_Cancel(&dnsrecords[j].timer);
    dnsrecords[j].flags=0;
    SGIP_INTR_UNPROTECT();
    return dnsrecords+j;
@@ -246,7 +239,7 @@ int sgIP_DNS_genquery(const char * name) {
    unsigned short * querydata_s = (unsigned short *) querydata;
    unsigned char * querydata_c = querydata;
    // header section
-   querydata_s[0]=htons(time_count&0xFFFF);
+   querydata_s[0]=htons((sgIP_timems/1000)&0xFFFF);
    last_id=querydata_s[0];
    querydata_s[1]=htons(0x0100); // recursion desired, standard query
    querydata_s[2]=htons(1); // one QD (question)
@@ -446,6 +439,8 @@ dns_listenonly:
             for(c=name,i=0;*c;c++,i++) rec->name[i]=*c;
             rec->name[i]=0;
             rec->flags=SGIP_DNS_FLAG_ACTIVE | SGIP_DNS_FLAG_RESOLVED;
+            if(rec->TTL<0 || rec->TTL>SGIP_DNS_MAXTTL) rec->TTL=SGIP_DNS_MAXTTL;
+            sgIP_TimerWheel_Set(&rec->timer,sgIP_timems+rec->TTL*1000);
             break; // we got our answer, let's get out of here!
          }
       } while(1);
@@ -26,6 +26,7 @@ SOFTWARE.
 #define SGIP_DNS_H
 
 #include "sgIP_Config.h"
+#include "sgIP_TimerWheel.h"
 
 #define SGIP_DNS_FLAG_ACTIVE     1
 #define SGIP_DNS_FLAG_RESOLVED   2
@@ -40,6 +41,7 @@ typedef struct SGIP_DNS_RECORD {
    int               numaddr,numalias;
    int               TTL;
    int               flags;
+   sgIP_TimerEntry   timer; // drops the record from the cache when the TTL runs out
 } sgIP_DNS_Record;
 
 typedef struct SGIP_DNS_HOSTENT {
@@ -55,7 +57,6 @@ extern "C" {
 #endif
 
 extern void sgIP_DNS_Init();
-extern void sgIP_DNS_Timer1000ms();
 
 extern sgIP_DNS_Hostent * sgIP_DNS_gethostbyname(const char * name);
 extern sgIP_DNS_Record  * sgIP_DNS_GetUnusedRecord();
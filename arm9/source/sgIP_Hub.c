@@ -24,6 +24,7 @@ SOFTWARE.
 ******************************************************************************/
 #include "sgIP_Hub.h"
 #include "sgIP_ARP.h"
+#include "sgIP_IP.h"
 
 //////////////////////////////////////////////////////////////////////////
 // Global vars
@@ -32,6 +33,7 @@ int NumHWInterfaces;
 int NumProtocolInterfaces;
 sgIP_Hub_Protocol ProtocolInterfaces[SGIP_HUB_MAXPROTOCOLINTERFACES];
 sgIP_Hub_HWInterface HWInterfaces[SGIP_HUB_MAXHWINTERFACES];
+int sgIP_Hub_txbatching; // nesting depth of sgIP_Hub_TxBatchStart
 
 
 
@@ -50,6 +52,7 @@ sgIP_Hub_HWInterface HWInterfaces[SGIP_HUB_MAXHWINTERFACES];
 void sgIP_Hub_Init() {
 	NumHWInterfaces=0;
 	NumProtocolInterfaces=0;
+	sgIP_Hub_txbatching=0;
 
 }
 
@@ -80,6 +83,7 @@ sgIP_Hub_HWInterface * sgIP_Hub_AddHardwareInterface(int (*TransmitFunction)(sgI
 
 	HWInterfaces[n].flags = SGIP_FLAG_HWINTERFACE_IN_USE | SGIP_FLAG_HWINTERFACE_ENABLED;
 	HWInterfaces[n].TransmitFunction=TransmitFunction;
+	HWInterfaces[n].FlushFunction=0;
 	if(InterfaceInit) InterfaceInit(HWInterfaces+n);
 	NumHWInterfaces++;
 	return HWInterfaces+n;
@@ -132,6 +136,26 @@ int sgIP_Hub_ReceiveHardwarePacket(sgIP_Hub_HWInterface * hw, sgIP_memblock * pa
 	sgIP_memblock_free(packet);
 	return 0;
 }
+// a burst of received packets, linked by nextpacket: handled one after another like
+//  sgIP_Hub_ReceiveHardwarePacket, but the acks they call for are sent once at the end.
+int sgIP_Hub_ReceiveHardwarePackets(sgIP_Hub_HWInterface * hw, sgIP_memblock * packets) {
+	sgIP_memblock * next;
+	if(!packets) return 0;
+	SGIP_INTR_PROTECT();
+	sgIP_Hub_TxBatchStart();
+	sgIP_IP_BatchStart();
+	while(packets) {
+		next=packets->nextpacket;
+		packets->nextpacket=0;
+		if(hw) sgIP_Hub_ReceiveHardwarePacket(hw,packets);
+		else sgIP_memblock_free(packets);
+		packets=next;
+	}
+	sgIP_IP_BatchEnd();
+	sgIP_Hub_TxBatchEnd();
+	SGIP_INTR_UNPROTECT();
+	return 0;
+}
 // send packet from a protocol interface, resolve the requisite hardware interface addresses and send it.
 int sgIP_Hub_SendProtocolPacket(int protocol, sgIP_memblock * packet, unsigned long dest_address, unsigned long src_address) {
 	if(!packet) return 0;
@@ -163,8 +187,36 @@ int sgIP_Hub_SendRawPacket(sgIP_Hub_HWInterface * hw, sgIP_memblock * packet) {
 	return 0;
 }
 
+// a transmit batch: hardware interfaces may hold off telling the hardware about the frames
+//  they're given (TransmitFunction) until the batch ends, when FlushFunction is called.
+void sgIP_Hub_TxBatchStart() {
+	sgIP_Hub_txbatching++;
+}
+void sgIP_Hub_TxBatchEnd() {
+	int n;
+	if(sgIP_Hub_txbatching<=0) return;
+	if(--sgIP_Hub_txbatching) return;
+	for(n=0;n<SGIP_HUB_MAXHWINTERFACES;n++) {
+		if((HWInterfaces[n].flags&SGIP_FLAG_HWINTERFACE_IN_USE) && HWInterfaces[n].FlushFunction) HWInterfaces[n].FlushFunction(HWInterfaces+n);
+	}
+}
+int sgIP_Hub_TxBatching() {
+	return sgIP_Hub_txbatching>0;
+}
+
 int sgIP_Hub_IPMaxMessageSize(unsigned long ipaddr) {
-	return SGIP_MTU_OVERRIDE; // hack - make this more accurate soon!
+	int n,mtu;
+	sgIP_Hub_HWInterface * hw;
+	hw=0;
+	for(n=0;n<SGIP_HUB_MAXHWINTERFACES;n++) { // same interface choice as sgIP_Hub_GetCompatibleIP
+		if((HWInterfaces[n].flags&SGIP_FLAG_HWINTERFACE_IN_USE)) {
+			if((HWInterfaces[n].ipaddr & HWInterfaces[n].snmask) == (ipaddr & HWInterfaces[n].snmask)) { hw=HWInterfaces+n; break; }
+			if(!hw) hw=HWInterfaces+n;
+		}
+	}
+	mtu=SGIP_MTU_OVERRIDE;
+	if(hw && hw->MTU>0 && hw->MTU<mtu) mtu=hw->MTU;
+	return mtu;
 }
 
 unsigned long sgIP_Hub_GetCompatibleIP(unsigned long destIP) {
@@ -182,6 +234,20 @@ unsigned long sgIP_Hub_GetCompatibleIP(unsigned long destIP) {
 	return 0;
 }
 
+// is ipaddr the limited broadcast address, the broadcast address of one of our networks, or multicast?
+int sgIP_Hub_IsBroadcast(unsigned long ipaddr) {
+	int n;
+	if(ipaddr==0xFFFFFFFF) return 1;
+	if((htonl(ipaddr)>>28)==14) return 1; // 224.0.0.0/4
+	for(n=0;n<SGIP_HUB_MAXHWINTERFACES;n++) {
+		if((HWInterfaces[n].flags&SGIP_FLAG_HWINTERFACE_IN_USE) && HWInterfaces[n].snmask!=0xFFFFFFFF) {
+			if((HWInterfaces[n].ipaddr & HWInterfaces[n].snmask) == (ipaddr & HWInterfaces[n].snmask)
+				&& (ipaddr | HWInterfaces[n].snmask) == 0xFFFFFFFF) return 1;
+		}
+	}
+	return 0;
+}
+
 extern sgIP_Hub_HWInterface * sgIP_Hub_GetDefaultInterface() {
    int n;
    for(n=0;n<SGIP_HUB_MAXHWINTERFACES;n++) {
@@ -61,6 +61,7 @@ typedef struct SGIP_HUB_HWINTERFACE {
 	unsigned short hwaddrlen;
 	int MTU;
 	int (*TransmitFunction)(struct SGIP_HUB_HWINTERFACE *, sgIP_memblock *);
+	void (*FlushFunction)(struct SGIP_HUB_HWINTERFACE *); // optional; frames sent during a transmit batch may wait for this
 	void * userdata;
 	unsigned long ipaddr, gateway, snmask, dns[3];
 	unsigned char hwaddr[SGIP_MAXHWADDRLEN];
@@ -90,11 +91,16 @@ extern void sgIP_Hub_RemoveProtocolInterface(sgIP_Hub_Protocol * protocol);
 extern void sgIP_Hub_RemoveHardwareInterface(sgIP_Hub_HWInterface * hw);
 
 extern int sgIP_Hub_ReceiveHardwarePacket(sgIP_Hub_HWInterface * hw, sgIP_memblock * packet);
+extern int sgIP_Hub_ReceiveHardwarePackets(sgIP_Hub_HWInterface * hw, sgIP_memblock * packets);
 extern int sgIP_Hub_SendProtocolPacket(int protocol, sgIP_memblock * packet, unsigned long dest_address, unsigned long src_address);
 extern int sgIP_Hub_SendRawPacket(sgIP_Hub_HWInterface * hw, sgIP_memblock * packet);
+extern void sgIP_Hub_TxBatchStart();
+extern void sgIP_Hub_TxBatchEnd();
+extern int sgIP_Hub_TxBatching();
 
 extern int sgIP_Hub_IPMaxMessageSize(unsigned long ipaddr);
 unsigned long sgIP_Hub_GetCompatibleIP(unsigned long destIP);
+extern int sgIP_Hub_IsBroadcast(unsigned long ipaddr);
 
 extern sgIP_Hub_HWInterface * sgIP_Hub_GetDefaultInterface();
 
@@ -26,6 +26,7 @@ SOFTWARE.
 #include "sgIP_ICMP.h"
 #include "sgIP_IP.h"
 #include "sgIP_Hub.h"
+#include "sgIP_TCP.h"
 
 void sgIP_ICMP_Init() {
 
@@ -42,11 +43,32 @@ int sgIP_ICMP_ReceivePacket(sgIP_memblock * mb, unsigned long srcip, unsigned lo
    }
    switch(icmp->type) {
    case 8: // echo request
-      icmp->type=0; // change to echo reply
-      // mod checksum
-      icmp->checksum=0;
-      icmp->checksum=~sgIP_memblock_IPChecksum(mb,0,mb->totallength);
+      {
+         unsigned short oldword=((unsigned short *)icmp)[0];
+         icmp->type=0; // change to echo reply
+         if(icmp->checksum) { // mod checksum for just the type that changed
+            icmp->checksum=sgIP_memblock_ChecksumAdjust(icmp->checksum,oldword,((unsigned short *)icmp)[0]);
+         } else {
+            icmp->checksum=~sgIP_memblock_IPChecksum(mb,0,mb->totallength);
+         }
+      }
       return sgIP_IP_SendViaIP(mb,PROTOCOL_IP_ICMP,destip,srcip);
+   case 3: // destination unreachable
+      if(icmp->code==4) { // fragmentation needed and DF set
+         unsigned char orig[60+8]; // the original IP header and at least 8 bytes of its payload
+         sgIP_Header_IP * iphdr;
+         int hdrlen;
+         hdrlen=sgIP_memblock_CopyToLinear(mb,orig,8,sizeof(orig));
+         iphdr=(sgIP_Header_IP *)orig;
+         if(hdrlen<20) break;
+         if(hdrlen<(iphdr->version_ihl&15)*4+8) break;
+         hdrlen=(iphdr->version_ihl&15)*4;
+         if(iphdr->protocol==PROTOCOL_IP_TCP) {
+            sgIP_Header_TCP * tcp = (sgIP_Header_TCP *)(orig+hdrlen);
+            sgIP_TCP_PMTUUpdate(iphdr->src_address,iphdr->dest_address,tcp->srcport,tcp->destport,htonl(tcp->seqnum),htons(((unsigned short *)&icmp->xtra)[1]));
+         }
+      }
+      break;
    case 0: // echo reply (ignore for now)
    default: // others (ignore for now)
       break;
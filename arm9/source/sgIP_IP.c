@@ -33,12 +33,10 @@ int idnum_count;
 
 int sgIP_IP_ReceivePacket(sgIP_memblock * mb) {
 	sgIP_Header_IP * iphdr;
-	unsigned short * chksum_calc;
 	int chksum_temp;
 	int hdrlen;
 
 	iphdr=(sgIP_Header_IP *)mb->datastart;
-	chksum_calc=(unsigned short *)mb->datastart;
 	// check that header is valid:
 	hdrlen=iphdr->version_ihl&15;
 	// check length...
@@ -86,6 +84,13 @@ int sgIP_IP_ReceivePacket(sgIP_memblock * mb) {
 
 	return 0;
 }
+// packets received between these are one burst (see sgIP_Hub_ReceiveHardwarePackets)
+void sgIP_IP_BatchStart() {
+	sgIP_TCP_BatchStart();
+}
+void sgIP_IP_BatchEnd() {
+	sgIP_TCP_BatchEnd();
+}
 int sgIP_IP_MaxContentsSize(unsigned long destip) {
 	return sgIP_Hub_IPMaxMessageSize(destip)-sgIP_IP_RequiredHeaderSize();
 }
@@ -100,7 +105,10 @@ int sgIP_IP_SendViaIP(sgIP_memblock * mb, int protocol, unsigned long srcip, uns
 	iphdr=(sgIP_Header_IP *)mb->datastart;
 	chksum_calc=(unsigned short *)mb->datastart;
 	iphdr->dest_address=destip;
-	iphdr->fragment_offset=0;
+	// DF - TCP sizes segments, options included, to the path MTU.  anything that still doesn't fit
+	//  the link goes without it, so a router may fragment it rather than drop it.
+	if(protocol==PROTOCOL_IP_TCP && mb->totallength<=sgIP_Hub_IPMaxMessageSize(destip)) iphdr->fragment_offset=htons(0x4000);
+	else iphdr->fragment_offset=0;
 	iphdr->header_checksum=0;
 	iphdr->identification=idnum_count++;
 	iphdr->protocol=protocol;
@@ -51,6 +51,8 @@ extern "C" {
 #endif
 
 	extern int sgIP_IP_ReceivePacket(sgIP_memblock * mb);
+	extern void sgIP_IP_BatchStart();
+	extern void sgIP_IP_BatchEnd();
 	extern int sgIP_IP_MaxContentsSize(unsigned long destip);
 	extern int sgIP_IP_RequiredHeaderSize();
 	extern int sgIP_IP_SendViaIP(sgIP_memblock * mb, int protocol, unsigned long srcip, unsigned long destip);
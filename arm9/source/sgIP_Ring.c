@@ -0,0 +1,120 @@
+// DSWifi Project - sgIP Internet Protocol Stack Implementation
+// Copyright (C) 2005-2006 Stephen Stair - sgstair@akkit.org - http://www.akkit.org
+/****************************************************************************** 
+DSWifi Lib and test materials are licenced under the MIT open source licence:
+Copyright (c) 2005-2006 Stephen Stair
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#include "sgIP_Ring.h"
+#include <string.h>
+
+// Every transfer is at most two spans (up to the end of the buffer, then from its start), each
+//  one memcpy; the ARM memcpy moves aligned data a word (or an ldm/stm burst) at a time.
+
+void sgIP_Ring_Init(sgIP_Ring * r) {
+	r->buf=0;
+	r->size=0;
+	r->in=r->out=0;
+}
+int sgIP_Ring_Alloc(sgIP_Ring * r, int size) {
+	r->buf=sgIP_malloc(size);
+	if(!r->buf) return 1;
+	r->size=size;
+	r->in=r->out=0;
+	return 0;
+}
+void sgIP_Ring_Free(sgIP_Ring * r) {
+	if(r->buf) sgIP_free(r->buf);
+	sgIP_Ring_Init(r);
+}
+// move the contents to a new buffer of newsize bytes, if used bytes (which may count more than
+//  is in the ring now) fit in it.
+int sgIP_Ring_Resize(sgIP_Ring * r, int newsize, int used) {
+	unsigned char * newbuf;
+	int len;
+	if(used>newsize-1) return 0; // too full, try again later
+	newbuf=sgIP_malloc(newsize);
+	if(!newbuf) return 0;
+	len=sgIP_Ring_Read(r,newbuf,newsize-1,0);
+	sgIP_free(r->buf);
+	r->buf=newbuf;
+	r->size=newsize;
+	r->in=0;
+	r->out=len;
+	return 1;
+}
+
+int sgIP_Ring_Used(sgIP_Ring * r) {
+	int n;
+	n=r->out-r->in;
+	if(n<0) n+=r->size;
+	return n;
+}
+int sgIP_Ring_Space(sgIP_Ring * r) {
+	int n;
+	n=r->size-sgIP_Ring_Used(r)-1;
+	if(n<0) n=0; // (no buffer)
+	return n;
+}
+int sgIP_Ring_Read(sgIP_Ring * r, void * dest, int len, int peek) {
+	int n,used;
+	used=sgIP_Ring_Used(r);
+	if(len>used) len=used;
+	if(len<=0) return 0;
+	n=r->size-r->in; // bytes until the end of the buffer
+	if(n>len) n=len;
+	memcpy(dest,r->buf+r->in,n);
+	if(len>n) memcpy(((char *)dest)+n,r->buf,len-n);
+	if(!peek) {
+		n=r->in+len;
+		if(n>=r->size) n-=r->size;
+		r->in=n;
+	}
+	return len;
+}
+int sgIP_Ring_Write(sgIP_Ring * r, const void * src, int len) {
+	int n,space;
+	space=sgIP_Ring_Space(r);
+	if(len>space) len=space;
+	if(len<=0) return 0;
+	n=r->size-r->out;
+	if(n>len) n=len;
+	memcpy(r->buf+r->out,src,n);
+	if(len>n) memcpy(r->buf,((const char *)src)+n,len-n);
+	n=r->out+len;
+	if(n>=r->size) n-=r->size;
+	r->out=n;
+	return len;
+}
+int sgIP_Ring_WriteMemblock(sgIP_Ring * r, sgIP_memblock * mb, int offset, int len) {
+	int n,space;
+	space=sgIP_Ring_Space(r);
+	if(len>space) len=space;
+	if(len<=0) return 0;
+	n=r->size-r->out;
+	if(n>len) n=len;
+	sgIP_memblock_CopyToLinear(mb,r->buf+r->out,offset,n);
+	if(len>n) sgIP_memblock_CopyToLinear(mb,r->buf,offset+n,len-n);
+	n=r->out+len;
+	if(n>=r->size) n-=r->size;
+	r->out=n;
+	return len;
+}
@@ -0,0 +1,61 @@
+// DSWifi Project - sgIP Internet Protocol Stack Implementation
+// Copyright (C) 2005-2006 Stephen Stair - sgstair@akkit.org - http://www.akkit.org
+/****************************************************************************** 
+DSWifi Lib and test materials are licenced under the MIT open source licence:
+Copyright (c) 2005-2006 Stephen Stair
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#ifndef SGIP_RING_H
+#define SGIP_RING_H
+
+#include "sgIP_Config.h"
+#include "sgIP_memblock.h"
+
+// sgIP_Ring - a byte fifo in a circular buffer, embedded in the record that owns it.
+//  one byte is always left free, so in==out means empty.
+typedef struct SGIP_RING {
+	unsigned char * buf;
+	int size; // allocated bytes, 0 if there is no buffer
+	int in, out; // next byte to read, next byte to write
+} sgIP_Ring;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	extern void sgIP_Ring_Init(sgIP_Ring * r); // no buffer yet
+	extern int sgIP_Ring_Alloc(sgIP_Ring * r, int size); // returns 0, or 1 if out of memory
+	extern void sgIP_Ring_Free(sgIP_Ring * r);
+	extern int sgIP_Ring_Resize(sgIP_Ring * r, int newsize, int used); // returns 1 if moved to a newsize buffer
+
+	extern int sgIP_Ring_Used(sgIP_Ring * r);
+	extern int sgIP_Ring_Space(sgIP_Ring * r);
+	extern int sgIP_Ring_Read(sgIP_Ring * r, void * dest, int len, int peek); // returns bytes read
+	extern int sgIP_Ring_Write(sgIP_Ring * r, const void * src, int len); // returns bytes written
+	extern int sgIP_Ring_WriteMemblock(sgIP_Ring * r, sgIP_memblock * mb, int offset, int len); // as above, from a packet
+
+#ifdef __cplusplus
+};
+#endif
+
+
+#endif
@@ -26,69 +26,168 @@ SOFTWARE.
 #include "sgIP_TCP.h"
 #include "sgIP_IP.h"
 #include "sgIP_Hub.h"
+#include "sgIP_TimerWheel.h"
 #include "sys/socket.h"
+#include "netinet/tcp.h"
+#include <string.h>
 
 sgIP_Record_TCP * tcprecords;
 int port_counter;
-unsigned long lasttime;
 extern unsigned long volatile sgIP_timems;
-sgIP_TCP_SYNCookie synlist[SGIP_TCP_MAXSYNS]; 
+sgIP_Record_TCP * tcphash[SGIP_TCP_HASHSIZE]; // connected records, by (remote ip, local port, remote port)
+sgIP_Record_TCP * tcplistenhash[SGIP_TCP_PORTHASHSIZE]; // listening records, by local port
+sgIP_Record_TCP * tcpbindhash[SGIP_TCP_PORTHASHSIZE]; // all bound records, by local port
 
-int numsynlist; // number of active entries in synlist (earliest first)
+int sgIP_TCP_batching; // inside sgIP_TCP_BatchStart/sgIP_TCP_BatchEnd (nesting count)
+sgIP_Record_TCP * tcpbatchlist; // records owed an ack at the end of the current receive batch
+unsigned long syncookie_pool; // entropy gathered for the SYN cookie secrets
+unsigned long syncookie_secret[4]; // mixed into every SYN cookie, one for each value of its time counter
+int syncookie_counter; // time counter the newest secret was drawn for, -1 before any are
+const unsigned short sgIP_TCP_CookieMSS[4] = { 536, 1220, 1420, 1460 };
+const signed char sgIP_TCP_CookieWS[8] = { -1, 0, 2, 4, 6, 7, 8, 9 }; // -1: no window scale offered
+
+int sgIP_TCP_Output(sgIP_Record_TCP * rec, int forceack);
+void sgIP_TCP_Retransmit(sgIP_Record_TCP * rec);
+void sgIP_TCP_RetransmitTimeout(sgIP_Record_TCP * rec);
+void sgIP_TCP_UpdateScoreboard(sgIP_Record_TCP * rec, sgIP_TCP_Options * opt);
+int sgIP_TCP_LocalMSS(unsigned long destip);
+void sgIP_TCP_InitCongestion(sgIP_Record_TCP * rec);
+int sgIP_TCP_FlightSize(sgIP_Record_TCP * rec);
+int sgIP_TCP_Pipe(sgIP_Record_TCP * rec);
+int sgIP_TCP_FullSegment(sgIP_Record_TCP * rec);
+void sgIP_TCP_NewAck(sgIP_Record_TCP * rec, int acked, int flight);
+void sgIP_TCP_DupAck(sgIP_Record_TCP * rec);
+void sgIP_TCP_RttSample(sgIP_Record_TCP * rec, int rtt);
+void sgIP_TCP_UpdateTimer(sgIP_Record_TCP * rec);
+void sgIP_TCP_BatchUnlink(sgIP_Record_TCP * rec);
+int sgIP_TCP_AllocBuffers(sgIP_Record_TCP * rec);
+void sgIP_TCP_ResizeBuffers(sgIP_Record_TCP * rec);
+int sgIP_TCP_SynWindow(sgIP_Record_TCP * rec);
+int sgIP_TCP_WindowShift(int bufsize);
+void sgIP_TCP_SetWindowScale(sgIP_Record_TCP * rec, int wscale);
+sgIP_memblock * sgIP_TCP_TxBlock(sgIP_Record_TCP * rec, unsigned long seq, int * offset);
+void sgIP_TCP_TxAcked(sgIP_Record_TCP * rec, int acked);
+void sgIP_TCP_TxFlush(sgIP_Record_TCP * rec);
+int sgIP_TCP_MaxPayload(sgIP_Record_TCP * rec, int flags);
 
 void sgIP_TCP_Init() {
+	int i;
 	tcprecords=0;
-   numsynlist=0;
+	sgIP_TCP_batching=0;
+	tcpbatchlist=0;
+	sgIP_TCP_AddEntropy(SGIP_ENTROPY());
+	syncookie_counter=-1;
+	for(i=0;i<SGIP_TCP_HASHSIZE;i++) tcphash[i]=0;
+	for(i=0;i<SGIP_TCP_PORTHASHSIZE;i++) { tcplistenhash[i]=0; tcpbindhash[i]=0; }
 	port_counter=SGIP_TCP_FIRSTOUTGOINGPORT;
-	lasttime=sgIP_timems;
 }
 
-void sgIP_TCP_Timer() { // scan through tcp records and resend anything necessary
+int sgIP_TCP_HashConn(unsigned long destip, unsigned short srcport, unsigned short destport) {
+	unsigned long hash;
+	hash=destip ^ (((unsigned long)srcport)<<16) ^ destport;
+	hash^=hash>>16;
+	hash^=hash>>8;
+	return hash&(SGIP_TCP_HASHSIZE-1);
+}
+int sgIP_TCP_HashPort(unsigned short port) {
+	return (port ^ (port>>8))&(SGIP_TCP_PORTHASHSIZE-1);
+}
+
+// unlink a record from a hash bucket chained through either hashnext or bindnext
+void sgIP_TCP_HashUnlink(sgIP_Record_TCP ** bucket, sgIP_Record_TCP * rec, int bindchain) {
+	sgIP_Record_TCP * t;
+	while((t=*bucket)) {
+		if(t==rec) {
+			*bucket = bindchain?rec->bindnext:rec->hashnext;
+			return;
+		}
+		bucket = bindchain?&t->bindnext:&t->hashnext;
+	}
+}
+void sgIP_TCP_HashInsert(sgIP_Record_TCP * rec, int which) {
+	int i;
+	if(rec->hashflags&which) return;
+	rec->hashflags|=which;
+	switch(which) {
+	case SGIP_TCP_HASHED_CONN:
+		i=sgIP_TCP_HashConn(rec->destip,rec->srcport,rec->destport);
+		rec->hashnext=tcphash[i];
+		tcphash[i]=rec;
+		break;
+	case SGIP_TCP_HASHED_LISTEN:
+		i=sgIP_TCP_HashPort(rec->srcport);
+		rec->hashnext=tcplistenhash[i];
+		tcplistenhash[i]=rec;
+		break;
+	case SGIP_TCP_HASHED_BIND:
+		i=sgIP_TCP_HashPort(rec->srcport);
+		rec->bindnext=tcpbindhash[i];
+		tcpbindhash[i]=rec;
+		break;
+	}
+}
+void sgIP_TCP_HashRemove(sgIP_Record_TCP * rec) {
+	if(rec->hashflags&SGIP_TCP_HASHED_CONN)
+		sgIP_TCP_HashUnlink(tcphash+sgIP_TCP_HashConn(rec->destip,rec->srcport,rec->destport),rec,0);
+	if(rec->hashflags&SGIP_TCP_HASHED_LISTEN)
+		sgIP_TCP_HashUnlink(tcplistenhash+sgIP_TCP_HashPort(rec->srcport),rec,0);
+	if(rec->hashflags&SGIP_TCP_HASHED_BIND)
+		sgIP_TCP_HashUnlink(tcpbindhash+sgIP_TCP_HashPort(rec->srcport),rec,1);
+	rec->hashflags=0;
+}
+
+// find the record an incoming segment belongs to - an exact connection match wins over a listener.
+sgIP_Record_TCP * sgIP_TCP_FindRecord(unsigned long srcip, unsigned long destip, unsigned short srcport, unsigned short destport, int flags) {
+	sgIP_Record_TCP * rec;
+	rec=tcphash[sgIP_TCP_HashConn(srcip,destport,srcport)];
+	while(rec) {
+		if(rec->srcport==destport && rec->destport==srcport && rec->destip==srcip && (rec->srcip==destip || rec->srcip==0)) return rec;
+		rec=rec->hashnext;
+	}
+	if(!(flags&SGIP_TCP_FLAG_SYN)) return 0;
+	rec=tcplistenhash[sgIP_TCP_HashPort(destport)];
+	while(rec) {
+		if(rec->srcport==destport && (rec->srcip==destip || rec->srcip==0)) return rec;
+		rec=rec->hashnext;
+	}
+	return 0;
+}
+
+// a record's timer went off: resend whatever needs it, then arm the timer for the next deadline.
+void sgIP_TCP_RecordTimer(void * data) {
    sgIP_Record_TCP * rec;
-   int time,i,j;
-   time=sgIP_timems-lasttime;
-   lasttime=sgIP_timems;
-   for(i=0;i<numsynlist;i++) {
-	   if(synlist[i].timenext<=time) {
-		   j=time-synlist[i].timenext;
-		   synlist[i].timebackoff*=2;
-		   if(synlist[i].timebackoff>SGIP_TCP_BACKOFFMAX) synlist[i].timebackoff=SGIP_TCP_BACKOFFMAX;
-		   if(j>synlist[i].timebackoff) synlist[i].timenext=0; else synlist[i].timenext=synlist[i].timebackoff-j;
-		   // resend SYN		
-		   sgIP_TCP_SendSynReply(SGIP_TCP_FLAG_SYN|SGIP_TCP_FLAG_ACK,synlist[i].localseq,synlist[i].remoteseq,synlist[i].localip,synlist[i].remoteip,synlist[i].localport,synlist[i].remoteport,-1);
-	   } else {
-		   synlist[i].timenext-=time;
-	   }
+   int time,j;
+   rec=(sgIP_Record_TCP *)data;
+   time=sgIP_timems-rec->time_last_action;
+   if(rec->ackpending && (int)(sgIP_timems-rec->ackdue)>=0) { // delayed ack is due
+      sgIP_TCP_SendSegment(rec,SGIP_TCP_FLAG_ACK,rec->sequence_next,0);
    }
-   rec=tcprecords;
-   while(rec) {
-      time=sgIP_timems-rec->time_last_action;
-      switch(rec->tcpstate) {
-      case SGIP_TCP_STATE_NODATA: // newly allocated [do nothing]
-      case SGIP_TCP_STATE_UNUSED: // allocated & BINDed [do nothing]
-      case SGIP_TCP_STATE_CLOSED: // Block is unused. [do nothing]
-      case SGIP_TCP_STATE_LISTEN: // listening [do nothing]
-      case SGIP_TCP_STATE_FIN_WAIT_2: // got ACK for our FIN, haven't got FIN yet. [do nothing]
-         break;
-      case SGIP_TCP_STATE_SYN_SENT: // connect initiated [resend syn]
-         if(time>rec->time_backoff) {
-            rec->retrycount++;
-            if(rec->retrycount>=SGIP_TCP_MAXRETRY) {
-               //error
-               rec->errorcode=ECONNABORTED;
-               rec->tcpstate=SGIP_TCP_STATE_CLOSED;
-               break;
-            }
+   switch(rec->tcpstate) {
+   case SGIP_TCP_STATE_NODATA: // newly allocated [do nothing]
+   case SGIP_TCP_STATE_UNUSED: // allocated & BINDed [do nothing]
+   case SGIP_TCP_STATE_CLOSED: // Block is unused. [do nothing]
+   case SGIP_TCP_STATE_LISTEN: // listening [do nothing]
+   case SGIP_TCP_STATE_FIN_WAIT_2: // got ACK for our FIN, haven't got FIN yet. [do nothing]
+      break;
+   case SGIP_TCP_STATE_SYN_SENT: // connect initiated [resend syn]
+      if(time>rec->time_backoff) {
+         rec->retrycount++;
+         if(rec->retrycount>=SGIP_TCP_MAXRETRY) {
+            //error
+            rec->errorcode=ECONNABORTED;
+            rec->tcpstate=SGIP_TCP_STATE_CLOSED;
+            break;
+         }
 			j=rec->time_backoff;
 			j*=2;
 			if(j>SGIP_TCP_BACKOFFMAX) j=SGIP_TCP_BACKOFFMAX;
-            sgIP_TCP_SendPacket(rec,SGIP_TCP_FLAG_SYN,0);   
+         sgIP_TCP_SendPacket(rec,SGIP_TCP_FLAG_SYN,0);   
 			rec->time_backoff=j; // preserve backoff
-         }
-         break;
+      }
+      break;
 	  case SGIP_TCP_STATE_CLOSE_WAIT: // got FIN, wait for user code to close socket & send FIN [Finish sending data in buffer]
-      case SGIP_TCP_STATE_ESTABLISHED: // syns have been exchanged [check for data in buffer, send]
-		 if(rec->want_shutdown==1 && rec->buf_tx_out==rec->buf_tx_in) { // oblige & shutdown
+   case SGIP_TCP_STATE_ESTABLISHED: // syns have been exchanged [check for data in buffer, send]
+		 if(rec->want_shutdown==1 && !rec->txq_len) { // oblige & shutdown
 			 sgIP_TCP_SendPacket(rec,SGIP_TCP_FLAG_FIN | SGIP_TCP_FLAG_ACK,0);
 			 if(rec->tcpstate==SGIP_TCP_STATE_CLOSE_WAIT) {
 				 rec->tcpstate=SGIP_TCP_STATE_LAST_ACK;
@@ -98,82 +197,102 @@ void sgIP_TCP_Timer() { // scan through tcp records and resend anything necessar
 			 rec->want_shutdown=2;
 			 break;
 		 }
-         j=rec->buf_tx_out-rec->buf_tx_in;
-         if(j<0) j+=SGIP_TCP_TRANSMITBUFFERLENGTH;
-         j+=(int)(rec->sequence-rec->sequence_next); 
-         if(j>0) {// never-sent bytes
-            if(time>SGIP_TCP_TRANSMIT_DELAY) { // 1000 is an arbitrary constant.
-               j=rec->buf_tx_out-rec->buf_tx_in;
-               if(j<0) j+=SGIP_TCP_TRANSMITBUFFERLENGTH;
-               i=(int)(rec->txwindow-rec->sequence);
-               if(j>i) j=i;
-               i=sgIP_IP_MaxContentsSize(rec->destip)-20; // max tcp data size
-               if(j>i) j=i;
-               sgIP_TCP_SendPacket(rec,SGIP_TCP_FLAG_ACK,j);
-               break;
-            }
-         }
-         if(time>rec->time_backoff && rec->buf_tx_out!=rec->buf_tx_in) { // resend last packet
-            j=rec->buf_tx_out-rec->buf_tx_in;
-            if(j<0) j+=SGIP_TCP_TRANSMITBUFFERLENGTH;
-            i=(int)(rec->txwindow-rec->sequence);
-            if(j>i) j=i;
-            i=sgIP_IP_MaxContentsSize(rec->destip)-20; // max tcp data size
-            if(j>i) j=i;
-            i=j;
-            
+      if(time>rec->time_backoff && rec->txq_len
+         && (rec->sequence_next!=rec->sequence || rec->txwindow==rec->sequence)) { // resend what was lost (or probe a closed window)
 			j=rec->time_backoff;
 			j*=2;
 			if(j>SGIP_TCP_BACKOFFMAX) j=SGIP_TCP_BACKOFFMAX;
-            sgIP_TCP_SendPacket(rec,SGIP_TCP_FLAG_ACK,i);
+         sgIP_TCP_RetransmitTimeout(rec);
 			rec->time_backoff=j; // preserve backoff
+         break;
+      }
+      j=rec->txq_len-(int)(rec->sequence_next-rec->sequence);
+      if(j>0) { // never-sent bytes (Nagle/TCP_CORK may still hold a partial segment back)
+         sgIP_TCP_Output(rec,0);
+      }
+      break;
+   case SGIP_TCP_STATE_FIN_WAIT_1: // sent a FIN, haven't got FIN or ACK yet. [resend fin]
+      if(time>rec->time_backoff) {
+         rec->retrycount++;
+         if(rec->retrycount>=SGIP_TCP_MAXRETRY) {
+            //error
+            rec->errorcode=ETIMEDOUT;
+            rec->tcpstate=SGIP_TCP_STATE_CLOSED;
             break;
          }
-         break;
-      case SGIP_TCP_STATE_FIN_WAIT_1: // sent a FIN, haven't got FIN or ACK yet. [resend fin]
-         if(time>rec->time_backoff) {
-            rec->retrycount++;
-            if(rec->retrycount>=SGIP_TCP_MAXRETRY) {
-               //error
-               rec->errorcode=ETIMEDOUT;
-               rec->tcpstate=SGIP_TCP_STATE_CLOSED;
-               break;
-            }
 			j=rec->time_backoff;
 			j*=2;
 			if(j>SGIP_TCP_BACKOFFMAX) j=SGIP_TCP_BACKOFFMAX;
-            sgIP_TCP_SendPacket(rec,SGIP_TCP_FLAG_FIN,0);
+         sgIP_TCP_SendPacket(rec,SGIP_TCP_FLAG_FIN,0);
 			rec->time_backoff=j; // preserve backoff
+      }
+      break;
+   case SGIP_TCP_STATE_CLOSING: // got FIN, waiting for ACK of our FIN [resend FINACK]
+   case SGIP_TCP_STATE_LAST_ACK: // wait for ACK of our last FIN [resend FINACK]
+      if(time>rec->time_backoff) {
+         rec->retrycount++;
+         if(rec->retrycount>=SGIP_TCP_MAXRETRY) {
+            //error
+            rec->errorcode=ETIMEDOUT;
+            rec->tcpstate=SGIP_TCP_STATE_CLOSED;
+            break;
          }
-         break;
-      case SGIP_TCP_STATE_CLOSING: // got FIN, waiting for ACK of our FIN [resend FINACK]
-      case SGIP_TCP_STATE_LAST_ACK: // wait for ACK of our last FIN [resend FINACK]
-         if(time>rec->time_backoff) {
-            rec->retrycount++;
-            if(rec->retrycount>=SGIP_TCP_MAXRETRY) {
-               //error
-               rec->errorcode=ETIMEDOUT;
-               rec->tcpstate=SGIP_TCP_STATE_CLOSED;
-               break;
-            }
 			j=rec->time_backoff;
 			j*=2;
 			if(j>SGIP_TCP_BACKOFFMAX) j=SGIP_TCP_BACKOFFMAX;
-            sgIP_TCP_SendPacket(rec,SGIP_TCP_FLAG_FIN | SGIP_TCP_FLAG_ACK,0);
+         sgIP_TCP_SendPacket(rec,SGIP_TCP_FLAG_FIN | SGIP_TCP_FLAG_ACK,0);
 			rec->time_backoff=j; // preserve backoff
+      }
+      break;
+   case SGIP_TCP_STATE_TIME_WAIT: // wait to ensure remote tcp knows it's been terminated. [reset in 2MSL]
+      if(time>SGIP_TCP_TIMEMS_2MSL) {
+         rec->errorcode=ESHUTDOWN;
+         rec->tcpstate=SGIP_TCP_STATE_CLOSED;
+      }
+      break;
+   }      
+   sgIP_TCP_UpdateTimer(rec);
+}
+// arm a record's timer for the next thing sgIP_TCP_RecordTimer will have to do, if anything.
+//  call whenever the connection's state, buffers or retransmit timer may have changed.
+void sgIP_TCP_UpdateTimer(sgIP_Record_TCP * rec) {
+   unsigned long t;
+   switch(rec->tcpstate) {
+   case SGIP_TCP_STATE_SYN_SENT: // resend syn
+   case SGIP_TCP_STATE_FIN_WAIT_1: // resend fin
+   case SGIP_TCP_STATE_CLOSING: // resend finack
+   case SGIP_TCP_STATE_LAST_ACK: // resend finack
+      t=rec->time_last_action+rec->time_backoff+1;
+      break;
+   case SGIP_TCP_STATE_CLOSE_WAIT:
+   case SGIP_TCP_STATE_ESTABLISHED:
+      if(!rec->txq_len) {
+         if(rec->want_shutdown!=1) {
+            if(rec->ackpending) sgIP_TimerWheel_Set(&rec->timer,rec->ackdue);
+            else sgIP_TimerWheel_Cancel(&rec->timer);
+            return;
          }
-         break;
-      case SGIP_TCP_STATE_TIME_WAIT: // wait to ensure remote tcp knows it's been terminated. [reset in 2MSL]
-         if(time>SGIP_TCP_TIMEMS_2MSL) {
-            rec->errorcode=ESHUTDOWN;
-            rec->tcpstate=SGIP_TCP_STATE_CLOSED;
-         }
-         break;
-      }      
-
-
-      rec=rec->next;
+         t=sgIP_timems; // send our fin on the next tick
+      } else if(rec->sequence_next!=rec->sequence || rec->txwindow==rec->sequence) {
+         t=rec->time_last_action+rec->time_backoff+1; // retransmit (or probe a closed window)
+      } else if(rec->cork && rec->want_shutdown!=1) { // holding a partial segment until uncorked
+         if(rec->ackpending) sgIP_TimerWheel_Set(&rec->timer,rec->ackdue);
+         else sgIP_TimerWheel_Cancel(&rec->timer);
+         return;
+      } else {
+         t=rec->time_last_action+rec->time_backoff+1; // nothing in flight and still unsent: sending failed, try again
+      }
+      break;
+   case SGIP_TCP_STATE_TIME_WAIT:
+      t=rec->time_last_action+SGIP_TCP_TIMEMS_2MSL+1;
+      break;
+   default:
+      if(rec->ackpending) { sgIP_TimerWheel_Set(&rec->timer,rec->ackdue); return; }
+      sgIP_TimerWheel_Cancel(&rec->timer);
+      return;
    }
+   if(rec->ackpending && (int)(rec->ackdue-t)<0) t=rec->ackdue;
+   sgIP_TimerWheel_Set(&rec->timer,t);
 }
 
 
@@ -186,19 +305,92 @@ unsigned long sgIP_TCP_support_seqhash(unsigned long srcip, unsigned long destip
 	hash ^= destip * (0x04020108+(sgIP_timems<<5));
 	return hash;
 }
+
+// stir some unpredictable bits into the pool the SYN cookie secrets are drawn from
+void sgIP_TCP_AddEntropy(unsigned long data) {
+	unsigned long h;
+	SGIP_INTR_PROTECT();
+	h=syncookie_pool^data;
+	h*=0x9E3779B1; h^=h>>15;
+	h*=0x85EBCA77; h^=h>>13;
+	syncookie_pool=h;
+	SGIP_INTR_UNPROTECT();
+}
+// the secret for cookies stamped with time counter c.  a fresh one is drawn from the pool each time
+//  the counter moves on, so a secret is only any use while cookies made with it are still accepted.
+unsigned long sgIP_TCP_CookieSecret(int c) {
+	int now,i;
+	now=sgIP_timems>>SGIP_TCP_COOKIE_TIMESHIFT;
+	if(syncookie_counter<0 || (unsigned int)(now-syncookie_counter)>=4) { // first use, or idle so long every secret is stale (or sgIP_timems wrapped): all get a new one
+		for(i=0;i<4;i++) {
+			sgIP_TCP_AddEntropy(SGIP_ENTROPY()^sgIP_timems^i);
+			syncookie_secret[i]=syncookie_pool;
+		}
+		syncookie_counter=now;
+	}
+	while(syncookie_counter!=now) {
+		syncookie_counter++;
+		sgIP_TCP_AddEntropy(SGIP_ENTROPY()^sgIP_timems);
+		syncookie_secret[syncookie_counter&3]=syncookie_pool;
+	}
+	return syncookie_secret[c&3];
+}
+
+// SYN cookies: a listening socket keeps no state for half-open connections. Everything needed
+// to set up the connection is packed into the sequence number of our SYN-ACK instead:
+//   bits 31-30: time counter (sgIP_timems/65536), low bits
+//   bits 29-28: index into sgIP_TCP_CookieMSS
+//   bit 27:     remote end offered SACK
+//   bits 26-24: index into sgIP_TCP_CookieWS
+//   bits 23-0:  hash of the above with the addresses, ports and remote initial sequence number
+// mss and window scale are rounded down to a table entry; a smaller scale only understates the
+//  remote end's window.
+unsigned long sgIP_TCP_CookieHash(unsigned long srcip, unsigned long destip, unsigned short srcport, unsigned short destport, unsigned long remoteseq, unsigned long data) {
+	unsigned long hash;
+	hash=sgIP_TCP_CookieSecret(data>>30)^data;
+	hash=(hash^srcip)*0x9E3779B1; hash^=hash>>15;
+	hash=(hash^destip)*0x85EBCA77; hash^=hash>>13;
+	hash=(hash^((srcport<<16)|destport))*0xC2B2AE3D; hash^=hash>>16;
+	hash=(hash^remoteseq)*0x27D4EB2F; hash^=hash>>15;
+	return hash;
+}
+unsigned long sgIP_TCP_MakeCookie(unsigned long srcip, unsigned long destip, unsigned short srcport, unsigned short destport, unsigned long remoteseq, int mss, int sackok, int wscale) {
+	unsigned long data;
+	int i;
+	for(i=3;i>0;i--) if(sgIP_TCP_CookieMSS[i]<=mss) break; // largest table entry not above mss
+	data=(((sgIP_timems>>SGIP_TCP_COOKIE_TIMESHIFT)&3)<<30) | (i<<28);
+	if(sackok) data|=1<<27;
+	for(i=7;i>0;i--) if(sgIP_TCP_CookieWS[i]<=wscale) break; // likewise for the window scale
+	data|=i<<24;
+	return data | (sgIP_TCP_CookieHash(srcip,destip,srcport,destport,remoteseq,data)&0xFFFFFF);
+}
+// returns 1 and fills in mss/sackok/wscale if cookie is one we handed out recently for this connection.
+int sgIP_TCP_CheckCookie(unsigned long srcip, unsigned long destip, unsigned short srcport, unsigned short destport, unsigned long remoteseq, unsigned long cookie, int * mss, int * sackok, int * wscale) {
+	unsigned long data;
+	if((((sgIP_timems>>SGIP_TCP_COOKIE_TIMESHIFT)-(cookie>>30))&3)>SGIP_TCP_COOKIE_MAXAGE) return 0; // stale
+	data=cookie&0xFF000000;
+	if((sgIP_TCP_CookieHash(srcip,destip,srcport,destport,remoteseq,data)^cookie)&0xFFFFFF) return 0;
+	*mss=sgIP_TCP_CookieMSS[(cookie>>28)&3];
+	*sackok=(cookie>>27)&1;
+	*wscale=sgIP_TCP_CookieWS[(cookie>>24)&7];
+	return 1;
+}
+
 int sgIP_TCP_GetUnusedOutgoingPort() {
 	int myport,clear;
+	unsigned short nport;
 	sgIP_Record_TCP * rec;
    port_counter+=(sgIP_timems&1023); // semi-random
    if(port_counter>SGIP_TCP_LASTOUTGOINGPORT) port_counter=SGIP_TCP_FIRSTOUTGOINGPORT;
 	while(1) {
-		rec = tcprecords;
 		myport=port_counter++;
 		if(port_counter>SGIP_TCP_LASTOUTGOINGPORT) port_counter=SGIP_TCP_FIRSTOUTGOINGPORT;
+		nport=htons(myport); // records store ports in network order
+		rec = tcpbindhash[sgIP_TCP_HashPort(nport)];
 		clear=1;
 		while(rec) {
-			if(rec->srcport==myport && rec->tcpstate!=SGIP_TCP_STATE_CLOSED && rec->tcpstate!=SGIP_TCP_STATE_NODATA) { clear=0; break; }
-			rec=rec->next;
+			if(rec->srcport==nport && rec->tcpstate!=SGIP_TCP_STATE_CLOSED && rec->tcpstate!=SGIP_TCP_STATE_NODATA) { clear=0; break; }
+			rec=rec->bindnext;
 		}
 		if(clear) return myport;
 	}
@@ -207,7 +399,6 @@ int sgIP_TCP_GetUnusedOutgoingPort() {
 int sgIP_TCP_CalcChecksum(sgIP_memblock * mb, unsigned long srcip, unsigned long destip, int totallength) {
 	int checksum;
 	if(!mb) return 0;
-	if(mb->totallength&1) mb->datastart[mb->totallength]=0;
 	checksum=sgIP_memblock_IPChecksum(mb,0,mb->totallength);
 	// add in checksum of "faux header"
 	checksum+=(destip&0xFFFF);
@@ -223,10 +414,193 @@ int sgIP_TCP_CalcChecksum(sgIP_memblock * mb, unsigned long srcip, unsigned long
 }
 
 
+// largest segment we can send to or receive from destip without fragmenting on our link
+int sgIP_TCP_LocalMSS(unsigned long destip) {
+	return sgIP_IP_MaxContentsSize(destip)-20;
+}
+// the remote end's MSS option (0 if it didn't send one) limits what we send.
+void sgIP_TCP_SetMSS(sgIP_Record_TCP * rec, int peermss) {
+	int mss;
+	mss=sgIP_TCP_LocalMSS(rec->destip);
+	if(!peermss) peermss=SGIP_TCP_DEFAULTMSS;
+	if(mss>peermss) mss=peermss;
+	rec->mss=mss;
+}
+
+// ICMP "fragmentation needed" for a segment we sent: shrink the connection's MSS to fit the
+//  reported next-hop MTU, and resend what was lost right away.  seq is the sequence number
+//  of the dropped segment, and must be one we have outstanding.
+void sgIP_TCP_PMTUUpdate(unsigned long srcip, unsigned long destip, unsigned short srcport, unsigned short destport, unsigned long seq, int mtu) {
+	sgIP_Record_TCP * rec;
+	int mss;
+	SGIP_INTR_PROTECT();
+	rec=sgIP_TCP_FindRecord(destip,srcip,destport,srcport,0);
+	if(rec && (int)(seq-rec->sequence)>=0 && (int)(seq-rec->sequence_next)<0) {
+		if(mtu) mss=mtu-sgIP_IP_RequiredHeaderSize()-20;
+		else mss=rec->mss-(rec->mss>>2); // old router not reporting an MTU, step down
+		if(mss<SGIP_TCP_DEFAULTMSS) mss=SGIP_TCP_DEFAULTMSS;
+		if(mss<rec->mss) {
+			rec->mss=mss;
+			sgIP_TCP_Retransmit(rec);
+			sgIP_TCP_UpdateTimer(rec);
+		}
+	}
+	SGIP_INTR_UNPROTECT();
+}
+
+// read the options out of a tcp header; the caller has checked dataofs_ is sane.
+void sgIP_TCP_ParseOptions(sgIP_Header_TCP * tcp, sgIP_TCP_Options * opt) {
+	unsigned char * p, * end;
+	int len,i;
+	opt->mss=0;
+	opt->sackok=0;
+	opt->wscale=-1;
+	opt->numsack=0;
+	p=tcp->options;
+	end=((unsigned char *)tcp)+(tcp->dataofs_>>4)*4;
+	while(p<end) {
+		if(*p==SGIP_TCP_OPT_END) break;
+		if(*p==SGIP_TCP_OPT_NOP) { p++; continue; }
+		if(p+1>=end) break;
+		len=p[1];
+		if(len<2 || p+len>end) break; // malformed, ignore the rest
+		switch(*p) {
+		case SGIP_TCP_OPT_MSS:
+			if(len==4) opt->mss=(p[2]<<8)|p[3];
+			break;
+		case SGIP_TCP_OPT_WSCALE:
+			if(len==3) opt->wscale=p[2];
+			break;
+		case SGIP_TCP_OPT_SACKOK:
+			if(len==2) opt->sackok=1;
+			break;
+		case SGIP_TCP_OPT_SACK:
+			for(i=2;i+8<=len && opt->numsack<SGIP_TCP_MAXSACKBLOCKS;i+=8) {
+				opt->sack[opt->numsack*2]=(p[i]<<24)|(p[i+1]<<16)|(p[i+2]<<8)|p[i+3];
+				opt->sack[opt->numsack*2+1]=(p[i+4]<<24)|(p[i+5]<<16)|(p[i+6]<<8)|p[i+7];
+				opt->numsack++;
+			}
+			break;
+		}
+		p+=len;
+	}
+}
+
+// copy datalen bytes starting at datastart in mb into the receive fifo, and advance the ack.
+//  the caller has already checked this is in the receive window, so it will not overflow.
+void sgIP_TCP_RxFifoWrite(sgIP_Record_TCP * rec, sgIP_memblock * mb, int datastart, int datalen) {
+	rec->ack+=datalen;
+	sgIP_Ring_WriteMemblock(&rec->rx,mb,datastart,datalen);
+}
+
+// The out-of-order queue (rec->rxooo) holds whole segments, tcp header still exposed, sorted
+//  by sequence number.  Like the UDP incoming queue, segments are chained end-to-end through
+//  the memblock next pointers, with each segment's first block giving its totallength.
+sgIP_memblock * sgIP_TCP_OOOLastBlock(sgIP_memblock * mb) { // last memblock of a queued segment
+	int len;
+	len=mb->totallength-mb->thislength;
+	while(len>0 && mb->next) { mb=mb->next; len-=mb->thislength; }
+	return mb;
+}
+unsigned long sgIP_TCP_OOOSeq(sgIP_memblock * mb) {
+	return htonl(((sgIP_Header_TCP *)mb->datastart)->seqnum);
+}
+int sgIP_TCP_OOOLen(sgIP_memblock * mb) {
+	return mb->totallength-(((sgIP_Header_TCP *)mb->datastart)->dataofs_>>4)*4;
+}
+
+// queue a segment that starts beyond rec->ack; the caller has checked it ends inside the
+//  receive window, which never extends past the free space in rec->rx.  returns 1 if the
+//  memblock was taken, 0 if the caller still owns it.
+int sgIP_TCP_QueueOOO(sgIP_Record_TCP * rec, sgIP_memblock * mb, unsigned long seq, int datalen) {
+	sgIP_memblock * prev, * cur, * last;
+	int n;
+	prev=0;
+	cur=rec->rxooo;
+	n=0;
+	while(cur) {
+		if((int)(seq-sgIP_TCP_OOOSeq(cur))<0) break;
+		if((int)(seq+datalen-sgIP_TCP_OOOSeq(cur)-sgIP_TCP_OOOLen(cur))<=0) return 0; // already have all of this
+		prev=cur;
+		cur=sgIP_TCP_OOOLastBlock(cur)->next;
+		n++;
+	}
+	while(cur) { n++; cur=sgIP_TCP_OOOLastBlock(cur)->next; }
+	if(n>=SGIP_TCP_MAXOOOSEGMENTS) return 0;
+	last=sgIP_TCP_OOOLastBlock(mb);
+	if(prev) {
+		prev=sgIP_TCP_OOOLastBlock(prev);
+		last->next=prev->next;
+		prev->next=mb;
+	} else {
+		last->next=rec->rxooo;
+		rec->rxooo=mb;
+	}
+	return 1;
+}
+
+// move any queued segments that are now contiguous with rec->ack into the receive fifo.
+//  returns the number of bytes added.
+int sgIP_TCP_MergeOOO(sgIP_Record_TCP * rec) {
+	sgIP_memblock * mb, * last;
+	int delta, len, total;
+	total=0;
+	while((mb=rec->rxooo)) {
+		delta=(int)(rec->ack-sgIP_TCP_OOOSeq(mb));
+		if(delta<0) break; // still a hole before this one
+		len=sgIP_TCP_OOOLen(mb)-delta;
+		if(len>0) {
+			sgIP_TCP_RxFifoWrite(rec,mb,(((sgIP_Header_TCP *)mb->datastart)->dataofs_>>4)*4+delta,len);
+			total+=len;
+		}
+		last=sgIP_TCP_OOOLastBlock(mb);
+		rec->rxooo=last->next;
+		last->next=0;
+		sgIP_memblock_free(mb);
+	}
+	return total;
+}
+
+// a burst of received segments: acks for in-order data are held until the end of it, then each
+//  connection that is owed one gets a single ack (or data carrying it), with the latest window.
+void sgIP_TCP_BatchStart() {
+	sgIP_TCP_batching++;
+}
+void sgIP_TCP_BatchEnd() {
+	sgIP_Record_TCP * rec;
+	if(sgIP_TCP_batching<=0) return;
+	if(--sgIP_TCP_batching) return;
+	SGIP_INTR_PROTECT();
+	while(tcpbatchlist) {
+		rec=tcpbatchlist;
+		tcpbatchlist=rec->batchnext;
+		rec->batchnext=0;
+		rec->batchack=0;
+		if(!rec->ackpending) continue; // data or an ack went out since, carrying it
+		if(rec->tcpstate==SGIP_TCP_STATE_ESTABLISHED || rec->tcpstate==SGIP_TCP_STATE_CLOSE_WAIT || rec->tcpstate==SGIP_TCP_STATE_SYN_RECEIVED) {
+			sgIP_TCP_Output(rec,1);
+		} else {
+			sgIP_TCP_SendPacket(rec,SGIP_TCP_FLAG_ACK,0);
+		}
+	}
+	SGIP_INTR_UNPROTECT();
+}
+void sgIP_TCP_BatchUnlink(sgIP_Record_TCP * rec) {
+	sgIP_Record_TCP ** p;
+	if(!rec->batchack) return;
+	for(p=&tcpbatchlist;*p;p=&(*p)->batchnext) {
+		if(*p==rec) { *p=rec->batchnext; break; }
+	}
+	rec->batchnext=0;
+	rec->batchack=0;
+}
+
 int sgIP_TCP_ReceivePacket(sgIP_memblock * mb, unsigned long srcip, unsigned long destip) {
 	if(!mb) return 0;
 	sgIP_Header_TCP * tcp;
-   int delta1,delta2, delta3,datalen, shouldReply;
+   int delta1,delta2, delta3,datalen, shouldReply, queued, dupack;
+   unsigned long txwnd;
+   sgIP_TCP_Options opts;
    unsigned long tcpack,tcpseq;
 	tcp = (sgIP_Header_TCP *) mb->datastart;
 	//                   01234567890123456789012345678901
@@ -239,60 +613,71 @@ int sgIP_TCP_ReceivePacket(sgIP_memblock * mb, unsigned long srcip, unsigned lon
 		sgIP_memblock_free(mb);
 		return 0;
 	}
+	if((tcp->dataofs_>>4)<5 || (tcp->dataofs_>>4)*4>mb->totallength) { // malformed header
+		sgIP_memblock_free(mb);
+		return 0;
+	}
+	sgIP_TCP_ParseOptions(tcp,&opts);
 	sgIP_Record_TCP * rec;
-	rec=tcprecords;
 	// find associated block.
-	while(rec) {
-		if(rec->srcport==tcp->destport && (rec->srcip==destip || rec->srcip==0)) {
-			if((rec->tcpstate==SGIP_TCP_STATE_LISTEN && (tcp->tcpflags&SGIP_TCP_FLAG_SYN)) || rec->destport==tcp->srcport) break;
-		}
-		rec=rec->next;
-	}
-   if(!rec) { // could be completion of an incoming connection?
-      tcpack=htonl(tcp->acknum);
-      if(tcp->tcpflags&SGIP_TCP_FLAG_ACK) {
-         int i,j;
-         for(i=0;i<numsynlist;i++) {
-            if(synlist[i].localseq+1==tcpack) { // oki! this is probably legit ;) 
-               rec=synlist[i].linked; // we have the data we need.
-               // remove entry from synlist
-               numsynlist--;
-               for(;i<numsynlist;i++) {
-                  synlist[i]=synlist[i+1]; // assume struct copy
-               }              
-               for(j=0;j<rec->maxlisten;j++) if(!rec->listendata[j]) break; // find last entry in listen queue
-               if(j==rec->maxlisten) { rec=0; break; } // discard this connection! we have no space in the listen queue.
-               
-               rec->listendata[j]=sgIP_TCP_AllocRecord();
-               j++;
-               if(j!=rec->maxlisten) rec->listendata[j]=0;
-
-               rec=rec->listendata[j-1];
-
-               // fill in data about the connection.
-               rec->tcpstate=SGIP_TCP_STATE_ESTABLISHED;
-               rec->time_last_action=sgIP_timems;
-			   rec->time_backoff=SGIP_TCP_GENRETRYMS; // backoff timer
-               rec->srcip=destip;
-               rec->destip=srcip;
-               rec->srcport=tcp->destport;
-               rec->destport=tcp->srcport;
-               rec->sequence=htonl(tcp->acknum);
-               rec->ack=htonl(tcp->seqnum);
-               rec->sequence_next=rec->sequence;
-               rec->rxwindow=rec->ack+1400; // last byte in receive window
-               rec->txwindow=rec->sequence+htons(tcp->window);
-
-               sgIP_memblock_free(mb);
-               return 0;               
-            }
+	rec=sgIP_TCP_FindRecord(srcip,destip,tcp->srcport,tcp->destport,tcp->tcpflags);
+   if(!rec && (tcp->tcpflags&(SGIP_TCP_FLAG_SYN|SGIP_TCP_FLAG_RST|SGIP_TCP_FLAG_ACK))==SGIP_TCP_FLAG_ACK) { // could be completion of an incoming connection?
+      int cookie_mss, cookie_sack, cookie_ws;
+      rec=sgIP_TCP_FindRecord(srcip,destip,tcp->srcport,tcp->destport,SGIP_TCP_FLAG_SYN); // the listening socket, if any
+      if(rec && rec->tcpstate==SGIP_TCP_STATE_LISTEN
+         && sgIP_TCP_CheckCookie(srcip,destip,tcp->srcport,tcp->destport,htonl(tcp->seqnum)-1,htonl(tcp->acknum)-1,&cookie_mss,&cookie_sack,&cookie_ws)) { // oki! this is legit ;)
+         sgIP_Record_TCP * lrec;
+         int j;
+         for(j=0;j<rec->maxlisten;j++) if(!rec->listendata[j]) break; // find last entry in listen queue
+         lrec=0;
+         if(j<rec->maxlisten && (lrec=sgIP_TCP_AllocRecord())) {
+            lrec->buf_rx_want=rec->buf_rx_want; // buffer sizes are inherited from the listening socket
+            lrec->buf_tx_want=rec->buf_tx_want;
+            lrec->nodelay=rec->nodelay; // so are TCP_NODELAY and TCP_CORK
+            lrec->cork=rec->cork;
+            if(sgIP_TCP_AllocBuffers(lrec)) { sgIP_TCP_FreeRecord(lrec); lrec=0; }
          }
-      }
+         if(!lrec) { // no space; drop the ack, the cookie is still good when it's resent.
+            sgIP_memblock_free(mb);
+            return 0;
+         }
+         rec->listendata[j]=lrec;
+         j++;
+         if(j!=rec->maxlisten) rec->listendata[j]=0;
+
+         rec=lrec;
+
+         // fill in data about the connection.
+         rec->tcpstate=SGIP_TCP_STATE_ESTABLISHED;
+         rec->time_last_action=sgIP_timems;
+         rec->time_backoff=rec->rto; // backoff timer
+         rec->srcip=destip;
+         rec->destip=srcip;
+         rec->srcport=tcp->destport;
+         rec->destport=tcp->srcport;
+         rec->sequence=htonl(tcp->acknum);
+         rec->snd_sml=rec->sequence;
+         rec->ack=htonl(tcp->seqnum);
+         rec->sequence_next=rec->sequence;
+         rec->rxwindow=rec->ack+sgIP_TCP_SynWindow(rec); // last byte in receive window
+         if(cookie_ws>=0) { // both ends sent a window scale option
+            rec->wscaleok=1;
+            rec->snd_wscale=cookie_ws;
+            rec->rcv_wscale=sgIP_TCP_WindowShift(rec->buf_rx_want);
+         }
+         rec->txwindow=rec->sequence+(htons(tcp->window)<<rec->snd_wscale);
+         rec->sackok=cookie_sack;
+         rec->mss=cookie_mss;
+         sgIP_TCP_InitCongestion(rec);
+         sgIP_TCP_HashInsert(rec,SGIP_TCP_HASHED_CONN);
+         sgIP_TCP_HashInsert(rec,SGIP_TCP_HASHED_BIND);
+         // carry on below, the ack may already carry data.
+      } else rec=0;
    }
 	if(!rec) { // we don't have a clue what this one is.
 #ifndef SGIP_TCP_STEALTH
 		// send a RST
-		sgIP_TCP_SendSynReply(SGIP_TCP_FLAG_RST,ntohl(tcp->acknum),0,destip,srcip,tcp->destport,tcp->srcport,0);
+		sgIP_TCP_SendSynReply(SGIP_TCP_FLAG_RST,ntohl(tcp->acknum),0,destip,srcip,tcp->destport,tcp->srcport,0,0);
 #endif
 		sgIP_memblock_free(mb);
 		return 0;
@@ -300,8 +685,14 @@ int sgIP_TCP_ReceivePacket(sgIP_memblock * mb, unsigned long srcip, unsigned lon
 	// check sequence and ACK numbers, to ensure they're in range.
    tcpack=htonl(tcp->acknum);
    tcpseq=htonl(tcp->seqnum);
+   txwnd=htons(tcp->window);
+   if(!(tcp->tcpflags&SGIP_TCP_FLAG_SYN)) txwnd<<=rec->snd_wscale; // the window in a SYN is never scaled
    datalen=mb->totallength-(tcp->dataofs_>>4)*4;
+   rec->segs_in++;
+   if(datalen>0) rec->data_segs_in++;
    shouldReply=0;
+   queued=0;
+   dupack=0;
    if(tcp->tcpflags&SGIP_TCP_FLAG_RST) { // verify if rst is legit, and act on it.
       // check seq against receive window
       delta1=(int)(tcpseq-rec->ack);
@@ -321,18 +712,30 @@ int sgIP_TCP_ReceivePacket(sgIP_memblock * mb, unsigned long srcip, unsigned lon
       // verify ack value (checking ack sequence vs transmit window)
       delta1=(int)(tcpack-rec->sequence);
       delta2=(int)(rec->txwindow-tcpack);
+      if((int)(rec->sequence_next-tcpack)>=0 || (int)(rec->sequence_max-tcpack)>=0) delta2=0; // a zero window probe goes past the window
       if(delta1<0 || delta2<0) { // invalid ack range, discard packet
          sgIP_memblock_free(mb);
          return 0;
       }
-	  delta2=tcpack-rec->sequence;
+      if(delta1==0 && datalen==0 && !(tcp->tcpflags&SGIP_TCP_FLAG_FIN) && rec->sequence_next!=rec->sequence
+         && rec->txwindow==rec->sequence+txwnd) dupack=1; // same ack, same window, no data: something got lost
+      if(rec->rttiming && (int)(tcpack-rec->rttseq)>=0) { // the timed segment made it
+         sgIP_TCP_RttSample(rec,sgIP_timems-rec->rtttime);
+         rec->rttiming=0;
+      }
+      delta3=sgIP_TCP_FlightSize(rec);
       rec->sequence=tcpack;
-	  delta2+=rec->buf_tx_in;
-	  if(delta2>=SGIP_TCP_TRANSMITBUFFERLENGTH) delta2-=SGIP_TCP_TRANSMITBUFFERLENGTH;
-	  rec->buf_tx_in=delta2;
-      if(delta1>0) shouldReply=1;
+      sgIP_TCP_TxAcked(rec,delta1);
+      if((int)(rec->sequence_next-rec->sequence)<0) rec->sequence_next=rec->sequence;
+      if(rec->sackok && (opts.numsack || rec->numsacked)) sgIP_TCP_UpdateScoreboard(rec,&opts);
+      if(delta1>0) {
+         sgIP_TCP_NewAck(rec,delta1,delta3);
+         shouldReply=1;
+      }
    }
-   rec->txwindow=rec->sequence+htons(tcp->window);
+   rec->txwindow=rec->sequence+txwnd;
+   if(txwnd>rec->max_sndwnd) rec->max_sndwnd=txwnd;
+   if(dupack) sgIP_TCP_DupAck(rec);
 
 	// now, decide what to do with our nice new shiny memblock...
 
@@ -344,7 +747,10 @@ int sgIP_TCP_ReceivePacket(sgIP_memblock * mb, unsigned long srcip, unsigned lon
 	case SGIP_TCP_STATE_LISTEN: // listening
 	case SGIP_TCP_STATE_TIME_WAIT: // wait to ensure remote tcp knows it's been terminated.
 	case SGIP_TCP_STATE_SYN_SENT: // connect initiated
+		break;
 	case SGIP_TCP_STATE_CLOSE_WAIT: // got FIN, wait for user code to close socket & send FIN
+		if(shouldReply) sgIP_TCP_Output(rec,0); // still sending our remaining data
+		break;
 	case SGIP_TCP_STATE_CLOSING: // got FIN, waiting for ACK of our FIN
 	case SGIP_TCP_STATE_LAST_ACK: // wait for ACK of our last FIN
 		break;
@@ -358,42 +764,50 @@ int sgIP_TCP_ReceivePacket(sgIP_memblock * mb, unsigned long srcip, unsigned lon
 			delta2=(int)(rec->rxwindow-tcpseq-datalen); // check end of data vs end of window (>=0, end of data is equal to or before end of rx window)
 			delta3=(int)(rec->ack-tcpseq); // check start of data vs start of window (>=0, start of data is equal or before the next expected byte)
 			if(delta1<0 || delta2<0 || delta3<0) {
-				if(delta1>-SGIP_TCP_RECEIVEBUFFERLENGTH) { // ack it anyway, they got lost on the retard bus.
+				if(delta3<0 && delta2>=0 && datalen>0) { // beyond a hole; hold on to it until the hole is filled
+					if(sgIP_TCP_QueueOOO(rec,mb,tcpseq,datalen)) queued=1;
+				}
+				if(delta1>-rec->rx.size) { // ack it anyway, they got lost on the retard bus.
 					sgIP_TCP_SendPacket(rec,SGIP_TCP_FLAG_ACK,0);
 				}
 				break; // out of range, they should know better.
 			}
 			{
 				int datastart=(tcp->dataofs_>>4)*4;
+				delta2=datalen; // any data at all needs an ack, even if we already had it
 				delta1=(int)(tcpseq-rec->ack);
 				if(delta1<0) { // data is partly ack'd...just copy what we need.
 					datastart-=delta1;
 					datalen+=delta1; 
 				}
 				// copy data into the fifo
-				rec->ack+=datalen;
 				delta1=datalen;
-				while(datalen>0) { // don't actually need to check the rx buffer length, if the ack check approved it, it will be in range (not overflow) by default
-					delta2=SGIP_TCP_RECEIVEBUFFERLENGTH-rec->buf_rx_out; // number of bytes til the end of the buffer
-					if(datalen<delta2) delta2=datalen;
-					sgIP_memblock_CopyToLinear(mb,rec->buf_rx+rec->buf_rx_out,datastart,delta2);
-					datalen-=delta2;
-					datastart+=delta2;
-					rec->buf_rx_out += delta2;
-					if(rec->buf_rx_out>=SGIP_TCP_RECEIVEBUFFERLENGTH) rec->buf_rx_out-=SGIP_TCP_RECEIVEBUFFERLENGTH;
-				}
-				if(rec->tcpstate==SGIP_TCP_STATE_FIN_WAIT_1 || rec->tcpstate==SGIP_TCP_STATE_FIN_WAIT_2) break;
-				if(shouldReply || delta1>=0) { // send a packet in reply, ha!
-					delta1=rec->buf_tx_out-rec->buf_tx_in;
-					if(delta1<0) delta1+=SGIP_TCP_TRANSMITBUFFERLENGTH;
-					delta2=(int)(rec->txwindow-rec->sequence);
-					if(delta1>delta2) delta1=delta2;
-					delta2=sgIP_IP_MaxContentsSize(rec->destip)-20; // max tcp data size
-					if(delta1>delta2) delta1=delta2;
-					if(delta1>=0) { // could be less than 0, but very odd.
-						sgIP_TCP_SendPacket(rec,SGIP_TCP_FLAG_ACK,delta1);
+				sgIP_TCP_RxFifoWrite(rec,mb,datastart,datalen);
+				if(rec->rxooo) delta1+=sgIP_TCP_MergeOOO(rec); // this may have filled a gap
+				if(delta2>0) {
+					// ack at once for every second full-sized segment, when the window we offered is used
+					//  up, for data we already had, and while there are holes (or one was just filled);
+					//  otherwise hold the ack back a little, in the hope it can ride along with data.
+					//  inside a receive batch the every-second-segment ack waits for the end of the batch.
+					if(datalen<=0 || delta1!=datalen || rec->rxooo || (int)(rec->rxwindow-rec->ack)<rec->mss
+						|| (rec->ackpending+datalen>=2*rec->mss && !sgIP_TCP_batching)) delta2=1;
+					else {
+						if(!rec->ackpending) rec->ackdue=sgIP_timems+SGIP_TCP_DELACKMS;
+						rec->ackpending+=datalen;
+						if(rec->ackpending>=2*rec->mss && !rec->batchack) {
+							rec->batchack=1;
+							rec->batchnext=tcpbatchlist;
+							tcpbatchlist=rec;
+						}
+						delta2=0;
 					}
 				}
+				if(rec->tcpstate==SGIP_TCP_STATE_FIN_WAIT_1 || rec->tcpstate==SGIP_TCP_STATE_FIN_WAIT_2) {
+					if(delta2) sgIP_TCP_SendPacket(rec,SGIP_TCP_FLAG_ACK,0);
+					break;
+				}
+				sgIP_TCP_Output(rec,delta2); // send whatever the window allows; data sent carries the ack
+
 			}
 		}
    }
@@ -406,44 +820,44 @@ int sgIP_TCP_ReceivePacket(sgIP_memblock * mb, unsigned long srcip, unsigned lon
 		break; // can't do anything in these states.
 	case SGIP_TCP_STATE_LISTEN: // listening
       if(tcp->tcpflags&SGIP_TCP_FLAG_SYN) { // other end requesting a connection
-         if(numsynlist==SGIP_TCP_MAXSYNS) {
-            numsynlist--;
-            for(delta1=0;delta1<numsynlist;delta1++) {
-               synlist[delta1]=synlist[delta1+1]; // assume struct copy
-            } 
-         }
-         {
-            unsigned long myseq,myport;
-            myport=tcp->destport;
-            myseq=sgIP_TCP_support_seqhash(srcip,destip,tcp->srcport,myport);
-            // send relevant synack
-			sgIP_TCP_SendSynReply(SGIP_TCP_FLAG_SYN|SGIP_TCP_FLAG_ACK,myseq,tcpseq+1,destip,srcip,myport,tcp->srcport,-1);
-            synlist[numsynlist].localseq=myseq;
-			synlist[numsynlist].timebackoff=SGIP_TCP_SYNRETRYMS;
-			synlist[numsynlist].timenext=SGIP_TCP_SYNRETRYMS;
-            synlist[numsynlist].linked=rec;
-			synlist[numsynlist].remoteseq=tcpseq+1;
-			synlist[numsynlist].remoteip=srcip;
-			synlist[numsynlist].localip=destip;
-			synlist[numsynlist].localport=myport;
-			synlist[numsynlist].remoteport=tcp->srcport;
-            numsynlist++;
-         }
+         unsigned long myseq;
+         // answer with a SYN cookie, nothing is kept until the remote end acks it.
+         delta1=sgIP_TCP_LocalMSS(srcip);
+         if(opts.mss) delta2=opts.mss; else delta2=SGIP_TCP_DEFAULTMSS;
+         if(delta2>delta1) delta2=delta1;
+         myseq=sgIP_TCP_MakeCookie(srcip,destip,tcp->srcport,tcp->destport,tcpseq,delta2,opts.sackok,opts.wscale);
+         opts.mss=delta1;
+         if(opts.wscale>=0) opts.wscale=sgIP_TCP_WindowShift(rec->buf_rx_want); // only answered if offered
+         opts.numsack=0; // sackok is echoed back if the remote end offered it
+         sgIP_TCP_SendSynReply(SGIP_TCP_FLAG_SYN|SGIP_TCP_FLAG_ACK,myseq,tcpseq+1,destip,srcip,tcp->destport,tcp->srcport,sgIP_TCP_SynWindow(rec),&opts);
       }
 		break;
 	case SGIP_TCP_STATE_SYN_SENT: // connect initiated
       switch(tcp->tcpflags&(SGIP_TCP_FLAG_SYN|SGIP_TCP_FLAG_ACK)) {
       case SGIP_TCP_FLAG_SYN | SGIP_TCP_FLAG_ACK: // both flags set
          // FIXME: shall check ack againts our seq instead.
+         if(!rec->retrycount) sgIP_TCP_RttSample(rec,sgIP_timems-rec->time_last_action); // our syn was only sent once
          rec->ack=tcpseq+1;
+         rec->rxwindow=rec->ack; // nothing offered in the remote end's sequence space yet
          rec->sequence=tcpack;
+         rec->sequence_next=tcpack;
+         rec->sackok=opts.sackok;
+         sgIP_TCP_SetWindowScale(rec,opts.wscale);
+         sgIP_TCP_SetMSS(rec,opts.mss);
+         sgIP_TCP_InitCongestion(rec);
          sgIP_TCP_SendPacket(rec,SGIP_TCP_FLAG_ACK,0);
          rec->tcpstate=SGIP_TCP_STATE_ESTABLISHED;
          rec->retrycount=0;
          break;         
       case SGIP_TCP_FLAG_SYN: // just got a syn...
          rec->ack=tcpseq+1;
+         rec->rxwindow=rec->ack; // nothing offered in the remote end's sequence space yet
          rec->sequence=tcpack;
+         rec->sequence_next=tcpack;
+         rec->sackok=opts.sackok;
+         sgIP_TCP_SetWindowScale(rec,opts.wscale);
+         sgIP_TCP_SetMSS(rec,opts.mss);
+         sgIP_TCP_InitCongestion(rec);
          sgIP_TCP_SendPacket(rec,SGIP_TCP_FLAG_ACK,0);
          rec->tcpstate=SGIP_TCP_STATE_SYN_RECEIVED;
          rec->retrycount=0;
@@ -575,42 +989,157 @@ int sgIP_TCP_ReceivePacket(sgIP_memblock * mb, unsigned long srcip, unsigned lon
       }
 		break;
 	}
-	sgIP_memblock_free(mb);
+	sgIP_TCP_UpdateTimer(rec);
+	if(!queued) sgIP_memblock_free(mb);
 	return 0;
 }
 
-sgIP_memblock * sgIP_TCP_GenHeader(sgIP_Record_TCP * rec, int flags, int datalength) {
-	sgIP_memblock * mb = sgIP_memblock_alloc(datalength+20+sgIP_IP_RequiredHeaderSize());
-	int windowlen;
+// write options into a tcp header; returns the number of bytes used (always a multiple of 4)
+int sgIP_TCP_WriteOptions(unsigned char * dest, sgIP_TCP_Options * opt) {
+	int len,i;
+	unsigned long seq;
+	len=0;
+	if(!opt) return 0;
+	if(opt->mss) {
+		dest[len++]=SGIP_TCP_OPT_MSS;
+		dest[len++]=4;
+		dest[len++]=opt->mss>>8;
+		dest[len++]=opt->mss;
+	}
+	if(opt->wscale>=0) {
+		dest[len++]=SGIP_TCP_OPT_NOP;
+		dest[len++]=SGIP_TCP_OPT_WSCALE;
+		dest[len++]=3;
+		dest[len++]=opt->wscale;
+	}
+	if(opt->sackok) {
+		dest[len++]=SGIP_TCP_OPT_NOP;
+		dest[len++]=SGIP_TCP_OPT_NOP;
+		dest[len++]=SGIP_TCP_OPT_SACKOK;
+		dest[len++]=2;
+	}
+	if(opt->numsack) {
+		dest[len++]=SGIP_TCP_OPT_NOP;
+		dest[len++]=SGIP_TCP_OPT_NOP;
+		dest[len++]=SGIP_TCP_OPT_SACK;
+		dest[len++]=2+opt->numsack*8;
+		for(i=0;i<opt->numsack*2;i++) {
+			seq=opt->sack[i];
+			dest[len++]=seq>>24;
+			dest[len++]=seq>>16;
+			dest[len++]=seq>>8;
+			dest[len++]=seq;
+		}
+	}
+	return len;
+}
+
+// describe the out-of-order queue as SACK blocks, lowest sequence first.
+void sgIP_TCP_GenSackBlocks(sgIP_Record_TCP * rec, sgIP_TCP_Options * opt) {
+	sgIP_memblock * mb;
+	unsigned long seq,seqend;
+	int n;
+	n=0;
+	mb=rec->rxooo;
+	while(mb) {
+		seq=sgIP_TCP_OOOSeq(mb);
+		seqend=seq+sgIP_TCP_OOOLen(mb);
+		if(n && (int)(seq-opt->sack[n*2-1])<=0) { // contiguous or overlapping the previous block
+			if((int)(seqend-opt->sack[n*2-1])>0) opt->sack[n*2-1]=seqend;
+		} else {
+			if(n==SGIP_TCP_MAXSACKBLOCKS) break;
+			opt->sack[n*2]=seq;
+			opt->sack[n*2+1]=seqend;
+			n++;
+		}
+		mb=sgIP_TCP_OOOLastBlock(mb)->next;
+	}
+	opt->numsack=n;
+}
+
+// the options a segment with these flags carries
+void sgIP_TCP_GenOptions(sgIP_Record_TCP * rec, int flags, sgIP_TCP_Options * opt) {
+	opt->mss=0;
+	opt->wscale=-1;
+	opt->sackok=0;
+	opt->numsack=0;
+	if(flags&SGIP_TCP_FLAG_SYN) {
+		opt->mss=sgIP_TCP_LocalMSS(rec->destip);
+		opt->sackok=1; // we can always handle SACK
+		opt->wscale=sgIP_TCP_WindowShift(rec->rx.size);
+	} else if(rec->sackok && rec->rxooo) {
+		sgIP_TCP_GenSackBlocks(rec,opt);
+	}
+}
+// bytes of options sgIP_TCP_GenHeader will add to a segment with these flags.  the mss counts
+//  them (RFC 6691), so the payload of a segment has to leave room for them.
+int sgIP_TCP_OptionLength(sgIP_Record_TCP * rec, int flags) {
+	sgIP_TCP_Options opt;
+	unsigned char optbuf[40];
+	sgIP_TCP_GenOptions(rec,flags,&opt);
+	return sgIP_TCP_WriteOptions(optbuf,&opt);
+}
+// largest payload a segment with these flags can carry right now
+int sgIP_TCP_MaxPayload(sgIP_Record_TCP * rec, int flags) {
+	int len;
+	len=rec->mss-sgIP_TCP_OptionLength(rec,flags);
+	if(len<1) len=1;
+	return len;
+}
+
+sgIP_memblock * sgIP_TCP_GenHeader(sgIP_Record_TCP * rec, int flags, unsigned long seq, int datalength) {
+	sgIP_TCP_Options opt;
+	unsigned char optbuf[40];
+	int windowlen,optlen;
+	sgIP_TCP_GenOptions(rec,flags,&opt);
+	if(flags&SGIP_TCP_FLAG_SYN) rec->rcv_wscale=opt.wscale;
+	optlen=sgIP_TCP_WriteOptions(optbuf,&opt);
+	sgIP_memblock * mb = sgIP_memblock_alloc(datalength+20+optlen+sgIP_IP_RequiredHeaderSize());
 	if(!mb) return 0;
 	sgIP_memblock_exposeheader(mb,-sgIP_IP_RequiredHeaderSize()); // hide IP header space for later
 	sgIP_Header_TCP * tcp = (sgIP_Header_TCP *) mb->datastart;
 	tcp->srcport=rec->srcport;
 	tcp->destport=rec->destport;
-	tcp->seqnum=htonl(rec->sequence);
+	tcp->seqnum=htonl(seq);
 	tcp->acknum=htonl(rec->ack);
 	tcp->tcpflags=flags;
 	tcp->urg_ptr=0; // no support for URG data atm.
 	tcp->checksum=0;
-	tcp->dataofs_=5<<4; // header length == 20 (5*32bit)
-	windowlen=rec->buf_rx_out-rec->buf_rx_in;
-	if(windowlen<0) windowlen+=SGIP_TCP_RECEIVEBUFFERLENGTH; // we now have the amount in the buffer
-	windowlen = SGIP_TCP_RECEIVEBUFFERLENGTH-windowlen-1;
+	tcp->dataofs_=((20+optlen)/4)<<4;
+	if(optlen) sgIP_memblock_CopyFromLinear(mb,optbuf,20,optlen);
+	windowlen=sgIP_Ring_Used(&rec->rx); // we now have the amount in the buffer
+	if(rec->buf_rx_want<rec->rx.size) { // shrinking: only offer what the smaller buffer will have, without pulling back the window edge
+		int edge=(int)(rec->rxwindow-rec->ack);
+		windowlen = rec->buf_rx_want-windowlen-1;
+		if(windowlen<edge) windowlen=edge;
+	} else windowlen = rec->rx.size-windowlen-1;
 	if(windowlen<0) windowlen=0;
+	if(flags&SGIP_TCP_FLAG_ACK) rec->ackpending=0; // this carries the ack, nothing left to delay
+	rec->segs_out++;
     if(flags&SGIP_TCP_FLAG_ACK) rec->want_reack = windowlen<SGIP_TCP_REACK_THRESH; // indicate an additional ack should be sent when we have more space in the buffer.
-	if(windowlen>65535) windowlen=65535;
-   if(windowlen>1400) windowlen=1400; // don't want to deal with IP fragmentation.
-   rec->rxwindow=rec->ack+windowlen; // last byte in receive window
-	tcp->window=htons(windowlen);
+	if(flags&SGIP_TCP_FLAG_SYN) {
+		if(windowlen>65535) windowlen=65535; // the window in a SYN is never scaled
+		rec->rxwindow=rec->ack+windowlen; // last byte in receive window
+		tcp->window=htons(windowlen);
+	} else {
+		if(windowlen>(65535<<rec->rcv_wscale)) windowlen=65535<<rec->rcv_wscale;
+		windowlen>>=rec->rcv_wscale;
+		tcp->window=htons(windowlen);
+		windowlen<<=rec->rcv_wscale;
+		if((int)(rec->ack+windowlen-rec->rxwindow)>0) rec->rxwindow=rec->ack+windowlen; // rounding to the scale never pulls the edge back
+	}
 	return mb;
 }
-void sgIP_TCP_FixChecksum(unsigned long srcip, unsigned long destip, sgIP_memblock * mb) {
-	int checksum;
+// fill in the checksum, given the sum of everything after the first sumlength bytes (from
+//  sgIP_memblock_CopyFromLinearChecksum as the payload went in)
+void sgIP_TCP_FixChecksumPartial(unsigned long srcip, unsigned long destip, sgIP_memblock * mb, int sumlength, unsigned long datasum) {
+	unsigned long checksum;
 	if(!mb) return;
    sgIP_Header_TCP * tcp;
    tcp = (sgIP_Header_TCP *) mb->datastart;
    tcp->checksum=0;
-   checksum=sgIP_memblock_IPChecksum(mb,0,mb->totallength);
+   checksum=sgIP_memblock_IPChecksum(mb,0,sumlength);
+   checksum+=datasum;
 
 	// add in checksum of "faux header"
 	checksum+=(destip&0xFFFF);
@@ -626,46 +1155,384 @@ void sgIP_TCP_FixChecksum(unsigned long srcip, unsigned long destip, sgIP_memblo
 	if(checksum==0) checksum = 0xFFFF;
 	tcp->checksum=checksum;
 }
+void sgIP_TCP_FixChecksum(unsigned long srcip, unsigned long destip, sgIP_memblock * mb) {
+	if(!mb) return;
+	sgIP_TCP_FixChecksumPartial(srcip,destip,mb,mb->totallength,0);
+}
 
-int sgIP_TCP_SendPacket(sgIP_Record_TCP * rec, int flags, int datalength) { // data sent is taken directly from the TX fifo.
-   int i,j,k;
+int sgIP_TCP_SendSegment(sgIP_Record_TCP * rec, int flags, unsigned long seq, int datalength) { // data sent is taken directly from the send queue.
+   int i,j,k,ofs,hdrlen;
+   unsigned long datasum;
+   sgIP_memblock * src;
 	if(!rec) return 0;
 	SGIP_INTR_PROTECT();
 
-   j=rec->buf_tx_out-rec->buf_tx_in;
-   if(j<0) j+=SGIP_TCP_TRANSMITBUFFERLENGTH;
+   j=rec->txq_len;
+   k=(int)(seq-rec->sequence); // offset of seq into the send queue
+   if(k<0) k=0;
+   j-=k;
+   if(datalength>j) datalength=j;
+   j=sgIP_TCP_MaxPayload(rec,flags); // header options come out of the mss
    if(datalength>j) datalength=j;
-   sgIP_memblock * mb =sgIP_TCP_GenHeader(rec,flags,datalength);
+   if(datalength<0) datalength=0;
+   src=0;
+   if(datalength>0) src=sgIP_TCP_TxBlock(rec,rec->sequence+k,&ofs);
+   // a segment that is exactly one block sgIP_TCP_Send is done with goes out as it is, chained
+   //  behind the header.  anything else (the open last block, or data across block edges) is copied.
+   if(src && (ofs || datalength!=src->thislength || (src==rec->txq_end && rec->txq_room))) {
+      j=datalength;
+   } else j=0;
+   sgIP_memblock * mb =sgIP_TCP_GenHeader(rec,flags,seq,j);
 	if(!mb) {
 		SGIP_INTR_UNPROTECT();
-		return 0;
+		return -1;
 	}
-   j=20; // destination offset in memblock for data
-   rec->sequence_next=rec->sequence+datalength;
-   k=rec->buf_tx_in;
-   while(datalength>0) {
-      i=SGIP_TCP_TRANSMITBUFFERLENGTH-k;
-      if(i>datalength)i=datalength;
-      sgIP_memblock_CopyFromLinear(mb,rec->buf_tx+k,j,i);
-      k+=i;
-      if(k>=SGIP_TCP_TRANSMITBUFFERLENGTH) k-=SGIP_TCP_TRANSMITBUFFERLENGTH;
-      j+=i;
-      datalength-=i;
+   // (re)start the retransmit timer if nothing was outstanding, or this is the oldest data;
+   //  acks and new data sent behind outstanding data leave it running.
+   if(rec->sequence_next==rec->sequence || (seq==rec->sequence && datalength>0) || (flags&(SGIP_TCP_FLAG_SYN|SGIP_TCP_FLAG_FIN))) {
+      rec->time_last_action=sgIP_timems; // semi-generic timer.
+      rec->time_backoff=rec->rto; // backoff timer
+   }
+   if((int)(seq+datalength-rec->sequence_next)>0) rec->sequence_next=seq+datalength;
+   hdrlen=mb->totallength; // what the checksum still has to cover, when the payload is summed as it's copied in
+   datasum=0;
+   if(datalength>0) {
+      rec->data_segs_out++;
+      if((int)(seq-rec->sequence_max)<0) { // sending this again
+         rec->retransmits++;
+         rec->rttiming=0; // Karn: can't tell which copy an ack is for
+      } else if(!rec->rttiming) { // time new data, one segment at a time
+         rec->rttiming=1;
+         rec->rttseq=seq+datalength;
+         rec->rtttime=sgIP_timems;
+      }
+      if((int)(seq+datalength-rec->sequence_max)>0) rec->sequence_max=seq+datalength;
+      if(j) {
+         k=(((sgIP_Header_TCP *)mb->datastart)->dataofs_>>4)*4;
+         hdrlen=k;
+         i=0;
+         while(j>0) {
+            i=src->thislength-ofs;
+            if(i>j) i=j;
+            sgIP_memblock_CopyFromLinearChecksum(mb,src->datastart+ofs,k,i,&datasum);
+            k+=i;
+            j-=i;
+            if(j>0) { src=src->nextpacket; ofs=0; }
+         }
+         // sent up to the end of a half-full last block: more data goes in a new block, so the next
+         //  segment starts on a block boundary again (a small block stays open for more small writes).
+         if(src==rec->txq_end && ofs+i==src->thislength && src->thislength>=rec->txq_room) rec->txq_room=0;
+      } else {
+         sgIP_memblock_addref(src); // the queue keeps its hold, for retransmission
+         sgIP_memblock_append(mb,src);
+         hdrlen=mb->totallength; // (not copied, so it's summed here)
+      }
    }
 
-	sgIP_TCP_FixChecksum(rec->srcip,rec->destip,mb);
+	sgIP_TCP_FixChecksumPartial(rec->srcip,rec->destip,mb,hdrlen,datasum);
 	sgIP_IP_SendViaIP(mb,6,rec->srcip,rec->destip);
 
-   rec->time_last_action=sgIP_timems; // semi-generic timer.
-   rec->time_backoff=SGIP_TCP_GENRETRYMS; // backoff timer
 	SGIP_INTR_UNPROTECT();
    return 0;
 }
+int sgIP_TCP_SendPacket(sgIP_Record_TCP * rec, int flags, int datalength) { // data sent is taken directly from the send queue.
+	if(!rec) return 0;
+	return sgIP_TCP_SendSegment(rec,flags,rec->sequence,datalength);
+}
+
+// bytes from seq up to seqend the remote end has not SACKed
+int sgIP_TCP_Unsacked(sgIP_Record_TCP * rec, unsigned long seq, unsigned long seqend) {
+	int i,n;
+	unsigned long s,e;
+	n=(int)(seqend-seq);
+	if(n<=0) return 0;
+	for(i=0;i<rec->numsacked;i++) {
+		s=rec->sacked[i*2];
+		e=rec->sacked[i*2+1];
+		if((int)(s-seqend)>=0) break;
+		if((int)(s-seq)<0) s=seq;
+		if((int)(e-seqend)>0) e=seqend;
+		if((int)(e-s)>0) n-=(int)(e-s);
+	}
+	return n;
+}
+// bytes sent and not yet acknowledged, less what the remote end has SACKed
+int sgIP_TCP_FlightSize(sgIP_Record_TCP * rec) {
+	return sgIP_TCP_Unsacked(rec,rec->sequence,rec->sequence_next);
+}
+// how much is taken to be in the network (RFC 6675 pipe).  in SACK recovery, what hasn't been SACKed
+//  below the highest SACK counts as lost, unless it has been resent since; outside it, everything unSACKed.
+int sgIP_TCP_Pipe(sgIP_Record_TCP * rec) {
+	unsigned long high,resent;
+	if(!rec->inrecovery || !rec->sackok || !rec->numsacked) return sgIP_TCP_FlightSize(rec);
+	high=rec->sacked[rec->numsacked*2-1];
+	resent=rec->rexmit_next;
+	if((int)(resent-high)>0) resent=high;
+	return sgIP_TCP_Unsacked(rec,rec->sequence,resent)+sgIP_TCP_Unsacked(rec,high,rec->sequence_next);
+}
+// the next hole to resend in SACK recovery (RFC 6675 NextSeg rule 1): the first unSACKed sequence not
+//  resent yet, below the highest SACK.  returns its length (0 if there is none) and sets *seq.
+int sgIP_TCP_NextHole(sgIP_Record_TCP * rec, unsigned long * seq) {
+	int i;
+	unsigned long s;
+	s=rec->rexmit_next;
+	if((int)(s-rec->sequence)<0) s=rec->sequence;
+	for(i=0;i<rec->numsacked;i++) {
+		if((int)(s-rec->sacked[i*2])<0) {
+			*seq=s;
+			return (int)(rec->sacked[i*2]-s);
+		}
+		if((int)(s-rec->sacked[i*2+1])<0) s=rec->sacked[i*2+1];
+	}
+	return 0;
+}
 
-int sgIP_TCP_SendSynReply(int flags,unsigned long seq, unsigned long ack, unsigned long srcip, unsigned long destip, int srcport, int destport, int windowlen) {
+// what counts as a full segment for Nagle/TCP_CORK, and the size of send queue blocks: an mss,
+//  or less if the remote window or our own send buffer could never hold that much (RFC 1122 4.2.3.4)
+int sgIP_TCP_FullSegment(sgIP_Record_TCP * rec) {
+	int full;
+	full=rec->mss;
+	if(rec->max_sndwnd && rec->max_sndwnd/2<full) full=rec->max_sndwnd/2;
+	if(rec->buf_tx_size/2<full) full=rec->buf_tx_size/2;
+	if(full<1) full=1;
+	return full;
+}
+// send as much never-sent data as the congestion window, remote window and segment size allow.
+//  in SACK recovery the holes the scoreboard shows go first (RFC 6675 NextSeg), and if nothing else
+//  could be sent, the last segment past the highest SACK, once.  after a timeout sequence_next has
+//  gone back and this resends, stepping over what the remote end has SACKed.
+//  if nothing could be sent and forceack is set, send a bare ACK instead. returns segments sent.
+int sgIP_TCP_Output(sgIP_Record_TCP * rec, int forceack) {
+	int i,len,room,unsent,sent,full,maxseg,sackrecovery;
+	unsigned long seq;
+	sent=0;
+	full=sgIP_TCP_FullSegment(rec);
+	sackrecovery=rec->inrecovery && rec->sackok;
+	while(1) {
+		maxseg=sgIP_TCP_MaxPayload(rec,SGIP_TCP_FLAG_ACK); // less than the mss while SACK blocks are going out
+		if(full>maxseg) full=maxseg;
+		room=rec->cwnd-sgIP_TCP_Pipe(rec);
+		if(sackrecovery) {
+			len=sgIP_TCP_NextHole(rec,&seq);
+			if(len>0) {
+				if(len>maxseg) len=maxseg;
+				if(room<len) break;
+				if(sgIP_TCP_SendSegment(rec,SGIP_TCP_FLAG_ACK,seq,len)<0) break;
+				rec->rexmit_next=seq+len;
+				sent++;
+				continue;
+			}
+		}
+		for(i=0;i<rec->numsacked;i++) { // step over SACKed data; the next SACKed range limits the segment
+			if((int)(rec->sequence_next-rec->sacked[i*2])<0) break;
+			if((int)(rec->sequence_next-rec->sacked[i*2+1])<0) rec->sequence_next=rec->sacked[i*2+1];
+		}
+		unsent=rec->txq_len-(int)(rec->sequence_next-rec->sequence); // never-sent bytes
+		len=(int)(rec->txwindow-rec->sequence_next);
+		if(room>len) room=len;
+		len=unsent;
+		if(len>maxseg) len=maxseg;
+		if(i<rec->numsacked && len>(int)(rec->sacked[i*2]-rec->sequence_next)) len=(int)(rec->sacked[i*2]-rec->sequence_next);
+		if(len>room) { // fill what the window allows if that's a full segment's worth; else wait for acks to open it (RFC 1122 4.2.3.4)
+			if(rec->sequence_next!=rec->sequence && room<full) break;
+			len=room;
+		}
+		if(len<=0) break;
+		if(len<full && len==unsent && rec->want_shutdown!=1) { // the tail of the buffer, less than a segment
+			if(rec->cork) break; // TCP_CORK: wait for more data to fill it
+			if(!rec->nodelay && (int)(rec->snd_sml-rec->sequence)>0) break; // Nagle (Minshall's variant): only one small segment in flight
+		}
+		if(sgIP_TCP_SendSegment(rec,SGIP_TCP_FLAG_ACK,rec->sequence_next,len)<0) break;
+		if(len<full) rec->snd_sml=rec->sequence_next;
+		sent++;
+	}
+	if(sackrecovery && !sent && !rec->rescued && rec->numsacked && rec->cwnd-sgIP_TCP_Pipe(rec)>=maxseg) {
+		// rescue retransmission (RFC 6675 5 C.4): one segment ending at the highest byte sent, in case
+		//  the tail past the highest SACK was lost too and nothing behind it will bring more SACKs.
+		seq=rec->sacked[rec->numsacked*2-1];
+		len=(int)(rec->sequence_next-seq);
+		if(len>maxseg) len=maxseg;
+		if(len>0 && sgIP_TCP_SendSegment(rec,SGIP_TCP_FLAG_ACK,rec->sequence_next-len,len)>=0) {
+			rec->rescued=1;
+			sent++;
+		}
+	}
+	if(!sent && forceack) sgIP_TCP_SendSegment(rec,SGIP_TCP_FLAG_ACK,rec->sequence_next,0);
+	return sent;
+}
+
+// congestion control (RFC 5681 / NewReno RFC 6582), in bytes.
+void sgIP_TCP_InitCongestion(sgIP_Record_TCP * rec) {
+	int iw;
+	iw=2*rec->mss; // initial window, RFC 3390
+	if(iw<4380) iw=4380;
+	if(iw>4*rec->mss) iw=4*rec->mss;
+	rec->cwnd=iw;
+	rec->ssthresh=0x7FFFFFFF;
+	rec->dupacks=0;
+	rec->inrecovery=0;
+	rec->recover=rec->sequence;
+	rec->rexmit_next=rec->sequence;
+	rec->rescued=0;
+	rec->sequence_max=rec->sequence_next;
+	rec->rttiming=0;
+}
+// acked bytes of new data were acknowledged; flight was the amount outstanding before.
+void sgIP_TCP_NewAck(sgIP_Record_TCP * rec, int acked, int flight) {
+	rec->dupacks=0;
+	if(rec->inrecovery) {
+		if((int)(rec->sequence-rec->recover)>=0) { // everything outstanding at the loss is acked
+			rec->inrecovery=0;
+			rec->cwnd=rec->ssthresh;
+		} else if(rec->sackok) { // partial ack: the scoreboard says what else to resend
+			sgIP_TCP_Output(rec,0);
+		} else { // partial ack: the segment after it was lost too
+			sgIP_TCP_SendSegment(rec,SGIP_TCP_FLAG_ACK,rec->sequence,rec->mss);
+			rec->cwnd-=acked;
+			rec->cwnd+=rec->mss;
+			if(rec->cwnd<rec->mss) rec->cwnd=rec->mss;
+		}
+	} else if(flight+rec->mss>=rec->cwnd) { // only grow while the window is what limits us
+		// counting bytes acked rather than acks (RFC 3465), so an ack that covers several segments
+		//  (the remote end's delayed acks, or a receive batch) opens the window as much as separate ones.
+		if(rec->cwnd<rec->ssthresh) { // slow start
+			rec->cwnd+=(acked<2*rec->mss)?acked:2*rec->mss;
+		} else { // congestion avoidance
+			rec->cwnd+=rec->mss*acked/rec->cwnd+1;
+		}
+	}
+	// new data acked, restart the retransmit timer
+	rec->time_last_action=sgIP_timems;
+	rec->time_backoff=rec->rto;
+}
+// round trip time estimation (RFC 6298).  srtt is kept scaled by 8 and rttvar by 4, as in BSD.
+void sgIP_TCP_RttSample(sgIP_Record_TCP * rec, int rtt) {
+	int delta;
+	if(rtt<0) rtt=0;
+	if(rec->srtt<0) { // first measurement
+		rec->srtt=rtt<<3;
+		rec->rttvar=rtt<<1;
+	} else {
+		delta=rtt-(rec->srtt>>3);
+		rec->srtt+=delta; // srtt += delta/8
+		if(delta<0) delta=-delta;
+		rec->rttvar+=delta-(rec->rttvar>>2); // rttvar += (|delta|-rttvar)/4
+	}
+	delta=rec->rttvar; // 4*rttvar
+	if(delta<SGIP_TCP_TIMERGRANULARITYMS) delta=SGIP_TCP_TIMERGRANULARITYMS;
+	rec->rto=(rec->srtt>>3)+delta;
+	if(rec->rto<SGIP_TCP_MINRTOMS) rec->rto=SGIP_TCP_MINRTOMS;
+	if(rec->rto>SGIP_TCP_BACKOFFMAX) rec->rto=SGIP_TCP_BACKOFFMAX;
+}
+void sgIP_TCP_DupAck(sgIP_Record_TCP * rec) {
+	int flight,len;
+	rec->dupacks++;
+	if(rec->inrecovery) {
+		// each further duplicate means another segment has left the network.  with SACK the pipe
+		//  estimate already counts it, without it the window is inflated to let another one out.
+		if(!rec->sackok) rec->cwnd+=rec->mss;
+		sgIP_TCP_Output(rec,0);
+		return;
+	}
+	if(rec->dupacks==SGIP_TCP_DUPACKTHRESH && (int)(rec->sequence-rec->recover)>=0) { // fast retransmit
+		flight=(int)(rec->sequence_next-rec->sequence);
+		rec->ssthresh=flight/2;
+		if(rec->ssthresh<2*rec->mss) rec->ssthresh=2*rec->mss;
+		rec->recover=rec->sequence_next;
+		rec->inrecovery=1;
+		rec->rescued=0;
+		len=sgIP_TCP_MaxPayload(rec,SGIP_TCP_FLAG_ACK);
+		if(rec->numsacked && len>(int)(rec->sacked[0]-rec->sequence)) len=(int)(rec->sacked[0]-rec->sequence);
+		sgIP_TCP_SendSegment(rec,SGIP_TCP_FLAG_ACK,rec->sequence,len);
+		rec->rexmit_next=rec->sequence+len;
+		if((int)(rec->rexmit_next-rec->sequence_next)>0) rec->rexmit_next=rec->sequence_next;
+		if(rec->sackok) rec->cwnd=rec->ssthresh; // RFC 6675: the pipe estimate decides what goes out
+		else rec->cwnd=rec->ssthresh+SGIP_TCP_DUPACKTHRESH*rec->mss;
+		sgIP_TCP_Output(rec,0);
+	}
+}
+// the retransmit timer went off: assume everything outstanding is lost and start over from one segment.
+void sgIP_TCP_RetransmitTimeout(sgIP_Record_TCP * rec) {
+	int flight;
+	if(rec->cwnd>rec->mss) { // first timeout for this loss
+		flight=(int)(rec->sequence_next-rec->sequence);
+		rec->ssthresh=flight/2;
+		if(rec->ssthresh<2*rec->mss) rec->ssthresh=2*rec->mss;
+	}
+	rec->cwnd=rec->mss;
+	rec->dupacks=0;
+	rec->inrecovery=0;
+	rec->recover=rec->sequence_next;
+	sgIP_TCP_Retransmit(rec);
+}
+
+// retransmission timeout (or a smaller path MTU): everything outstanding is taken as lost.  resend the
+//  first segment now, and go back so sgIP_TCP_Output sends the rest again as acks open the window,
+//  stepping over whatever the remote end has SACKed.
+void sgIP_TCP_Retransmit(sgIP_Record_TCP * rec) {
+	int j,mss;
+	mss=sgIP_TCP_MaxPayload(rec,SGIP_TCP_FLAG_ACK);
+	j=(int)(rec->txwindow-rec->sequence);
+	if(mss>j) mss=j;
+	if(mss<1) mss=1; // closed window: probe with one byte, so the reply carries the current window (RFC 1122 4.2.2.17)
+	if(rec->numsacked) {
+		j=(int)(rec->sacked[0]-rec->sequence); // up to the first SACKed range
+		if(j>0 && mss>j) mss=j;
+	}
+	if(rec->inrecovery) {
+		rec->inrecovery=0;
+		rec->cwnd=rec->ssthresh;
+	}
+	rec->sequence_next=rec->sequence;
+	rec->snd_sml=rec->sequence; // a small segment sent before is going again, it no longer holds Nagle back
+	sgIP_TCP_SendSegment(rec,SGIP_TCP_FLAG_ACK,rec->sequence,mss);
+}
+
+// merge SACK blocks from an incoming segment into the scoreboard, and forget anything
+//  the cumulative ack has passed.
+void sgIP_TCP_UpdateScoreboard(sgIP_Record_TCP * rec, sgIP_TCP_Options * opt) {
+	int i,j,n;
+	unsigned long s,e;
+	n=rec->numsacked;
+	for(i=0;i<opt->numsack;i++) {
+		s=opt->sack[i*2];
+		e=opt->sack[i*2+1];
+		if((int)(e-s)<=0 || (int)(e-rec->sequence_max)>0) continue; // bogus (sequence_next may have gone back after a timeout)
+		for(j=0;j<n;j++) if((int)(s-rec->sacked[j*2])<0) break; // insert sorted by start
+		if(n==SGIP_TCP_SACKSCOREBOARD) {
+			if(j==n) continue; // no room, and beyond everything we know about
+			n--;
+		}
+		memmove(rec->sacked+j*2+2,rec->sacked+j*2,(n-j)*2*sizeof(unsigned long));
+		rec->sacked[j*2]=s;
+		rec->sacked[j*2+1]=e;
+		n++;
+	}
+	// coalesce overlapping ranges and trim to the unacknowledged region
+	j=0;
+	for(i=0;i<n;i++) {
+		s=rec->sacked[i*2];
+		e=rec->sacked[i*2+1];
+		if((int)(e-rec->sequence)<=0) continue;
+		if((int)(s-rec->sequence)<0) s=rec->sequence;
+		if(j && (int)(s-rec->sacked[j*2-1])<=0) {
+			if((int)(e-rec->sacked[j*2-1])>0) rec->sacked[j*2-1]=e;
+		} else {
+			rec->sacked[j*2]=s;
+			rec->sacked[j*2+1]=e;
+			j++;
+		}
+	}
+	rec->numsacked=j;
+}
+
+int sgIP_TCP_SendSynReply(int flags,unsigned long seq, unsigned long ack, unsigned long srcip, unsigned long destip, int srcport, int destport, int windowlen, sgIP_TCP_Options * opts) {
+   unsigned char optbuf[40];
+   int optlen;
    SGIP_INTR_PROTECT();
 
-   sgIP_memblock * mb = sgIP_memblock_alloc(20+sgIP_IP_RequiredHeaderSize());
+   optlen=sgIP_TCP_WriteOptions(optbuf,opts);
+   sgIP_memblock * mb = sgIP_memblock_alloc(20+optlen+sgIP_IP_RequiredHeaderSize());
    if(!mb) {
       SGIP_INTR_UNPROTECT();
       return 0;
@@ -679,9 +1546,11 @@ int sgIP_TCP_SendSynReply(int flags,unsigned long seq, unsigned long ack, unsign
    tcp->tcpflags=flags;
    tcp->urg_ptr=0; // no support for URG data atm.
    tcp->checksum=0;
-   tcp->dataofs_=5<<4; // header length == 20 (5*32bit)
+   tcp->dataofs_=((20+optlen)/4)<<4;
+   if(optlen) sgIP_memblock_CopyFromLinear(mb,optbuf,20,optlen);
 
-   if(windowlen<0 || windowlen>1400) windowlen=1400; // don't want to deal with IP fragmentation.
+   if(windowlen<0) windowlen=0;
+   if(windowlen>65535) windowlen=65535; // not scaled in a SYN (or a RST)
    tcp->window=htons(windowlen);
 
    sgIP_TCP_FixChecksum(srcip,destip,mb);
@@ -696,22 +1565,56 @@ sgIP_Record_TCP * sgIP_TCP_AllocRecord() {
 	sgIP_Record_TCP * rec;
 	rec = sgIP_malloc(sizeof(sgIP_Record_TCP));
 	if(rec) {
-		rec->buf_oob_in=0;
-		rec->buf_oob_out=0;
-		rec->buf_rx_in=0;
-		rec->buf_rx_out=0;
-		rec->buf_tx_in=0;
-		rec->buf_tx_out=0;
+		sgIP_Ring_Init(&rec->rx);
+		rec->buf_rx_want=SGIP_TCP_RECEIVEBUFFERLENGTH;
+		rec->txq=rec->txq_end=0;
+		rec->txq_off=rec->txq_len=rec->txq_room=0;
+		rec->buf_tx_size=0;
+		rec->buf_tx_want=SGIP_TCP_TRANSMITBUFFERLENGTH;
 		rec->tcpstate=0;
 		rec->next=tcprecords;
 		tcprecords=rec;
 		rec->maxlisten=0;
 		rec->srcip=0;
+		rec->srcport=0;
+		rec->destport=0;
+		rec->hashflags=0;
       rec->retrycount=0;
       rec->errorcode=0;
       rec->listendata=0;
 	  rec->want_shutdown=0;
       rec->want_reack=0;
+		rec->rxooo=0;
+		rec->sackok=0;
+		rec->numsacked=0;
+		rec->wscaleok=0;
+		rec->snd_wscale=0;
+		rec->rcv_wscale=0;
+		rec->ackpending=0;
+		rec->batchack=0;
+		rec->batchnext=0;
+		rec->nodelay=0;
+		rec->cork=0;
+		rec->max_sndwnd=0;
+		rec->snd_sml=0;
+		rec->segs_in=0;
+		rec->data_segs_in=0;
+		rec->segs_out=0;
+		rec->data_segs_out=0;
+		rec->mss=SGIP_TCP_DEFAULTMSS;
+		rec->cwnd=SGIP_TCP_DEFAULTMSS;
+		rec->ssthresh=0x7FFFFFFF;
+		rec->dupacks=0;
+		rec->inrecovery=0;
+		rec->rexmit_next=0;
+		rec->rescued=0;
+		rec->sequence_max=0;
+		rec->srtt=-1;
+		rec->rttvar=0;
+		rec->rto=SGIP_TCP_GENRETRYMS;
+		rec->rttiming=0;
+		rec->retransmits=0;
+		sgIP_TimerWheel_InitEntry(&rec->timer,sgIP_TCP_RecordTimer,rec);
 	}
 	SGIP_INTR_UNPROTECT();
 	return rec;
@@ -720,8 +1623,14 @@ void sgIP_TCP_FreeRecord(sgIP_Record_TCP * rec) {
 	if(!rec) return;
 	SGIP_INTR_PROTECT();
 	sgIP_Record_TCP * t;
-   int i,j;
+   int i;
 	rec->tcpstate=0;
+	sgIP_TCP_HashRemove(rec);
+	sgIP_TCP_BatchUnlink(rec);
+	sgIP_TimerWheel_Cancel(&rec->timer);
+	if(rec->rxooo) sgIP_memblock_free(rec->rxooo);
+	sgIP_Ring_Free(&rec->rx);
+	sgIP_TCP_TxFlush(rec);
 	if(tcprecords==rec) {
 		tcprecords=rec->next;
 	} else {
@@ -739,16 +1648,6 @@ void sgIP_TCP_FreeRecord(sgIP_Record_TCP * rec) {
          if(!rec->listendata[i]) break;
          sgIP_TCP_FreeRecord(rec->listendata[i]);
       }
-      // kill any possible waiting elements in the SYN chain.
-      j=0;
-      for(i=0;i<numsynlist;i++) {
-         if(j!=i) {
-            synlist[j]=synlist[i];
-         }
-         if(synlist[i].linked==rec) j--;
-         j++;
-      }
-      numsynlist=j;
       sgIP_free(rec->listendata);
    }
 	sgIP_free(rec);
@@ -756,6 +1655,132 @@ void sgIP_TCP_FreeRecord(sgIP_Record_TCP * rec) {
 	SGIP_INTR_UNPROTECT();
 }
 
+// Socket buffers are allocated when a connection is set up (listening sockets never get any),
+//  at the sizes asked for in buf_rx_want/buf_tx_want. returns 0, or 1 if out of memory.
+//  The send queue takes memblocks as sgIP_TCP_Send fills it, buf_tx_size only limits it.
+int sgIP_TCP_AllocBuffers(sgIP_Record_TCP * rec) {
+	if(!rec->rx.buf && sgIP_Ring_Alloc(&rec->rx,rec->buf_rx_want)) return 1;
+	rec->buf_tx_size=rec->buf_tx_want;
+	return 0;
+}
+// bring allocated buffers to their wanted size. A receive buffer that holds more than fits in the
+//  new size (including what may still arrive in the advertised window) is left as it is, and
+//  resized once it has drained. A smaller send queue limit just holds sgIP_TCP_Send off until
+//  enough has been acked.
+void sgIP_TCP_ResizeBuffers(sgIP_Record_TCP * rec) {
+	int used;
+	if(rec->rx.buf && rec->buf_rx_want!=rec->rx.size) {
+		used=sgIP_Ring_Used(&rec->rx);
+		if((int)(rec->rxwindow-rec->ack)>0) used+=(int)(rec->rxwindow-rec->ack);
+		sgIP_Ring_Resize(&rec->rx,rec->buf_rx_want,used);
+	}
+	if(rec->buf_tx_size) rec->buf_tx_size=rec->buf_tx_want;
+}
+// SO_RCVBUF/SO_SNDBUF: set the receive and/or transmit buffer size (0 leaves it alone).
+void sgIP_TCP_SetBufferSize(sgIP_Record_TCP * rec, int rxsize, int txsize) {
+	if(!rec) return;
+	SGIP_INTR_PROTECT();
+	if(rxsize) {
+		if(rxsize<SGIP_TCP_MINBUFFERLENGTH) rxsize=SGIP_TCP_MINBUFFERLENGTH;
+		if(rxsize>SGIP_TCP_MAXBUFFERLENGTH) rxsize=SGIP_TCP_MAXBUFFERLENGTH;
+		rec->buf_rx_want=rxsize;
+	}
+	if(txsize) {
+		if(txsize<SGIP_TCP_MINBUFFERLENGTH) txsize=SGIP_TCP_MINBUFFERLENGTH;
+		if(txsize>SGIP_TCP_MAXBUFFERLENGTH) txsize=SGIP_TCP_MAXBUFFERLENGTH;
+		rec->buf_tx_want=txsize;
+	}
+	sgIP_TCP_ResizeBuffers(rec);
+	SGIP_INTR_UNPROTECT();
+}
+// TCP_NODELAY/TCP_CORK (-1 leaves an option alone); clearing TCP_CORK sends whatever it held back.
+void sgIP_TCP_SetNoDelay(sgIP_Record_TCP * rec, int nodelay, int cork) {
+	if(!rec) return;
+	SGIP_INTR_PROTECT();
+	if(nodelay>=0) rec->nodelay=nodelay?1:0;
+	if(cork>=0) rec->cork=cork?1:0;
+	if(rec->tcpstate==SGIP_TCP_STATE_ESTABLISHED || rec->tcpstate==SGIP_TCP_STATE_CLOSE_WAIT) {
+		sgIP_TCP_Output(rec,0);
+		sgIP_TCP_UpdateTimer(rec);
+	}
+	SGIP_INTR_UNPROTECT();
+}
+// bytes sgIP_TCP_Send could take right now.
+int sgIP_TCP_SendSpace(sgIP_Record_TCP * rec) {
+	int n;
+	n=rec->buf_tx_size-rec->txq_len;
+	if(n<0) n=0; // (after SO_SNDBUF was made smaller)
+	return n;
+}
+// the send queue block holding seq (which must be queued), and seq's offset in it.
+sgIP_memblock * sgIP_TCP_TxBlock(sgIP_Record_TCP * rec, unsigned long seq, int * offset) {
+	sgIP_memblock * mb;
+	int ofs;
+	ofs=(int)(seq-rec->sequence)+rec->txq_off;
+	mb=rec->txq;
+	while(ofs>=mb->thislength) {
+		ofs-=mb->thislength;
+		mb=mb->nextpacket;
+	}
+	*offset=ofs;
+	return mb;
+}
+// drop acked bytes from the front of the send queue. blocks still waiting in a lower layer
+//  (or on the air) are only let go here, and freed when that's done with them too.
+void sgIP_TCP_TxAcked(sgIP_Record_TCP * rec, int acked) {
+	sgIP_memblock * mb;
+	if(acked>rec->txq_len) acked=rec->txq_len; // the ack for our FIN isn't queued data
+	if(acked<=0) return;
+	rec->txq_len-=acked;
+	rec->txq_off+=acked;
+	if(!rec->txq_len) { // all of it: start over with an empty queue
+		sgIP_TCP_TxFlush(rec);
+		return;
+	}
+	while(rec->txq_off>=rec->txq->thislength) {
+		mb=rec->txq;
+		rec->txq_off-=mb->thislength;
+		rec->txq=mb->nextpacket;
+		mb->nextpacket=0;
+		sgIP_memblock_free(mb);
+	}
+}
+// empty the send queue.
+void sgIP_TCP_TxFlush(sgIP_Record_TCP * rec) {
+	sgIP_memblock * mb;
+	while((mb=rec->txq)) {
+		rec->txq=mb->nextpacket;
+		mb->nextpacket=0;
+		sgIP_memblock_free(mb);
+	}
+	rec->txq_end=0;
+	rec->txq_off=rec->txq_len=rec->txq_room=0;
+}
+// receive window to offer in a SYN or SYN-ACK, before the receive buffer is necessarily allocated
+int sgIP_TCP_SynWindow(sgIP_Record_TCP * rec) {
+	if(rec->buf_rx_want-1<65535) return rec->buf_rx_want-1;
+	return 65535;
+}
+// RFC 7323 window scale: the smallest shift that lets the window field cover a bufsize byte fifo
+int sgIP_TCP_WindowShift(int bufsize) {
+	int shift;
+	shift=0;
+	while(shift<14 && ((bufsize-1)>>shift)>65535) shift++;
+	return shift;
+}
+// the remote end's SYN carried window scale option wscale (-1 if none); scaling is used only
+//  if both ends sent the option.
+void sgIP_TCP_SetWindowScale(sgIP_Record_TCP * rec, int wscale) {
+	if(wscale<0) {
+		rec->wscaleok=0;
+		rec->snd_wscale=0;
+		rec->rcv_wscale=0;
+	} else {
+		rec->wscaleok=1;
+		rec->snd_wscale=wscale>14?14:wscale;
+	}
+}
+
 int sgIP_TCP_Bind(sgIP_Record_TCP * rec, int srcport, unsigned long srcip) {
 	if(!rec) return 0;
 	SGIP_INTR_PROTECT();
@@ -763,6 +1788,7 @@ int sgIP_TCP_Bind(sgIP_Record_TCP * rec, int srcport, unsigned long srcip) {
 		rec->srcip=srcip;
 		rec->srcport=srcport;
 		rec->tcpstate=SGIP_TCP_STATE_UNUSED;
+		sgIP_TCP_HashInsert(rec,SGIP_TCP_HASHED_BIND);
 	}
 	SGIP_INTR_UNPROTECT();
 	return 0;
@@ -778,23 +1804,22 @@ int sgIP_TCP_Listen(sgIP_Record_TCP * rec, int maxlisten) {
 		err=0;
       if(maxlisten<=0) maxlisten=1;
 		rec->maxlisten=maxlisten;
-		rec->listendata = (sgIP_Record_TCP **) sgIP_malloc(maxlisten*4); // pointers to TCP records, 0-terminated list.
-		if(!rec->listendata) { rec->maxlisten=0; err=0; } else {rec->tcpstate=SGIP_TCP_STATE_LISTEN; rec->listendata[0]=0;}
+		rec->listendata = (sgIP_Record_TCP **) sgIP_malloc(maxlisten*sizeof(sgIP_Record_TCP *)); // pointers to TCP records, 0-terminated list.
+		if(!rec->listendata) { rec->maxlisten=0; err=0; } else {rec->tcpstate=SGIP_TCP_STATE_LISTEN; rec->listendata[0]=0; sgIP_TCP_HashInsert(rec,SGIP_TCP_HASHED_LISTEN);}
 	}
 	SGIP_INTR_UNPROTECT();
 	return err;
 }
 
 sgIP_Record_TCP * sgIP_TCP_Accept(sgIP_Record_TCP * rec) {
-   if(!rec) return (sgIP_Record_TCP *)SGIP_ERROR0(EINVAL);
-   if(rec->tcpstate!=SGIP_TCP_STATE_LISTEN) return (sgIP_Record_TCP *)SGIP_ERROR0(EINVAL);
-   int err,i;
+   if(!rec || rec->tcpstate!=SGIP_TCP_STATE_LISTEN) { errno=EINVAL; return 0; }
+   int i;
    sgIP_Record_TCP * t;
    SGIP_INTR_PROTECT();
-   if(!rec->listendata) err=SGIP_ERROR0(EINVAL);
+   if(!rec->listendata) errno=EINVAL;
    else {
       if(!rec->listendata[0]) {
-         err=SGIP_ERROR0(EWOULDBLOCK);
+         errno=EWOULDBLOCK;
       } else {
          t=rec->listendata[0];
          for(i=1;i<rec->maxlisten;i++) {
@@ -814,17 +1839,23 @@ int sgIP_TCP_Close(sgIP_Record_TCP * rec) {
 	if(!rec) return SGIP_ERROR(EINVAL);
 	SGIP_INTR_PROTECT();
 	if(rec->want_shutdown==0) rec->want_shutdown=1;
+	sgIP_TCP_UpdateTimer(rec);
 	SGIP_INTR_UNPROTECT();
 	return 0;
 }
 int sgIP_TCP_Connect(sgIP_Record_TCP * rec, unsigned long destip, int destport) {
 	if(!rec) return SGIP_ERROR(EINVAL);
 	SGIP_INTR_PROTECT();
+	if((rec->tcpstate==SGIP_TCP_STATE_NODATA || rec->tcpstate==SGIP_TCP_STATE_UNUSED) && sgIP_TCP_AllocBuffers(rec)) {
+		SGIP_INTR_UNPROTECT();
+		return SGIP_ERROR(ENOMEM);
+	}
 	if(rec->tcpstate==SGIP_TCP_STATE_NODATA) { // need to bind a local address
 		rec->srcip=sgIP_IP_GetLocalBindAddr(0,destip);
 		rec->srcport=htons(sgIP_TCP_GetUnusedOutgoingPort());
 		rec->destip=destip;
 		rec->destport=destport;		
+		sgIP_TCP_HashInsert(rec,SGIP_TCP_HASHED_BIND);
 	} else if(rec->tcpstate==SGIP_TCP_STATE_UNUSED) { // already bound to a local address.
       rec->srcip=sgIP_IP_GetLocalBindAddr(rec->srcip,destip);
 		rec->destip=destip;
@@ -834,11 +1865,16 @@ int sgIP_TCP_Connect(sgIP_Record_TCP * rec, unsigned long destip, int destport)
 		return SGIP_ERROR(EINVAL);
 	}
 
+	sgIP_TCP_HashInsert(rec,SGIP_TCP_HASHED_CONN);
+	rec->mss=sgIP_TCP_LocalMSS(destip);
+
 	// send a SYN packet, and advance the state of the connection
 	rec->sequence=sgIP_TCP_support_seqhash(rec->srcip,rec->destip,rec->srcport,rec->destport);
+	rec->snd_sml=rec->sequence;
 	sgIP_TCP_SendPacket(rec,SGIP_TCP_FLAG_SYN,0);
    rec->retrycount=0;
 	rec->tcpstate=SGIP_TCP_STATE_SYN_SENT;
+	sgIP_TCP_UpdateTimer(rec);
 
 	SGIP_INTR_UNPROTECT();
 	return 0;
@@ -847,43 +1883,44 @@ int sgIP_TCP_Send(sgIP_Record_TCP * rec, const char * datatosend, int datalength
 	if(!rec || !datatosend) return SGIP_ERROR(EINVAL);
 	if(rec->want_shutdown) return SGIP_ERROR(ESHUTDOWN);
 	SGIP_INTR_PROTECT();
-	int bufsize;
-	bufsize=rec->buf_tx_out-rec->buf_tx_in;
-	if(bufsize<0) bufsize+=SGIP_TCP_TRANSMITBUFFERLENGTH;
-	if(bufsize==0) { rec->time_last_action=sgIP_timems; 	rec->time_backoff=SGIP_TCP_GENRETRYMS; } // first byte sent, set up delay before sending
-	bufsize=SGIP_TCP_TRANSMITBUFFERLENGTH-bufsize-1; // space left in buffer
-	if(datalength>bufsize) datalength=bufsize;
-	int i,j;
-	j=rec->buf_tx_out;
-	for(i=0;i<datalength;i++) {
-		rec->buf_tx[j++]=datatosend[i];
-		if(j==SGIP_TCP_TRANSMITBUFFERLENGTH) j=0;
-	}
-	rec->buf_tx_out = j;
-   // check for immediate transmit
-   j=rec->buf_tx_out-rec->buf_tx_in;
-   if(j<0) j+=SGIP_TCP_TRANSMITBUFFERLENGTH;
-   j+=(int)(rec->sequence-rec->sequence_next);
-   if(j>SGIP_TCP_TRANSMIT_IMMTHRESH && rec->tcpstate==SGIP_TCP_STATE_ESTABLISHED) {
-      j=(int)(rec->sequence_next-rec->sequence);
-      if(j<1000) { // arbitrary constant.
-         j=rec->buf_tx_out-rec->buf_tx_in;
-         if(j<0) j+=SGIP_TCP_TRANSMITBUFFERLENGTH;
-         i=(int)(rec->txwindow-rec->sequence);
-         if(j>i) j=i;
-         i=sgIP_IP_MaxContentsSize(rec->destip)-20; // max tcp data size
-         if(j>i) j=i;
-         sgIP_TCP_SendPacket(rec,SGIP_TCP_FLAG_ACK,j);
-         rec->retrycount=0;
-      }
+	int i,n;
+	sgIP_memblock * mb;
+	if(!rec->txq_len) { rec->time_last_action=sgIP_timems; 	rec->time_backoff=rec->rto; } // first byte sent, set up delay before sending
+	for(i=0;i<datalength;i+=n) {
+		if(rec->txq_len>=rec->buf_tx_size) break; // queue full (or not connected, no limit yet)
+		if(!rec->txq_room) { // start another block
+			n=sgIP_TCP_FullSegment(rec);
+			if(n>SGIP_MEMBLOCK_FIRSTINTERNALSIZE) n=SGIP_MEMBLOCK_FIRSTINTERNALSIZE;
+			mb=sgIP_memblock_alloc(n);
+			if(!mb) break;
+			mb->thislength=mb->totallength=0;
+			if(rec->txq_end) rec->txq_end->nextpacket=mb; else rec->txq=mb;
+			rec->txq_end=mb;
+			rec->txq_room=n;
+		}
+		mb=rec->txq_end;
+		n=datalength-i;
+		if(n>rec->txq_room) n=rec->txq_room;
+		if(n>rec->buf_tx_size-rec->txq_len) n=rec->buf_tx_size-rec->txq_len;
+		memcpy(mb->datastart+mb->thislength,datatosend+i,n);
+		mb->thislength+=n;
+		mb->totallength=mb->thislength;
+		rec->txq_room-=n;
+		rec->txq_len+=n;
+	}
+	datalength=i;
+   if(rec->tcpstate==SGIP_TCP_STATE_ESTABLISHED || rec->tcpstate==SGIP_TCP_STATE_CLOSE_WAIT) {
+      sgIP_TCP_Output(rec,0); // full segments go now, a partial one as Nagle/TCP_CORK allow
+      rec->retrycount=0;
    }
+   sgIP_TCP_UpdateTimer(rec);
 	SGIP_INTR_UNPROTECT();
    if(datalength==0) return SGIP_ERROR(EWOULDBLOCK);
 	return datalength;	
 }
 int sgIP_TCP_Recv(sgIP_Record_TCP * rec, char * databuf, int buflength, int flags) {
 	if(!rec || !databuf) return SGIP_ERROR(EINVAL); //error
-   if(rec->buf_rx_in==rec->buf_rx_out) {
+   if(!sgIP_Ring_Used(&rec->rx)) {
       if((rec->want_shutdown == 0 && rec->tcpstate>=SGIP_TCP_STATE_CLOSE_WAIT) ||
          (rec->want_shutdown == 2 && rec->tcpstate>=SGIP_TCP_STATE_TIME_WAIT)) {
          if(rec->errorcode) return SGIP_ERROR(rec->errorcode);
@@ -892,30 +1929,65 @@ int sgIP_TCP_Recv(sgIP_Record_TCP * rec, char * databuf, int buflength, int flag
       return SGIP_ERROR(EWOULDBLOCK); //error no data
    }
 	SGIP_INTR_PROTECT();
-	int rxlen = rec->buf_rx_out - rec->buf_rx_in;
-	if(rxlen<0) rxlen+=SGIP_TCP_RECEIVEBUFFERLENGTH;
-	if(buflength>rxlen) buflength=rxlen;
-	int i,j;
-	j=rec->buf_rx_in;
-	for(i=0;i<buflength;i++) {
-		databuf[i]=rec->buf_rx[j++];
-		if(j==SGIP_TCP_RECEIVEBUFFERLENGTH) j=0;
-	}
+	int i;
+	buflength=sgIP_Ring_Read(&rec->rx,databuf,buflength,flags&MSG_PEEK);
 
     if(!(flags&MSG_PEEK)) {
-	    rec->buf_rx_in=j;
+        if(rec->buf_rx_want!=rec->rx.size) sgIP_TCP_ResizeBuffers(rec);
 
+        i=sgIP_Ring_Space(&rec->rx);
         if(rec->want_reack) {
-            i=rec->buf_rx_out-rec->buf_rx_in;
-            if(i<0) i+=SGIP_TCP_RECEIVEBUFFERLENGTH; // we now have the amount in the buffer
-            i = SGIP_TCP_RECEIVEBUFFERLENGTH-i-1;
-            if(i<0) i=0;
-            if(i>SGIP_TCP_REACK_THRESH) {
+            if(i>SGIP_TCP_REACK_THRESH || i>=rec->rx.size/2) { // (small buffers never get to the threshold)
                 rec->want_reack=0;
                 sgIP_TCP_SendPacket(rec,SGIP_TCP_FLAG_ACK,0);
             }
+        } else if(rec->tcpstate==SGIP_TCP_STATE_ESTABLISHED && i-(int)(rec->rxwindow-rec->ack)>=2*rec->mss) {
+            // reading opened the window by two segments since we last offered it: tell them (RFC 1122 4.2.3.3)
+            sgIP_TCP_SendPacket(rec,SGIP_TCP_FLAG_ACK,0);
         }
     }
 	SGIP_INTR_UNPROTECT();
 	return buflength;
 }
+
+// fill in a tcp_info snapshot for getsockopt(TCP_INFO).
+void sgIP_TCP_GetInfo(sgIP_Record_TCP * rec, struct tcp_info * info) {
+	static const unsigned char states[] = {
+		TCP_CLOSE, TCP_CLOSE, TCP_LISTEN, TCP_SYN_SENT, TCP_SYN_RECV, TCP_ESTABLISHED, TCP_FIN_WAIT1,
+		TCP_FIN_WAIT2, TCP_CLOSE_WAIT, TCP_CLOSING, TCP_LAST_ACK, TCP_TIME_WAIT, TCP_CLOSE };
+	int i;
+	SGIP_INTR_PROTECT();
+	memset(info,0,sizeof(struct tcp_info));
+	info->tcpi_state=states[rec->tcpstate];
+	if(rec->inrecovery) info->tcpi_ca_state=TCP_CA_Recovery;
+	else if((int)(rec->sequence-rec->recover)<0) info->tcpi_ca_state=TCP_CA_Loss;
+	else if(rec->dupacks) info->tcpi_ca_state=TCP_CA_Disorder;
+	else info->tcpi_ca_state=TCP_CA_Open;
+	for(i=rec->rto;i<rec->time_backoff && info->tcpi_backoff<255;i*=2) info->tcpi_backoff++;
+	if(rec->sackok) info->tcpi_options|=TCPI_OPT_SACK;
+	if(rec->wscaleok) {
+		info->tcpi_options|=TCPI_OPT_WSCALE;
+		info->tcpi_snd_wscale=rec->snd_wscale;
+		info->tcpi_rcv_wscale=rec->rcv_wscale;
+	}
+	info->tcpi_rto=rec->rto*1000;
+	info->tcpi_ato=SGIP_TCP_DELACKMS*1000;
+	info->tcpi_snd_mss=rec->mss;
+	if(rec->tcpstate==SGIP_TCP_STATE_ESTABLISHED || rec->tcpstate==SGIP_TCP_STATE_CLOSE_WAIT) {
+		info->tcpi_unacked=(int)(rec->sequence_next-rec->sequence);
+		info->tcpi_sacked=info->tcpi_unacked-sgIP_TCP_FlightSize(rec);
+	}
+	if(rec->srtt>=0) {
+		info->tcpi_rtt=(rec->srtt>>3)*1000;
+		info->tcpi_rttvar=(rec->rttvar>>2)*1000;
+	}
+	if(rec->ssthresh==0x7FFFFFFF) info->tcpi_snd_ssthresh=TCP_INFINITE_SSTHRESH; // not scaled, as in Linux
+	else info->tcpi_snd_ssthresh=rec->ssthresh/rec->mss;
+	info->tcpi_snd_cwnd=rec->cwnd/rec->mss;
+	info->tcpi_total_retrans=rec->retransmits;
+	info->tcpi_segs_out=rec->segs_out;
+	info->tcpi_segs_in=rec->segs_in;
+	info->tcpi_data_segs_out=rec->data_segs_out;
+	info->tcpi_data_segs_in=rec->data_segs_in;
+	SGIP_INTR_UNPROTECT();
+}
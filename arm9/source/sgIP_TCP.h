@@ -27,6 +27,8 @@ SOFTWARE.
 
 #include "sgIP_Config.h"
 #include "sgIP_memblock.h"
+#include "sgIP_TimerWheel.h"
+#include "sgIP_Ring.h"
 
 enum SGIP_TCP_STATE {
 	SGIP_TCP_STATE_NODATA, // newly allocated
@@ -52,6 +54,20 @@ enum SGIP_TCP_STATE {
 #define SGIP_TCP_FLAG_ACK	16
 #define SGIP_TCP_FLAG_URG	32
 
+#define SGIP_TCP_OPT_END		0
+#define SGIP_TCP_OPT_NOP		1
+#define SGIP_TCP_OPT_MSS		2
+#define SGIP_TCP_OPT_WSCALE		3
+#define SGIP_TCP_OPT_SACKOK		4
+#define SGIP_TCP_OPT_SACK		5
+
+#define SGIP_TCP_DUPACKTHRESH	3 // duplicate acks that trigger a fast retransmit
+#define SGIP_TCP_DEFAULTMSS		536 // assumed when the remote end doesn't send an MSS option
+
+#define SGIP_TCP_HASHED_CONN	1 // in the connection hash (remote ip, local port, remote port)
+#define SGIP_TCP_HASHED_LISTEN	2 // in the listen hash (local port)
+#define SGIP_TCP_HASHED_BIND	4 // in the local port hash
+
 typedef struct SGIP_HEADER_TCP {
 	unsigned short srcport,destport;
 	unsigned long seqnum;
@@ -64,10 +80,22 @@ typedef struct SGIP_HEADER_TCP {
 	unsigned char options[4];
 } sgIP_Header_TCP;
 
+// sgIP_TCP_Options - the options carried in (or to be written to) a TCP header.
+typedef struct SGIP_TCP_OPTIONS {
+	int mss; // 0 if not present
+	int sackok; // SACK-permitted (SYN only)
+	int wscale; // -1 if not present
+	int numsack; // number of SACK blocks
+	unsigned long sack[SGIP_TCP_MAXSACKBLOCKS*2]; // start,end pairs (end is the sequence after the block)
+} sgIP_TCP_Options;
+
 
 // sgIP_Record_TCP - a TCP record, to store data for an active TCP connection.
 typedef struct SGIP_RECORD_TCP {
 	struct SGIP_RECORD_TCP * next; // operate as a linked list
+	struct SGIP_RECORD_TCP * hashnext; // next record in the same connection or listen hash bucket
+	struct SGIP_RECORD_TCP * bindnext; // next record in the same local port hash bucket
+	int hashflags; // which hash tables this record is currently linked into
 	// TCP state information
 	int tcpstate;
 	unsigned long sequence; // sequence number of first byte not acknowledged by remote system
@@ -86,35 +114,69 @@ typedef struct SGIP_RECORD_TCP {
    int errorcode;
    int want_shutdown; // 0= don't want shutdown, 1= want shutdown, 2= being shutdown
    int want_reack;
+	sgIP_memblock * rxooo; // out-of-order segments waiting for a hole to be filled, by sequence
+	int mss; // largest segment data size we will send on this connection
+	int cwnd; // congestion window, bytes
+	int ssthresh; // slow start threshold, bytes
+	int dupacks; // duplicate acks seen in a row
+	int inrecovery; // in fast recovery until recover is acked
+	unsigned long recover; // sequence_next at the time loss was detected
+	unsigned long rexmit_next; // SACK recovery: holes below this have been resent already (RFC 6675 HighRxt)
+	int rescued; // SACK recovery: the tail past the highest SACK has been resent once
+	unsigned long sequence_max; // highest sequence number sent so far; anything below it sent again is a retransmission
+	int srtt; // smoothed round trip time, ms*8 (-1 until the first measurement)
+	int rttvar; // round trip time variation, ms*4
+	int rto; // retransmit timeout, ms
+	int rttiming; // a segment is being timed
+	unsigned long rttseq; // ack that ends the timed segment
+	unsigned long rtttime; // sgIP_timems when the timed segment was sent
+	int retransmits; // segments sent more than once
+	int nodelay; // TCP_NODELAY: don't hold small segments back (no Nagle)
+	int cork; // TCP_CORK: only send full segments
+	int max_sndwnd; // largest window the remote end has offered
+	unsigned long snd_sml; // end of the last segment sent shorter than a full one (Nagle)
+	int ackpending; // bytes received in order and not acked yet (delayed ack)
+	unsigned long ackdue; // sgIP_timems when the delayed ack has to go out
+	int batchack; // on the batch ack list: an ack is owed at the end of the current receive batch, unless one goes out first
+	struct SGIP_RECORD_TCP * batchnext; // next record on the batch ack list
+	unsigned long segs_in, data_segs_in; // segments received, and of those the ones carrying data
+	unsigned long segs_out, data_segs_out; // segments sent, and of those the ones carrying data
+	sgIP_TimerEntry timer; // next retransmit/transmit/time-wait deadline
+	int sackok; // both ends agreed to use SACK
+	int wscaleok; // both ends sent a window scale option
+	int snd_wscale, rcv_wscale; // window scale shifts for the remote end's window and for ours
+	int numsacked; // number of ranges in the sacked scoreboard
+	unsigned long sacked[SGIP_TCP_SACKSCOREBOARD*2]; // ranges the remote end has SACKed, beyond sequence, sorted
 	// TCP buffer information:
-	int buf_rx_in, buf_rx_out;
-	int buf_tx_in, buf_tx_out;
-	int buf_oob_in, buf_oob_out;
-	unsigned char buf_rx[SGIP_TCP_RECEIVEBUFFERLENGTH];
-	unsigned char buf_tx[SGIP_TCP_TRANSMITBUFFERLENGTH];
-	unsigned char buf_oob[SGIP_TCP_OOBBUFFERLENGTH];
+	sgIP_Ring rx; // received data not yet read, no buffer until the connection is set up
+	int buf_tx_size; // send queue limit, 0 until the connection is set up
+	int buf_rx_want, buf_tx_want; // sizes asked for by SO_RCVBUF/SO_SNDBUF
+	// send queue: unacked and unsent data, in memblocks of up to one segment linked by nextpacket.
+	//  a segment that is exactly one block is sent straight from it, without copying.
+	sgIP_memblock * txq, * txq_end;
+	int txq_off; // bytes at the start of txq that are already acked
+	int txq_len; // bytes queued from sequence on (unacked + unsent)
+	int txq_room; // space left at the end of txq_end for sgIP_TCP_Send to fill
 } sgIP_Record_TCP;
 
-typedef struct SGIP_TCP_SYNCOOKIE {
-	unsigned long localseq, remoteseq;
-	unsigned long localip, remoteip;
-	unsigned short localport, remoteport;
-	unsigned long timenext,timebackoff; 
-	sgIP_Record_TCP * linked; // parent listening connection
-} sgIP_TCP_SYNCookie;
-
-
+struct tcp_info;
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 	extern void sgIP_TCP_Init();
-   extern void sgIP_TCP_Timer();
+	extern void sgIP_TCP_AddEntropy(unsigned long data);
 
 	extern int sgIP_TCP_ReceivePacket(sgIP_memblock * mb, unsigned long srcip, unsigned long destip);
-	extern int sgIP_TCP_SendPacket(sgIP_Record_TCP * rec, int flags, int datalength); // data sent is taken directly from the TX fifo.
-   extern int sgIP_TCP_SendSynReply(int flags,unsigned long seq, unsigned long ack, unsigned long srcip, unsigned long destip, int srcport, int destport, int windowlen);
+	extern void sgIP_TCP_BatchStart();
+	extern void sgIP_TCP_BatchEnd();
+	extern int sgIP_TCP_SendPacket(sgIP_Record_TCP * rec, int flags, int datalength); // data sent is taken directly from the send queue.
+	extern int sgIP_TCP_SendSegment(sgIP_Record_TCP * rec, int flags, unsigned long seq, int datalength); // as above, starting at any unacknowledged sequence number
+   extern int sgIP_TCP_SendSynReply(int flags,unsigned long seq, unsigned long ack, unsigned long srcip, unsigned long destip, int srcport, int destport, int windowlen, sgIP_TCP_Options * opts);
+
+	extern void sgIP_TCP_GetInfo(sgIP_Record_TCP * rec, struct tcp_info * info);
+	extern void sgIP_TCP_PMTUUpdate(unsigned long srcip, unsigned long destip, unsigned short srcport, unsigned short destport, unsigned long seq, int mtu);
 
 	extern sgIP_Record_TCP * sgIP_TCP_AllocRecord();
 	extern void sgIP_TCP_FreeRecord(sgIP_Record_TCP * rec);
@@ -125,6 +187,9 @@ extern "C" {
 	extern int sgIP_TCP_Connect(sgIP_Record_TCP * rec, unsigned long destip, int destport);
 	extern int sgIP_TCP_Send(sgIP_Record_TCP * rec, const char * datatosend, int datalength, int flags);
 	extern int sgIP_TCP_Recv(sgIP_Record_TCP * rec, char * databuf, int buflength, int flags);
+	extern void sgIP_TCP_SetBufferSize(sgIP_Record_TCP * rec, int rxsize, int txsize);
+	extern int sgIP_TCP_SendSpace(sgIP_Record_TCP * rec);
+	extern void sgIP_TCP_SetNoDelay(sgIP_Record_TCP * rec, int nodelay, int cork);
 
 #ifdef __cplusplus
 };
@@ -0,0 +1,139 @@
+// DSWifi Project - sgIP Internet Protocol Stack Implementation
+// Copyright (C) 2005-2006 Stephen Stair - sgstair@akkit.org - http://www.akkit.org
+/****************************************************************************** 
+DSWifi Lib and test materials are licenced under the MIT open source licence:
+Copyright (c) 2005-2006 Stephen Stair
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#include "sgIP_TimerWheel.h"
+
+// A hierarchical timing wheel: level 0 has one slot per tick for the next 64 ticks, level 1
+//  one slot per 64 ticks, level 2 one per 4096.  Entries further out move down a level when
+//  their slot comes round, so each tick only touches what is due (plus a cascade every 64).
+
+extern unsigned long volatile sgIP_timems;
+
+sgIP_TimerEntry * timerwheel[SGIP_TIMERWHEEL_LEVELS][SGIP_TIMERWHEEL_SLOTS];
+unsigned long timerwheel_ticks; // tick number last processed
+unsigned long timerwheel_time; // sgIP_timems at that tick
+
+void sgIP_TimerWheel_Init() {
+	int i,j;
+	for(i=0;i<SGIP_TIMERWHEEL_LEVELS;i++) for(j=0;j<SGIP_TIMERWHEEL_SLOTS;j++) timerwheel[i][j]=0;
+	timerwheel_ticks=0;
+	timerwheel_time=sgIP_timems;
+}
+
+void sgIP_TimerWheel_InitEntry(sgIP_TimerEntry * t, void (*callback)(void *), void * data) {
+	t->next=0;
+	t->pprev=0;
+	t->expires=0;
+	t->callback=callback;
+	t->data=data;
+}
+
+void sgIP_TimerWheel_Unlink(sgIP_TimerEntry * t) {
+	if(!t->pprev) return;
+	*t->pprev=t->next;
+	if(t->next) t->next->pprev=t->pprev;
+	t->next=0;
+	t->pprev=0;
+}
+
+// put an (unlinked) entry in the slot for its deadline
+void sgIP_TimerWheel_Insert(sgIP_TimerEntry * t) {
+	sgIP_TimerEntry ** slot;
+	int delta;
+	unsigned long tick;
+	delta=(int)(t->expires-timerwheel_time);
+	if(delta<=0) delta=1; else delta=(delta+SGIP_TIMERWHEEL_TICKMS-1)/SGIP_TIMERWHEEL_TICKMS;
+	if(delta>=SGIP_TIMERWHEEL_SPAN) delta=SGIP_TIMERWHEEL_SPAN-1; // it'll be put back when it gets here
+	tick=timerwheel_ticks+delta;
+	if(delta<SGIP_TIMERWHEEL_SLOTS) {
+		slot=&timerwheel[0][tick&(SGIP_TIMERWHEEL_SLOTS-1)];
+	} else if(delta<SGIP_TIMERWHEEL_SLOTS*SGIP_TIMERWHEEL_SLOTS) {
+		slot=&timerwheel[1][(tick>>SGIP_TIMERWHEEL_BITS)&(SGIP_TIMERWHEEL_SLOTS-1)];
+	} else {
+		slot=&timerwheel[2][(tick>>(SGIP_TIMERWHEEL_BITS*2))&(SGIP_TIMERWHEEL_SLOTS-1)];
+	}
+	t->next=*slot;
+	if(t->next) t->next->pprev=&t->next;
+	t->pprev=slot;
+	*slot=t;
+}
+
+void sgIP_TimerWheel_Set(sgIP_TimerEntry * t, unsigned long expires) {
+	SGIP_INTR_PROTECT();
+	sgIP_TimerWheel_Unlink(t);
+	t->expires=expires;
+	sgIP_TimerWheel_Insert(t);
+	SGIP_INTR_UNPROTECT();
+}
+
+void sgIP_TimerWheel_Cancel(sgIP_TimerEntry * t) {
+	SGIP_INTR_PROTECT();
+	sgIP_TimerWheel_Unlink(t);
+	SGIP_INTR_UNPROTECT();
+}
+
+// re-file every entry in one slot, relative to the current tick
+void sgIP_TimerWheel_Cascade(int level, int slot) {
+	sgIP_TimerEntry * t, * list;
+	list=timerwheel[level][slot];
+	timerwheel[level][slot]=0;
+	while(list) {
+		t=list;
+		list=t->next;
+		t->next=0;
+		t->pprev=0;
+		sgIP_TimerWheel_Insert(t);
+	}
+}
+
+void sgIP_TimerWheel_Run() {
+	sgIP_TimerEntry * t;
+	int i,j;
+	SGIP_INTR_PROTECT();
+	if((unsigned long)(sgIP_timems-timerwheel_time) >= (unsigned long)SGIP_TIMERWHEEL_SPAN*SGIP_TIMERWHEEL_TICKMS) {
+		// the clock jumped (sgIP_timems is seeded once the wifi hardware comes up); start over from here
+		timerwheel_time=sgIP_timems;
+		for(i=0;i<SGIP_TIMERWHEEL_LEVELS;i++) for(j=0;j<SGIP_TIMERWHEEL_SLOTS;j++) sgIP_TimerWheel_Cascade(i,j);
+	}
+	while((int)(sgIP_timems-timerwheel_time)>=SGIP_TIMERWHEEL_TICKMS) {
+		timerwheel_time+=SGIP_TIMERWHEEL_TICKMS;
+		timerwheel_ticks++;
+		if(!(timerwheel_ticks&(SGIP_TIMERWHEEL_SLOTS-1))) {
+			i=(timerwheel_ticks>>SGIP_TIMERWHEEL_BITS)&(SGIP_TIMERWHEEL_SLOTS-1);
+			if(!i) sgIP_TimerWheel_Cascade(2,(timerwheel_ticks>>(SGIP_TIMERWHEEL_BITS*2))&(SGIP_TIMERWHEEL_SLOTS-1));
+			sgIP_TimerWheel_Cascade(1,i);
+		}
+		i=timerwheel_ticks&(SGIP_TIMERWHEEL_SLOTS-1);
+		while((t=timerwheel[0][i])) {
+			sgIP_TimerWheel_Unlink(t);
+			if((int)(t->expires-timerwheel_time)>0) { // clamped to the wheel's reach, not due yet
+				sgIP_TimerWheel_Insert(t);
+				continue;
+			}
+			t->callback(t->data); // may re-arm t, or anything else
+		}
+	}
+	SGIP_INTR_UNPROTECT();
+}
@@ -0,0 +1,62 @@
+// DSWifi Project - sgIP Internet Protocol Stack Implementation
+// Copyright (C) 2005-2006 Stephen Stair - sgstair@akkit.org - http://www.akkit.org
+/****************************************************************************** 
+DSWifi Lib and test materials are licenced under the MIT open source licence:
+Copyright (c) 2005-2006 Stephen Stair
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#ifndef SGIP_TIMERWHEEL_H
+#define SGIP_TIMERWHEEL_H
+
+#include "sgIP_Config.h"
+
+#define SGIP_TIMERWHEEL_LEVELS	3
+#define SGIP_TIMERWHEEL_BITS	6 // 64 slots per level
+#define SGIP_TIMERWHEEL_SLOTS	(1<<SGIP_TIMERWHEEL_BITS)
+#define SGIP_TIMERWHEEL_SPAN	(1<<(SGIP_TIMERWHEEL_BITS*SGIP_TIMERWHEEL_LEVELS)) // ticks the wheel can look ahead
+
+// sgIP_TimerEntry - one pending deadline, embedded in the record that owns it.
+typedef struct SGIP_TIMERENTRY {
+	struct SGIP_TIMERENTRY * next;
+	struct SGIP_TIMERENTRY ** pprev; // link pointing at this entry; 0 when not armed
+	unsigned long expires; // sgIP_timems to fire at
+	void (*callback)(void * data);
+	void * data;
+} sgIP_TimerEntry;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	extern void sgIP_TimerWheel_Init();
+	extern void sgIP_TimerWheel_Run(); // fire everything that is due by sgIP_timems
+
+	extern void sgIP_TimerWheel_InitEntry(sgIP_TimerEntry * t, void (*callback)(void *), void * data);
+	extern void sgIP_TimerWheel_Set(sgIP_TimerEntry * t, unsigned long expires); // (re)arm; a deadline already passed fires on the next tick
+	extern void sgIP_TimerWheel_Cancel(sgIP_TimerEntry * t);
+
+#ifdef __cplusplus
+};
+#endif
+
+
+#endif
@@ -26,40 +26,105 @@ SOFTWARE.
 #include "sgIP_Hub.h"
 #include "sgIP_UDP.h"
 #include "sgIP_IP.h"
+#include "sys/socket.h"
+
+#define SGIP_UDP_NUMOUTGOINGPORTS (SGIP_UDP_LASTOUTGOINGPORT-SGIP_UDP_FIRSTOUTGOINGPORT+1)
 
 sgIP_Record_UDP * udprecords;
+sgIP_Record_UDP * udphash[SGIP_UDP_PORTHASHSIZE]; // bound records, by local port
+unsigned long udpportmap[(SGIP_UDP_NUMOUTGOINGPORTS+31)/32]; // outgoing range ports in use, 1 bit each
+int udpports_used;
 int udpport_counter;
 extern unsigned long volatile sgIP_timems;
 
 void sgIP_UDP_Init() {
+	int i;
 	udprecords=0;
+	for(i=0;i<SGIP_UDP_PORTHASHSIZE;i++) udphash[i]=0;
+	for(i=0;i<(SGIP_UDP_NUMOUTGOINGPORTS+31)/32;i++) udpportmap[i]=0;
+	udpports_used=0;
    udpport_counter=SGIP_UDP_FIRSTOUTGOINGPORT;
 }
 
+int sgIP_UDP_HashPort(unsigned short port) {
+	return (port ^ (port>>8))&(SGIP_UDP_PORTHASHSIZE-1);
+}
+
+// mark a local port (network order) used/free in the outgoing port bitmap, if it's in that range.
+//  a port stays marked while any record is bound to it.
+void sgIP_UDP_PortMark(unsigned short nport, int used) {
+	int i;
+	sgIP_Record_UDP * rec;
+	i=htons(nport)-SGIP_UDP_FIRSTOUTGOINGPORT;
+	if(i<0 || i>=SGIP_UDP_NUMOUTGOINGPORTS) return;
+	if(!used) {
+		for(rec=udphash[sgIP_UDP_HashPort(nport)];rec;rec=rec->hashnext) if(rec->srcport==nport) return;
+		if(udpportmap[i>>5]&(1UL<<(i&31))) udpports_used--;
+		udpportmap[i>>5]&=~(1UL<<(i&31));
+	} else {
+		if(!(udpportmap[i>>5]&(1UL<<(i&31)))) udpports_used++;
+		udpportmap[i>>5]|=1UL<<(i&31);
+	}
+}
+
+void sgIP_UDP_HashInsert(sgIP_Record_UDP * rec) {
+	int i;
+	if(rec->hashed) return;
+	i=sgIP_UDP_HashPort(rec->srcport);
+	rec->hashnext=udphash[i];
+	udphash[i]=rec;
+	rec->hashed=1;
+	sgIP_UDP_PortMark(rec->srcport,1);
+}
+void sgIP_UDP_HashRemove(sgIP_Record_UDP * rec) {
+	sgIP_Record_UDP ** bucket;
+	if(!rec->hashed) return;
+	bucket=udphash+sgIP_UDP_HashPort(rec->srcport);
+	while(*bucket) {
+		if(*bucket==rec) {
+			*bucket=rec->hashnext;
+			break;
+		}
+		bucket=&(*bucket)->hashnext;
+	}
+	rec->hashnext=0;
+	rec->hashed=0;
+	sgIP_UDP_PortMark(rec->srcport,0);
+}
 
+// a free port (host order) in the outgoing range, from a semi-random starting point; whole words
+//  of the bitmap that are in use get skipped at once.  returns 0 if every port in the range is taken.
 int sgIP_UDP_GetUnusedOutgoingPort() {
-   int myport,clear;
-   sgIP_Record_UDP * rec;
+	int i,n;
+	unsigned long bits;
+	if(udpports_used>=SGIP_UDP_NUMOUTGOINGPORTS) return 0;
    udpport_counter+=(sgIP_timems&1023); // semi-random
    if(udpport_counter>SGIP_UDP_LASTOUTGOINGPORT) udpport_counter=SGIP_UDP_FIRSTOUTGOINGPORT;
-   while(1) {
-      rec = udprecords;
-      myport=udpport_counter++;
-      if(udpport_counter>SGIP_UDP_LASTOUTGOINGPORT) udpport_counter=SGIP_UDP_FIRSTOUTGOINGPORT;
-      clear=1;
-      while(rec) {
-         if(rec->srcport==myport) { clear=0; break; }
-         rec=rec->next;
-      }
-      if(clear) return myport;
-   }
+	i=udpport_counter-SGIP_UDP_FIRSTOUTGOINGPORT;
+	for(n=0;n<=(SGIP_UDP_NUMOUTGOINGPORTS+31)/32;n++) {
+		bits=udpportmap[i>>5] | ((1UL<<(i&31))-1); // ports before i in its word don't count yet
+		if((i>>5)==(SGIP_UDP_NUMOUTGOINGPORTS-1)>>5 && (SGIP_UDP_NUMOUTGOINGPORTS&31))
+			bits|=~((1UL<<(SGIP_UDP_NUMOUTGOINGPORTS&31))-1); // past the end of the range
+		if((bits&0xFFFFFFFF)!=0xFFFFFFFF) {
+			i&=~31;
+			while(bits&1) { bits>>=1; i++; }
+			udpport_counter=SGIP_UDP_FIRSTOUTGOINGPORT+i+1;
+			if(udpport_counter>SGIP_UDP_LASTOUTGOINGPORT) udpport_counter=SGIP_UDP_FIRSTOUTGOINGPORT;
+			return SGIP_UDP_FIRSTOUTGOINGPORT+i;
+		}
+		i=(i|31)+1;
+		if(i>=SGIP_UDP_NUMOUTGOINGPORTS) i=0;
+	}
+	return 0;
 }
 
-int sgIP_UDP_CalcChecksum(sgIP_memblock * mb, unsigned long srcip, unsigned long destip, int totallength) {
-	int checksum;
+// checksum (inverted, ready for the header) of the first sumlength bytes of mb plus datasum, the sum of
+//  the rest from sgIP_memblock_CopyFromLinearChecksum
+int sgIP_UDP_CalcChecksumPartial(sgIP_memblock * mb, unsigned long srcip, unsigned long destip, int totallength, int sumlength, unsigned long datasum) {
+	unsigned long checksum;
 	if(!mb) return 0;
-	if(mb->totallength&1) mb->datastart[mb->totallength]=0;
-	checksum=sgIP_memblock_IPChecksum(mb,0,mb->totallength);
+	checksum=sgIP_memblock_IPChecksum(mb,0,sumlength);
+	checksum+=datasum;
 	// add in checksum of "faux header"
 	checksum+=(destip&0xFFFF);
 	checksum+=(destip>>16);
@@ -74,25 +139,102 @@ int sgIP_UDP_CalcChecksum(sgIP_memblock * mb, unsigned long srcip, unsigned long
     if(checksum==0) checksum=0xFFFF;
 	return checksum;
 }
+int sgIP_UDP_CalcChecksum(sgIP_memblock * mb, unsigned long srcip, unsigned long destip, int totallength) {
+	if(!mb) return 0;
+	return sgIP_UDP_CalcChecksumPartial(mb,srcip,destip,totallength,mb->totallength,0);
+}
+
+int sgIP_UDP_Matches(sgIP_Record_UDP * rec, unsigned short port, unsigned long destip) {
+	return (rec->srcip==destip || rec->srcip==0) && rec->srcport==port && rec->state!=SGIP_UDP_STATE_UNUSED;
+}
+// take the packet at the front of the record's queue.
+sgIP_memblock * sgIP_UDP_DequeuePacket(sgIP_Record_UDP * rec) {
+	sgIP_memblock * mb;
+	mb=rec->incoming_queue;
+	if(!mb) return 0;
+	rec->incoming_queue=mb->nextpacket;
+	if(!(rec->incoming_queue)) rec->incoming_queue_end=0;
+	mb->nextpacket=0;
+	rec->queue_bytes-=mb->totallength;
+	rec->queue_packets--;
+	if(rec->queue_checked) rec->queue_checked--;
+	return mb;
+}
+int sgIP_UDP_QueueFull(sgIP_Record_UDP * rec, sgIP_memblock * mb) {
+	return rec->incoming_queue && (rec->queue_bytes+mb->totallength>rec->buf_rx_size || rec->queue_packets>=SGIP_UDP_MAXQUEUED);
+}
+// check every queued datagram not checked yet, and free the ones that fail; afterwards the whole
+//  queue is known to be good.
+void sgIP_UDP_CheckQueue(sgIP_Record_UDP * rec) {
+	sgIP_memblock * mb, * prev, * next;
+	int i;
+	prev=0;
+	mb=rec->incoming_queue;
+	for(i=0;i<rec->queue_checked && mb;i++) { prev=mb; mb=mb->nextpacket; }
+	while(mb) {
+		next=mb->nextpacket;
+		if(sgIP_UDP_DatagramOK(mb)) {
+			prev=mb;
+		} else {
+			if(prev) prev->nextpacket=next; else rec->incoming_queue=next;
+			if(rec->incoming_queue_end==mb) rec->incoming_queue_end=prev;
+			rec->queue_bytes-=mb->totallength;
+			rec->queue_packets--;
+			mb->nextpacket=0;
+			sgIP_memblock_free(mb);
+		}
+		mb=next;
+	}
+	rec->queue_checked=rec->queue_packets;
+}
+// add a received packet (srcip in front of its udp header) to the end of the record's queue, if it
+//  fits in the socket's limits; otherwise drop it, or with dropoldest drop from the front until it
+//  fits.  returns 0 if the packet was dropped (and freed).
+//  checksums are normally left for the read, but nothing is dropped for the limits on the strength
+//  of an unchecked datagram: when it doesn't fit, the new one and everything queued gets checked
+//  first, so corrupt ones neither hold space nor push good ones out.
+int sgIP_UDP_QueuePacket(sgIP_Record_UDP * rec, sgIP_memblock * mb) {
+	if(sgIP_UDP_QueueFull(rec,mb)) {
+		if(!sgIP_UDP_DatagramOK(mb)) {
+			sgIP_memblock_free(mb);
+			return 0;
+		}
+		sgIP_UDP_CheckQueue(rec);
+		while(sgIP_UDP_QueueFull(rec,mb)) {
+			rec->rx_dropped++;
+			if(!rec->dropoldest) {
+				sgIP_memblock_free(mb);
+				return 0;
+			}
+			sgIP_memblock_free(sgIP_UDP_DequeuePacket(rec));
+		}
+		if(rec->queue_checked==rec->queue_packets) rec->queue_checked++; // the new one is good too
+	}
+	mb->nextpacket=0;
+	if(rec->incoming_queue==0) {
+		rec->incoming_queue=mb;
+	} else {
+		rec->incoming_queue_end->nextpacket=mb;
+	}
+	rec->incoming_queue_end=mb;
+	rec->queue_bytes+=mb->totallength;
+	rec->queue_packets++;
+	return 1;
+}
 
 int sgIP_UDP_ReceivePacket(sgIP_memblock * mb, unsigned long srcip, unsigned long destip) {
 	if(!mb) return 0;
-	int chk = sgIP_UDP_CalcChecksum(mb,srcip,destip,mb->totallength);
+	// (the checksum is checked as the datagram is read, or sooner if the queue is full; see sgIP_UDP_QueuePacket)
 	sgIP_Header_UDP * udp;
 	udp=(sgIP_Header_UDP *)mb->datastart;
-	if(chk!=0xFFFF && udp->checksum != 0) {
-		SGIP_DEBUG_MESSAGE(("UDP receive checksum incorrect"));
-		sgIP_memblock_free(mb);
-		return 0; // checksum error
-	}
-	sgIP_Record_UDP * rec;
-	sgIP_memblock *tmb;
+	sgIP_Record_UDP * rec, * r2;
+	sgIP_memblock *cmb;
 	SGIP_INTR_PROTECT();
-	rec=udprecords;
+	rec=udphash[sgIP_UDP_HashPort(udp->destport)];
 
 	while(rec) {
-		if((rec->srcip==destip || rec->srcip==0) && rec->srcport==udp->destport && rec->state!=SGIP_UDP_STATE_UNUSED) break; // a match!
-		rec=rec->next;
+		if(sgIP_UDP_Matches(rec,udp->destport,destip)) break; // a match!
+		rec=rec->hashnext;
 	}
 	if(!rec) { // no matching records
 		sgIP_memblock_free(mb);
@@ -100,17 +242,18 @@ int sgIP_UDP_ReceivePacket(sgIP_memblock * mb, unsigned long srcip, unsigned lon
 		return 0;
 	}
 	// we have a record and a packet for it; add some data to the record and stuff it into the record queue.
-	sgIP_memblock_exposeheader(mb,4);
-	*((unsigned long *)mb->datastart)=srcip; // keep srcip around.
-	if(rec->incoming_queue==0) {
-		rec->incoming_queue=mb;
-	} else {
-		rec->incoming_queue_end->next=mb;
+	sgIP_memblock_exposeheader(mb,8);
+	((unsigned long *)mb->datastart)[0]=srcip; // keep srcip around.
+	((unsigned long *)mb->datastart)[1]=destip; // and destip, for the checksum
+	if(sgIP_Hub_IsBroadcast(destip)) { // every socket on the port gets one, all sharing the one copy of the data
+		for(r2=rec->hashnext;r2;r2=r2->hashnext) {
+			if(!sgIP_UDP_Matches(r2,udp->destport,destip)) continue;
+			cmb=sgIP_memblock_clone(mb);
+			if(!cmb) break;
+			sgIP_UDP_QueuePacket(r2,cmb);
+		}
 	}
-
-	tmb=mb;
-	while(tmb->next) tmb=tmb->next;
-	rec->incoming_queue_end=tmb;
+	sgIP_UDP_QueuePacket(rec,mb);
 	// ok, data added to queue - yay!
 	// that means... we're done.
 
@@ -120,27 +263,32 @@ int sgIP_UDP_ReceivePacket(sgIP_memblock * mb, unsigned long srcip, unsigned lon
 
 int sgIP_UDP_SendPacket(sgIP_Record_UDP * rec, const char * data, int datalen, unsigned long destip, int destport) {
 	if(!rec || !data) return SGIP_ERROR(EINVAL);
-   if(rec->state!=SGIP_UDP_STATE_BOUND) {
-      rec->srcip=0;
-      rec->srcport=sgIP_UDP_GetUnusedOutgoingPort();
-      rec->state=SGIP_UDP_STATE_BOUND;
-   }
 	sgIP_memblock * mb = sgIP_memblock_alloc(sgIP_IP_RequiredHeaderSize()+8+datalen);
 	if(!mb) return SGIP_ERROR(ENOMEM);
 	sgIP_memblock_exposeheader(mb,-sgIP_IP_RequiredHeaderSize()); // hide IP header space for later
 
 	SGIP_INTR_PROTECT();
+   if(rec->state!=SGIP_UDP_STATE_BOUND) {
+      int port=sgIP_UDP_GetUnusedOutgoingPort();
+      if(!port) {
+         sgIP_memblock_free(mb);
+         SGIP_INTR_UNPROTECT();
+         return SGIP_ERROR(EADDRINUSE);
+      }
+      rec->srcip=0;
+      rec->srcport=htons(port); // records store ports in network order
+      rec->state=SGIP_UDP_STATE_BOUND;
+      sgIP_UDP_HashInsert(rec);
+   }
 	unsigned long srcip = sgIP_IP_GetLocalBindAddr(rec->srcip,destip);
 	sgIP_Header_UDP * udp = (sgIP_Header_UDP *) mb->datastart;
 	udp->srcport=rec->srcport;
 	udp->destport=destport;
 	udp->length=htons(datalen+8);
 	udp->checksum=0;
-	int i;
-	for(i=0;i<datalen;i++) {
-		mb->datastart[i+8]=data[i];
-	}
-	udp->checksum=sgIP_UDP_CalcChecksum(mb,srcip,destip,mb->totallength);
+	unsigned long datasum=0;
+	sgIP_memblock_CopyFromLinearChecksum(mb,(void *)data,8,datalen,&datasum);
+	udp->checksum=sgIP_UDP_CalcChecksumPartial(mb,srcip,destip,mb->totallength,8,datasum);
 	sgIP_IP_SendViaIP(mb,17,srcip,destip);
 
 	SGIP_INTR_UNPROTECT();
@@ -156,9 +304,17 @@ sgIP_Record_UDP * sgIP_UDP_AllocRecord() {
 		rec->destport=0;
 		rec->incoming_queue=0;
 		rec->incoming_queue_end=0;
+		rec->queue_bytes=0;
+		rec->queue_packets=0;
+		rec->queue_checked=0;
+		rec->buf_rx_size=SGIP_UDP_RECEIVEBUFFERLENGTH;
+		rec->dropoldest=0;
+		rec->rx_dropped=0;
 		rec->srcip=0;
 		rec->srcport=0;
 		rec->state=0;
+		rec->hashnext=0;
+		rec->hashed=0;
 		rec->next=udprecords;
 		udprecords=rec;
 	}
@@ -169,8 +325,9 @@ void sgIP_UDP_FreeRecord(sgIP_Record_UDP * rec) {
 	if(!rec) return;
 	SGIP_INTR_PROTECT();
 	sgIP_Record_UDP * t;
-	// incoming queue is all clumped together as a single memblock, so, time to free it all in one call :)
-	if(rec->incoming_queue) sgIP_memblock_free(rec->incoming_queue); // woohoo!
+	sgIP_memblock * mb;
+	while((mb=sgIP_UDP_DequeuePacket(rec))) sgIP_memblock_free(mb);
+	sgIP_UDP_HashRemove(rec);
 	rec->state=0;
 	if(udprecords==rec) {
 		udprecords=rec->next;
@@ -193,50 +350,127 @@ int sgIP_UDP_Bind(sgIP_Record_UDP * rec, int srcport, unsigned long srcip) {
 	if(!rec) return SGIP_ERROR(EINVAL);
 	SGIP_INTR_PROTECT();
 	if(rec->state!=SGIP_UDP_STATE_UNUSED) {
+		sgIP_UDP_HashRemove(rec);
 		rec->srcip=srcip;
 		rec->srcport=srcport;
 		if(rec->state==SGIP_UDP_STATE_UNBOUND) rec->state=SGIP_UDP_STATE_BOUND;
+		sgIP_UDP_HashInsert(rec);
 	}
 	SGIP_INTR_UNPROTECT();
 	return 0;
 }
 
-int sgIP_UDP_RecvFrom(sgIP_Record_UDP * rec, char * destbuf, int buflength, int flags, unsigned long * sender_ip, unsigned short * sender_port) {
-	if(!rec || !destbuf || !sender_ip || !sender_port || buflength==0) return SGIP_ERROR(EINVAL);
+// SO_RCVBUF: the limit on bytes waiting in the receive queue; what's already queued stays.
+void sgIP_UDP_SetBufferSize(sgIP_Record_UDP * rec, int rxsize) {
+	if(!rec) return;
+	if(rxsize<SGIP_TCP_MINBUFFERLENGTH) rxsize=SGIP_TCP_MINBUFFERLENGTH;
+	if(rxsize>SGIP_TCP_MAXBUFFERLENGTH) rxsize=SGIP_TCP_MAXBUFFERLENGTH;
 	SGIP_INTR_PROTECT();
-	if(rec->incoming_queue==0) { 
-		SGIP_INTR_UNPROTECT();
-		return SGIP_ERROR(EWOULDBLOCK);
+	rec->buf_rx_size=rxsize;
+	SGIP_INTR_UNPROTECT();
+}
+
+// a queued datagram's checksum is checked when it's read rather than when it arrives, so that it can
+//  be done in the same pass as the copy out.  hdr: the first SGIP_UDP_PAYLOADOFFSET bytes of mb.
+//  payloadsum: the sum of the payload if the caller has it (summed!=0), else it's summed here.
+int sgIP_UDP_QueuedChecksumOK(sgIP_memblock * mb, unsigned long * hdr, unsigned long payloadsum, int summed) {
+	unsigned long checksum;
+	sgIP_Header_UDP * udp;
+	udp=(sgIP_Header_UDP *)(hdr+2);
+	if(udp->checksum==0) return 1; // none was sent
+	if(!summed) payloadsum=sgIP_memblock_IPChecksum(mb,SGIP_UDP_PAYLOADOFFSET,mb->totallength-SGIP_UDP_PAYLOADOFFSET);
+	checksum=sgIP_memblock_ChecksumBuf(udp,8)+payloadsum;
+	// add in checksum of "faux header"
+	checksum+=(hdr[1]&0xFFFF);
+	checksum+=(hdr[1]>>16);
+	checksum+=(hdr[0]&0xFFFF);
+	checksum+=(hdr[0]>>16);
+	checksum+=htons(mb->totallength-8);
+	checksum+=(17)<<8;
+	checksum=(checksum&0xFFFF) + (checksum>>16);
+	checksum=(checksum&0xFFFF) + (checksum>>16);
+	if(checksum!=0xFFFF) {
+		SGIP_DEBUG_MESSAGE(("UDP receive checksum incorrect"));
+		return 0;
 	}
-	int packetlen=rec->incoming_queue->totallength-12;
-	if(packetlen>buflength) {
+	return 1;
+}
+int sgIP_UDP_DatagramOK(sgIP_memblock * mb) {
+	unsigned long hdr[SGIP_UDP_PAYLOADOFFSET/4];
+	sgIP_memblock_CopyToLinear(mb,hdr,0,SGIP_UDP_PAYLOADOFFSET);
+	return sgIP_UDP_QueuedChecksumOK(mb,hdr,0,0);
+}
+
+// copy out the datagram at the front of the queue, checking its checksum on the way; ones that fail
+//  are dropped and the next one tried.  a datagram longer than buflength is truncated (the rest is
+//  lost); MSG_TRUNC returns its real length regardless, and MSG_PEEK leaves it queued.
+int sgIP_UDP_RecvFrom(sgIP_Record_UDP * rec, char * destbuf, int buflength, int flags, unsigned long * sender_ip, unsigned short * sender_port) {
+	if(!rec || (!destbuf && buflength) || buflength<0 || !sender_ip || !sender_port) return SGIP_ERROR(EINVAL);
+	SGIP_INTR_PROTECT();
+	sgIP_memblock * mb;
+	sgIP_Header_UDP * udp;
+	unsigned long hdr[SGIP_UDP_PAYLOADOFFSET/4];
+	unsigned long sum;
+	int packetlen, copylen, ok;
+	while((mb=rec->incoming_queue)) {
+		// (the first block may be an empty one of a clone's, so this is copied out rather than read in place)
+		sgIP_memblock_CopyToLinear(mb,hdr,0,SGIP_UDP_PAYLOADOFFSET);
+		udp=(sgIP_Header_UDP *)(hdr+2);
+		packetlen=mb->totallength-SGIP_UDP_PAYLOADOFFSET;
+		copylen=packetlen;
+		if(copylen>buflength) copylen=buflength;
+		if(rec->queue_checked) {
+			ok=1;
+			sgIP_memblock_CopyToLinear(mb,destbuf,SGIP_UDP_PAYLOADOFFSET,copylen);
+		} else if(udp->checksum && copylen==packetlen) {
+			sum=0;
+			sgIP_memblock_CopyToLinearChecksum(mb,destbuf,SGIP_UDP_PAYLOADOFFSET,copylen,&sum);
+			ok=sgIP_UDP_QueuedChecksumOK(mb,hdr,sum,1);
+		} else {
+			ok=sgIP_UDP_QueuedChecksumOK(mb,hdr,0,0);
+			if(ok) sgIP_memblock_CopyToLinear(mb,destbuf,SGIP_UDP_PAYLOADOFFSET,copylen);
+		}
+		if(!ok) {
+			sgIP_memblock_free(sgIP_UDP_DequeuePacket(rec));
+			continue;
+		}
+		*sender_ip=hdr[0];
+		*sender_port=udp->srcport;
+		if(flags&MSG_PEEK) {
+			if(!rec->queue_checked) rec->queue_checked=1; // checked now, so don't check it again
+		} else {
+			sgIP_memblock_free(sgIP_UDP_DequeuePacket(rec));
+		}
 		SGIP_INTR_UNPROTECT();
-		return SGIP_ERROR(EMSGSIZE);
+		return (flags&MSG_TRUNC)?packetlen:copylen;
 	}
+	SGIP_INTR_UNPROTECT();
+	return SGIP_ERROR(EWOULDBLOCK);
+}
+// zero-copy receive: take the datagram at the front of the queue as it is (once its checksum is
+//  checked); the payload starts SGIP_UDP_PAYLOADOFFSET bytes in.  the caller frees it with sgIP_memblock_free.
+sgIP_memblock * sgIP_UDP_RecvPacket(sgIP_Record_UDP * rec, unsigned long * sender_ip, unsigned short * sender_port) {
 	sgIP_memblock * mb;
-	*sender_ip=*((unsigned long *)rec->incoming_queue->datastart);
-	*sender_port=((unsigned short *)rec->incoming_queue->datastart)[2];
-	int totlen,first, buf_start,i;
-	totlen=rec->incoming_queue->totallength;
-	first=12;
-	buf_start=0;
-
-	while(totlen>0 && rec->incoming_queue) {
-		totlen-=rec->incoming_queue->thislength;
-		for(i=first;i<rec->incoming_queue->thislength;i++) {
-			destbuf[buf_start+i-first]=rec->incoming_queue->datastart[i];
-		}
-		buf_start+=rec->incoming_queue->thislength-first;
-		first=0;
-		mb=rec->incoming_queue;
-		rec->incoming_queue=rec->incoming_queue->next;
-		mb->next=0;
+	unsigned long hdr[SGIP_UDP_PAYLOADOFFSET/4];
+	int ok;
+	if(!rec || !sender_ip || !sender_port) { errno=EINVAL; return 0; }
+	SGIP_INTR_PROTECT();
+	while((mb=rec->incoming_queue)) {
+		sgIP_memblock_CopyToLinear(mb,hdr,0,SGIP_UDP_PAYLOADOFFSET);
+		ok=rec->queue_checked || sgIP_UDP_QueuedChecksumOK(mb,hdr,0,0);
+		sgIP_UDP_DequeuePacket(rec);
+		if(ok) break;
 		sgIP_memblock_free(mb);
 	}
-	if(!(rec->incoming_queue)) rec->incoming_queue_end=0;
-	
+	if(!mb) {
+		SGIP_INTR_UNPROTECT();
+		errno=EWOULDBLOCK;
+		return 0;
+	}
+	*sender_ip=hdr[0];
+	*sender_port=((sgIP_Header_UDP *)(hdr+2))->srcport;
 	SGIP_INTR_UNPROTECT();
-	return buf_start;
+	return mb;
 }
 
 int sgIP_UDP_SendTo(sgIP_Record_UDP * rec, const char * buf, int buflength, int flags, unsigned long dest_ip, int dest_port) {
@@ -38,6 +38,9 @@ enum SGIP_UDP_STATE {
 };
 
 
+// queued datagrams keep the sender's ip, the ip they were sent to and the udp header in front of the payload
+#define SGIP_UDP_PAYLOADOFFSET	16
+
 typedef struct SGIP_HEADER_UDP {
 	unsigned short srcport,destport;
 	unsigned short length,checksum;
@@ -45,14 +48,21 @@ typedef struct SGIP_HEADER_UDP {
 
 typedef struct SGIP_RECORD_UDP {
 	struct SGIP_RECORD_UDP * next;
+	struct SGIP_RECORD_UDP * hashnext; // next record in the same local port hash bucket
+	int hashed; // linked into the local port hash
 
 	int state;
 	unsigned long srcip;
 	unsigned long destip;
 	unsigned short srcport,destport;
 	
-	sgIP_memblock * incoming_queue;
+	sgIP_memblock * incoming_queue; // received packets, linked by nextpacket
 	sgIP_memblock * incoming_queue_end;
+	int queue_bytes, queue_packets; // what's in incoming_queue (totallength of each, srcip included)
+	int queue_checked; // datagrams at the front of incoming_queue whose checksum is known to be good
+	int buf_rx_size; // limit on queue_bytes (SO_RCVBUF)
+	int dropoldest; // SO_RCVDROPOLDEST: make room for new datagrams rather than drop them
+	unsigned long rx_dropped; // datagrams dropped because the queue was full (SO_RCVDROPPED)
 
 } sgIP_Record_UDP;
 
@@ -62,7 +72,13 @@ extern "C" {
 
 	void sgIP_UDP_Init();
 
+	int sgIP_UDP_CalcChecksumPartial(sgIP_memblock * mb, unsigned long srcip, unsigned long destip, int totallength, int sumlength, unsigned long datasum);
 	int sgIP_UDP_CalcChecksum(sgIP_memblock * mb, unsigned long srcip, unsigned long destip, int totallength);
+	int sgIP_UDP_GetUnusedOutgoingPort();
+	int sgIP_UDP_Matches(sgIP_Record_UDP * rec, unsigned short port, unsigned long destip);
+	int sgIP_UDP_QueuePacket(sgIP_Record_UDP * rec, sgIP_memblock * mb);
+	sgIP_memblock * sgIP_UDP_DequeuePacket(sgIP_Record_UDP * rec);
+	void sgIP_UDP_SetBufferSize(sgIP_Record_UDP * rec, int rxsize);
 	int sgIP_UDP_ReceivePacket(sgIP_memblock * mb, unsigned long srcip, unsigned long destip);
 	int sgIP_UDP_SendPacket(sgIP_Record_UDP * rec, const char * data, int datalen, unsigned long destip, int destport);
 
@@ -70,6 +86,9 @@ extern "C" {
 	void sgIP_UDP_FreeRecord(sgIP_Record_UDP * rec);
 
 	int sgIP_UDP_Bind(sgIP_Record_UDP * rec, int srcport, unsigned long srcip);
+	int sgIP_UDP_QueuedChecksumOK(sgIP_memblock * mb, unsigned long * hdr, unsigned long payloadsum, int summed);
+	int sgIP_UDP_DatagramOK(sgIP_memblock * mb);
+	sgIP_memblock * sgIP_UDP_RecvPacket(sgIP_Record_UDP * rec, unsigned long * sender_ip, unsigned short * sender_port);
 	int sgIP_UDP_RecvFrom(sgIP_Record_UDP * rec, char * destbuf, int buflength, int flags, unsigned long * sender_ip, unsigned short * sender_port);
 	int sgIP_UDP_SendTo(sgIP_Record_UDP * rec, const char * buf, int buflength, int flags, unsigned long dest_ip, int dest_port);
 
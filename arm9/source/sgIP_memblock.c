@@ -27,6 +27,25 @@ SOFTWARE.
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+
+sgIP_memblock_Stats memblock_stats;
+
+#ifdef SGIP_MEMBLOCK_SLABS
+// the largest packetsize (as passed to allocHW) each class holds: acks, headers and clone heads;
+//  small datagrams; full frames (sizeof(sgIP_memblock), like the pool's blocks).
+const int memslab_classsize[SGIP_MEMSLAB_NUMCLASSES] = { 104, 600, SGIP_MEMBLOCK_FIRSTINTERNALSIZE };
+sgIP_memslab * memslab_list[SGIP_MEMSLAB_NUMCLASSES];
+int memslab_numfree[SGIP_MEMSLAB_NUMCLASSES];
+#endif
+
+#ifdef SGIP_MEMBLOCK_TICKS
+#define SGIP_MEMBLOCK_TIMESTART()	unsigned long tICKS=SGIP_MEMBLOCK_TICKS
+#define SGIP_MEMBLOCK_TIMEEND(total)	(total)+=(unsigned long)(SGIP_MEMBLOCK_TICKS)-tICKS
+#else
+#define SGIP_MEMBLOCK_TIMESTART()
+#define SGIP_MEMBLOCK_TIMEEND(total)
+#endif
 
 #ifndef SGIP_MEMBLOCK_DYNAMIC_MALLOC_ALL
 
@@ -40,18 +59,42 @@ sgIP_memblock * memblock_poolfree;
 int numused, numfree;
 void * pool_link;
 
+#ifdef SGIP_USEDYNAMICMEMORY
+// the pool is all used up: add another SGIP_MEMBLOCK_STEPNUM blocks to it, linked into pool_link.
+int sgIP_memblock_growpool() {
+	int i;
+	void * link;
+	sgIP_memblock * newblocks;
+	link = sgIP_malloc(sizeof(sgIP_memblock)*SGIP_MEMBLOCK_STEPNUM+4);
+	if(!link) return 0;
+	memblock_stats.heapallocs++;
+	((long *)link)[0]=(long)pool_link;
+	pool_link=link;
+	newblocks = (sgIP_memblock *) (((char *)link)+4);
+	for(i=0;i<SGIP_MEMBLOCK_STEPNUM;i++) {
+		newblocks[i].totallength=0;
+		newblocks[i].next=memblock_poolfree;
+		memblock_poolfree=newblocks+i;
+		numfree++;
+	}
+	memblock_stats.bytesheld+=sizeof(sgIP_memblock)*SGIP_MEMBLOCK_STEPNUM;
+	return 1;
+}
+#endif
 
 sgIP_memblock * sgIP_memblock_getunused() {
-	int i;
 	sgIP_memblock * mb;
 	SGIP_INTR_PROTECT();
+#ifdef SGIP_USEDYNAMICMEMORY
+	if(!memblock_poolfree) sgIP_memblock_growpool();
+#endif
 	if(memblock_poolfree) { // we still have free memblocks!
 		mb=memblock_poolfree;
 		memblock_poolfree=mb->next;
 		numfree--;
 		numused++;
 	} else { // oh noes, we have no more free memblocks.
-		mb = 0; // eventually alloc new blocks, but for now just stop.
+		mb = 0;
 	}
 
 	SGIP_INTR_UNPROTECT();
@@ -62,6 +105,13 @@ sgIP_memblock * sgIP_memblock_getunused() {
 void sgIP_memblock_Init() {
 #ifndef SGIP_MEMBLOCK_DYNAMIC_MALLOC_ALL
 	int i;
+#endif
+	memset(&memblock_stats,0,sizeof(memblock_stats));
+#ifdef SGIP_MEMBLOCK_SLABS
+	memset(memslab_list,0,sizeof(memslab_list));
+	memset(memslab_numfree,0,sizeof(memslab_numfree));
+#endif
+#ifndef SGIP_MEMBLOCK_DYNAMIC_MALLOC_ALL
 #ifdef SGIP_USEDYNAMICMEMORY
 	pool_link = sgIP_malloc(sizeof(sgIP_memblock)*SGIP_MEMBLOCK_BASENUM+4);
 	((long *)pool_link)[0]=0;
@@ -75,19 +125,153 @@ void sgIP_memblock_Init() {
 		memblock_poolfree=memblock_pool+i;
 		numfree++;
 	}
+	memblock_stats.bytesheld=sizeof(sgIP_memblock)*SGIP_MEMBLOCK_BASENUM;
 #endif //SGIP_MEMBLOCK_DYNAMIC_MALLOC_ALL
 }
 
 #ifdef SGIP_MEMBLOCK_DYNAMIC_MALLOC_ALL
 
+#ifdef SGIP_MEMBLOCK_SLABS
+// memblocks are carved from slabs of SGIP_MEMBLOCK_STEPNUM blocks of one size class, a list of slabs
+//  per class.  each block has a pointer to its slab in front of it (0 for a block too big for any
+//  class, which is malloc'd on its own).  a slab is given back to the heap when all its blocks
+//  are free, unless that would leave its class without a slab's worth of free blocks.
+
+#define SGIP_MEMSLAB_ALIGN(n)		(((n)+sizeof(void *)-1)&~(sizeof(void *)-1))
+#define SGIP_MEMSLAB_HEADSIZE		SGIP_MEMSLAB_ALIGN(sizeof(sgIP_memslab))
+#define SGIP_MEMSLAB_BLOCKHEAD		((int)sizeof(sgIP_memblock)-SGIP_MEMBLOCK_INTERNALSIZE+SGIP_MAXHWHEADER)
+#define SGIP_MEMSLAB_STRIDE(c)		SGIP_MEMSLAB_ALIGN(sizeof(sgIP_memslab *)+SGIP_MEMSLAB_BLOCKHEAD+memslab_classsize[c])
+#define SGIP_MEMSLAB_OWNER(mb)		(((sgIP_memslab **)(mb))[-1])
+
+int sgIP_memslab_trim();
+
+sgIP_memslab * sgIP_memslab_grow(int sizeclass) {
+	sgIP_memslab * s, ** link;
+	sgIP_memblock * mb;
+	char * item;
+	int i;
+	s = (sgIP_memslab *) sgIP_malloc(SGIP_MEMSLAB_HEADSIZE+SGIP_MEMSLAB_STRIDE(sizeclass)*SGIP_MEMBLOCK_STEPNUM);
+	if(!s) return 0;
+	memblock_stats.heapallocs++;
+	memblock_stats.slabsgrown++;
+	memblock_stats.bytesheld+=SGIP_MEMSLAB_HEADSIZE+SGIP_MEMSLAB_STRIDE(sizeclass)*SGIP_MEMBLOCK_STEPNUM;
+	s->sizeclass=sizeclass;
+	s->freelist=0;
+	item=((char *)s)+SGIP_MEMSLAB_HEADSIZE;
+	for(i=0;i<SGIP_MEMBLOCK_STEPNUM;i++) {
+		*((sgIP_memslab **)item)=s;
+		mb=(sgIP_memblock *)(item+sizeof(sgIP_memslab *));
+		mb->next=s->freelist;
+		s->freelist=mb;
+		item+=SGIP_MEMSLAB_STRIDE(sizeclass);
+	}
+	s->numfree=SGIP_MEMBLOCK_STEPNUM;
+	memslab_numfree[sizeclass]+=SGIP_MEMBLOCK_STEPNUM;
+	// new slabs go last; blocks are taken from the older slabs first, so the newer ones empty out.
+	for(link=memslab_list+sizeclass;*link;link=&(*link)->next);
+	s->next=0;
+	*link=s;
+	return s;
+}
+sgIP_memblock * sgIP_memslab_alloc(int packetsize) {
+	sgIP_memslab * s;
+	sgIP_memblock * mb;
+	int c;
+	SGIP_INTR_PROTECT();
+	for(c=0;c<SGIP_MEMSLAB_NUMCLASSES;c++) if(packetsize<=memslab_classsize[c]) break;
+	s=0;
+	if(c<SGIP_MEMSLAB_NUMCLASSES) {
+		for(s=memslab_list[c];s;s=s->next) if(s->freelist) break;
+		if(!s) s=sgIP_memslab_grow(c);
+	}
+	if(!s) { // too big for a slab, or no room for another: just this block, on its own
+		mb=0;
+		s=(sgIP_memslab *)sgIP_malloc(sizeof(sgIP_memslab *)+SGIP_MEMSLAB_BLOCKHEAD+packetsize);
+		if(!s && sgIP_memslab_trim()) s=(sgIP_memslab *)sgIP_malloc(sizeof(sgIP_memslab *)+SGIP_MEMSLAB_BLOCKHEAD+packetsize);
+		if(s) {
+			memblock_stats.heapallocs++;
+			*((sgIP_memslab **)s)=0;
+			mb=(sgIP_memblock *)(((char *)s)+sizeof(sgIP_memslab *));
+		}
+		SGIP_INTR_UNPROTECT();
+		return mb;
+	}
+	mb=s->freelist;
+	s->freelist=mb->next;
+	s->numfree--;
+	memslab_numfree[c]--;
+	SGIP_INTR_UNPROTECT();
+	return mb;
+}
+// give back every empty slab (the spares kept by sgIP_memslab_free); returns how many there were.
+int sgIP_memslab_trim() {
+	sgIP_memslab * s, ** link;
+	int c, n;
+	n=0;
+	for(c=0;c<SGIP_MEMSLAB_NUMCLASSES;c++) {
+		link=memslab_list+c;
+		while((s=*link)) {
+			if(s->numfree==SGIP_MEMBLOCK_STEPNUM) {
+				*link=s->next;
+				memslab_numfree[c]-=SGIP_MEMBLOCK_STEPNUM;
+				memblock_stats.slabsreleased++;
+				memblock_stats.bytesheld-=SGIP_MEMSLAB_HEADSIZE+SGIP_MEMSLAB_STRIDE(c)*SGIP_MEMBLOCK_STEPNUM;
+				sgIP_free(s);
+				n++;
+			} else link=&s->next;
+		}
+	}
+	return n;
+}
+void sgIP_memslab_free(sgIP_memblock * mb) {
+	sgIP_memslab * s, ** link;
+	int c;
+	s=SGIP_MEMSLAB_OWNER(mb);
+	if(!s) { // a big one, on its own
+		sgIP_free(((char *)mb)-sizeof(sgIP_memslab *));
+		return;
+	}
+	c=s->sizeclass;
+	mb->next=s->freelist;
+	s->freelist=mb;
+	s->numfree++;
+	memslab_numfree[c]++;
+	if(s->numfree==SGIP_MEMBLOCK_STEPNUM && memslab_numfree[c]>=2*SGIP_MEMBLOCK_STEPNUM) { // shrink
+		for(link=memslab_list+c;*link!=s;link=&(*link)->next);
+		*link=s->next;
+		memslab_numfree[c]-=SGIP_MEMBLOCK_STEPNUM;
+		memblock_stats.slabsreleased++;
+		memblock_stats.bytesheld-=SGIP_MEMSLAB_HEADSIZE+SGIP_MEMSLAB_STRIDE(c)*SGIP_MEMBLOCK_STEPNUM;
+		sgIP_free(s);
+	}
+}
+#endif //SGIP_MEMBLOCK_SLABS
+
 sgIP_memblock * sgIP_memblock_allocHW(int headersize, int packetsize) {
    sgIP_memblock * mb;
+   SGIP_INTR_PROTECT(); // memblock_stats is updated from interrupts too
+   SGIP_MEMBLOCK_TIMESTART();
+#ifdef SGIP_MEMBLOCK_SLABS
+   mb = sgIP_memslab_alloc(packetsize);
+#else
    mb = (sgIP_memblock *) sgIP_malloc(SGIP_MEMBLOCK_HEADERSIZE+SGIP_MAXHWHEADER+packetsize);
-   if(!mb) return 0;
+   if(mb) memblock_stats.heapallocs++;
+#endif
+   if(!mb) {
+      memblock_stats.failed++;
+      SGIP_INTR_UNPROTECT();
+      return 0;
+   }
+   memblock_stats.allocs++;
+   if(++memblock_stats.inuse>memblock_stats.peakinuse) memblock_stats.peakinuse=memblock_stats.inuse;
+   SGIP_INTR_UNPROTECT();
    mb->totallength=headersize+packetsize;
    mb->thislength=mb->totallength;
    mb->datastart=mb->reserved+SGIP_MAXHWHEADER-headersize;
    mb->next=0;
+   mb->refcount=1;
+   mb->nextpacket=0;
+   SGIP_MEMBLOCK_TIMEEND(memblock_stats.allocticks);
    return mb;
 }
 
@@ -96,15 +280,27 @@ sgIP_memblock * sgIP_memblock_allocHW(int headersize, int packetsize) {
 sgIP_memblock * sgIP_memblock_allocHW(int headersize, int packetsize) {
 	sgIP_memblock * mb, * tmb, *t;
 	int totlen;
+	SGIP_INTR_PROTECT(); // memblock_stats is updated from interrupts too
+	SGIP_MEMBLOCK_TIMESTART();
 	mb = sgIP_memblock_getunused();
-	if(!mb) return 0;
+	if(!mb) {
+		memblock_stats.failed++;
+		SGIP_INTR_UNPROTECT();
+		return 0;
+	}
+	memblock_stats.allocs++;
+	if(++memblock_stats.inuse>memblock_stats.peakinuse) memblock_stats.peakinuse=memblock_stats.inuse;
 	mb->totallength=headersize+packetsize;
 	mb->datastart=mb->reserved+SGIP_MAXHWHEADER-headersize;
 	mb->next=0;
+	mb->refcount=1;
+	mb->nextpacket=0;
 	mb->thislength=headersize+SGIP_MEMBLOCK_FIRSTINTERNALSIZE;
 	if(mb->thislength>=mb->totallength) {
 		mb->thislength = mb->totallength;
 //		SGIP_DEBUG_MESSAGE(("memblock_alloc: %i free, %i used",numfree,numused));
+		SGIP_MEMBLOCK_TIMEEND(memblock_stats.allocticks);
+		SGIP_INTR_UNPROTECT();
 		return mb;
 	} else { // need more blocks
 		totlen=mb->thislength;
@@ -113,16 +309,24 @@ sgIP_memblock * sgIP_memblock_allocHW(int headersize, int packetsize) {
 			t=sgIP_memblock_getunused();
 			if(!t) { // we're skrewed.
 				sgIP_memblock_free(mb);
+				memblock_stats.failed++;
+				SGIP_INTR_UNPROTECT();
 				return 0;
 			}
+			memblock_stats.allocs++;
+			if(++memblock_stats.inuse>memblock_stats.peakinuse) memblock_stats.peakinuse=memblock_stats.inuse;
 			tmb->next=t;
 			t->totallength=tmb->totallength;
 			t->datastart=t->reserved; // no header on blocks after the first.
 			t->next=0;
+			t->refcount=1;
+			t->nextpacket=0;
 			t->thislength=SGIP_MEMBLOCK_INTERNALSIZE;
 			if(t->thislength+totlen>=mb->totallength) {
 				t->thislength=mb->totallength-totlen;
 //				SGIP_DEBUG_MESSAGE(("memblock_alloc: %i free, %i used",numfree,numused));
+				SGIP_MEMBLOCK_TIMEEND(memblock_stats.allocticks);
+				SGIP_INTR_UNPROTECT();
 				return mb;
 			} else { // need YET more blocks.
 				totlen+=t->thislength;
@@ -131,6 +335,7 @@ sgIP_memblock * sgIP_memblock_allocHW(int headersize, int packetsize) {
 		}
 		sgIP_memblock_free(mb); // should never get here.
 	}
+	SGIP_INTR_UNPROTECT();
 	return 0;
 }
 #endif //SGIP_MEMBLOCK_DYNAMIC_MALLOC_ALL
@@ -145,14 +350,23 @@ void sgIP_memblock_free(sgIP_memblock * mb) {
    sgIP_memblock * f;
 
    SGIP_INTR_PROTECT();
+   SGIP_MEMBLOCK_TIMESTART();
    while(mb) {
+      if(mb->refcount>1) { mb->refcount--; break; } // still held elsewhere, along with the rest of the chain
       mb->totallength=0;
       mb->thislength=0;
       f=mb;
       mb = mb->next;
 
+      memblock_stats.frees++;
+      memblock_stats.inuse--;
+#ifdef SGIP_MEMBLOCK_SLABS
+      sgIP_memslab_free(f);
+#else
       sgIP_free(f);
+#endif
    }
+   SGIP_MEMBLOCK_TIMEEND(memblock_stats.freeticks);
 
    SGIP_INTR_UNPROTECT();
 }
@@ -163,17 +377,22 @@ void sgIP_memblock_free(sgIP_memblock * mb) {
 	sgIP_memblock * f;
 
 	SGIP_INTR_PROTECT();
+	SGIP_MEMBLOCK_TIMESTART();
 	while(mb) {
+		if(mb->refcount>1) { mb->refcount--; break; } // still held elsewhere, along with the rest of the chain
 		mb->totallength=0;
 		mb->thislength=0;
 		f=mb;
 		mb = mb->next;
 
+		memblock_stats.frees++;
+		memblock_stats.inuse--;
 		numfree++; // reinstate memblock into the pool!
 		numused--;
 		f->next=memblock_poolfree;
 		memblock_poolfree=f;
 	}
+	SGIP_MEMBLOCK_TIMEEND(memblock_stats.freeticks);
 //	SGIP_DEBUG_MESSAGE(("memblock_free: %i free, %i used",numfree,numused));
 
 	SGIP_INTR_UNPROTECT();
@@ -182,13 +401,29 @@ void sgIP_memblock_free(sgIP_memblock * mb) {
 
 #endif //SGIP_MEMBLOCK_DYNAMIC_MALLOC_ALL
 
+void sgIP_memblock_GetStats(sgIP_memblock_Stats * stats) {
+	if(!stats) return;
+	SGIP_INTR_PROTECT();
+	*stats=memblock_stats;
+	SGIP_INTR_UNPROTECT();
+}
+
+// take another hold on a block (and whatever is chained after it), to be let go with sgIP_memblock_free.
+//  a held block can be chained behind a new header and sent again without copying its data.
+void sgIP_memblock_addref(sgIP_memblock * mb) {
+	if(!mb) return;
+	SGIP_INTR_PROTECT();
+	mb->refcount++;
+	SGIP_INTR_UNPROTECT();
+}
+
 // positive to expose, negative to hide.
 void sgIP_memblock_exposeheader(sgIP_memblock * mb, int change) {
 	if(mb) {
 		mb->thislength+=change;
 		mb->totallength+=change;
 		mb->datastart-=change;
-		while(mb->next) {
+		while(mb->next && mb->next->refcount==1) { // blocks shared with another packet keep their own lengths
 			mb->next->totallength=mb->totallength;
 			mb=mb->next;
 		}
@@ -212,53 +447,164 @@ void sgIP_memblock_trimsize(sgIP_memblock * mb, int newsize) {
 }
 
 
-int sgIP_memblock_IPChecksum(sgIP_memblock * mb, int startbyte, int chksum_length) {
-	int chksum_temp,offset;
-	// check checksum
-	chksum_temp=0;
-	offset=0;
-	while(mb && startbyte>mb->thislength) { startbyte-=mb->thislength; mb=mb->next; }
-	if(!mb) return 0;
-	while(chksum_length) {
-		while(startbyte+offset+1<mb->thislength && chksum_length>1) {
-			chksum_temp+= ((unsigned char *)mb->datastart)[startbyte+offset] + (((unsigned char *)mb->datastart)[startbyte+offset+1]<<8);
-			offset+=2;
-			chksum_length-=2;
+// one's complement sum of a buffer, as little-endian 16bit words with the first byte in the low half
+//  (folded to 16 bits, not inverted).  Sums aligned 32bit words (uint32_t rather than long, which is
+//  wider on a 64bit host) and leaves the carries in the top bits until the end; a buffer at an odd
+//  address is summed one byte out of step and swapped back.
+unsigned long sgIP_memblock_ChecksumBuf(const void * buf, int length) {
+	const unsigned char * p = (const unsigned char *)buf;
+	uint32_t sum, w;
+	int swapped;
+	sum=0;
+	swapped=0;
+	if(length<=0) return 0;
+	if(((uintptr_t)p)&1) {
+		sum=(*p++)<<8;
+		length--;
+		swapped=1;
+	}
+	if((((uintptr_t)p)&2) && length>=2) {
+		sum+=*(const unsigned short *)p;
+		p+=2;
+		length-=2;
+	}
+	while(length>=16) {
+		w=((const uint32_t *)p)[0]; sum+=w; if(sum<w) sum++;
+		w=((const uint32_t *)p)[1]; sum+=w; if(sum<w) sum++;
+		w=((const uint32_t *)p)[2]; sum+=w; if(sum<w) sum++;
+		w=((const uint32_t *)p)[3]; sum+=w; if(sum<w) sum++;
+		p+=16;
+		length-=16;
+	}
+	while(length>=4) {
+		w=*(const uint32_t *)p; sum+=w; if(sum<w) sum++;
+		p+=4;
+		length-=4;
+	}
+	sum=(sum&0xFFFF)+(sum>>16);
+	if(length>=2) {
+		sum+=*(const unsigned short *)p;
+		p+=2;
+		length-=2;
+	}
+	if(length) sum+=*p;
+	sum=(sum&0xFFFF)+(sum>>16);
+	sum=(sum&0xFFFF)+(sum>>16);
+	if(swapped) sum=((sum&0xFF)<<8)|(sum>>8);
+	return sum;
+}
+
+// copy length bytes and return ChecksumBuf's sum of them, reading each byte once.  when dest and src
+//  aren't both at odd or both at even addresses there's no aligned way to do that, so it's a memcpy
+//  and then a sum of dest (still in the cache).
+unsigned long sgIP_memblock_CopyChecksumBuf(void * dest, const void * src, int length) {
+	unsigned char * d = (unsigned char *)dest;
+	const unsigned char * s = (const unsigned char *)src;
+	uint32_t sum, w;
+	int swapped;
+	if(length<=0) return 0;
+	if((((uintptr_t)d)^((uintptr_t)s))&1) {
+		memcpy(dest,src,length);
+		return sgIP_memblock_ChecksumBuf(dest,length);
+	}
+	sum=0;
+	swapped=0;
+	if(((uintptr_t)d)&1) {
+		*d=*s++;
+		sum=(*d++)<<8;
+		length--;
+		swapped=1;
+	}
+	if((((uintptr_t)d)^((uintptr_t)s))&2) { // only halfwords line up
+		while(length>=2) {
+			w=*(const unsigned short *)s;
+			*(unsigned short *)d=w;
+			sum+=w;
+			d+=2; s+=2;
+			length-=2;
 		}
-        chksum_temp= (chksum_temp&0xFFFF) +(chksum_temp>>16);
-		if(startbyte+offset<mb->thislength && chksum_length>0) {
-			chksum_temp+= ((unsigned char *)mb->datastart)[startbyte+offset];
-			if(chksum_length==1) break;
-			chksum_length--;
-			offset=0;
-			startbyte=0;
-			mb=mb->next;
-			if(!mb) break;
-			if(mb->thislength==0) break;
-			chksum_temp+= ((unsigned char *)mb->datastart)[startbyte+offset]<<8;
-			if(chksum_length==1) break;
-			offset++;
-			chksum_length--;
+	} else {
+		if((((uintptr_t)d)&2) && length>=2) {
+			w=*(const unsigned short *)s;
+			*(unsigned short *)d=w;
+			sum+=w;
+			d+=2; s+=2;
+			length-=2;
 		}
-        else
-        {
-			offset=0;
-			startbyte=0;
-			mb=mb->next;
-			if(!mb) break;
-        }
+		while(length>=16) {
+			w=((const uint32_t *)s)[0]; ((uint32_t *)d)[0]=w; sum+=w; if(sum<w) sum++;
+			w=((const uint32_t *)s)[1]; ((uint32_t *)d)[1]=w; sum+=w; if(sum<w) sum++;
+			w=((const uint32_t *)s)[2]; ((uint32_t *)d)[2]=w; sum+=w; if(sum<w) sum++;
+			w=((const uint32_t *)s)[3]; ((uint32_t *)d)[3]=w; sum+=w; if(sum<w) sum++;
+			d+=16; s+=16;
+			length-=16;
+		}
+		while(length>=4) {
+			w=*(const uint32_t *)s; *(uint32_t *)d=w; sum+=w; if(sum<w) sum++;
+			d+=4; s+=4;
+			length-=4;
+		}
+		sum=(sum&0xFFFF)+(sum>>16);
+		if(length>=2) {
+			w=*(const unsigned short *)s;
+			*(unsigned short *)d=w;
+			sum+=w;
+			d+=2; s+=2;
+			length-=2;
+		}
+	}
+	if(length) {
+		*d=*s;
+		sum+=*d;
 	}
-    chksum_temp= (chksum_temp&0xFFFF) +(chksum_temp>>16);
-    chksum_temp= (chksum_temp&0xFFFF) +(chksum_temp>>16);
+	sum=(sum&0xFFFF)+(sum>>16);
+	sum=(sum&0xFFFF)+(sum>>16);
+	if(swapped) sum=((sum&0xFF)<<8)|(sum>>8);
+	return sum;
+}
+
+// RFC 1624: the checksum of a header after one 16bit word in it has changed from oldword to newword
+//  (all three as they sit in memory).  0 comes out as 0xFFFF, which is the only right answer when
+//  everything summed is now zero and as good as 0 otherwise.
+unsigned short sgIP_memblock_ChecksumAdjust(unsigned short checksum, unsigned short oldword, unsigned short newword) {
+	unsigned long sum;
+	sum=(~checksum&0xFFFF)+(~oldword&0xFFFF)+newword;
+	sum=(sum&0xFFFF)+(sum>>16);
+	sum=(sum&0xFFFF)+(sum>>16);
+	sum=~sum&0xFFFF;
+	if(sum==0) sum=0xFFFF;
+	return sum;
+}
+
+int sgIP_memblock_IPChecksum(sgIP_memblock * mb, int startbyte, int chksum_length) {
+	unsigned long chksum_temp, blocksum;
+	int n, odd;
+	chksum_temp=0;
+	odd=0;
+	while(mb && startbyte>=mb->thislength) { startbyte-=mb->thislength; mb=mb->next; }
+	while(mb && chksum_length>0) {
+		n=mb->thislength-startbyte;
+		if(n>chksum_length) n=chksum_length;
+		blocksum=sgIP_memblock_ChecksumBuf(((unsigned char *)mb->datastart)+startbyte,n);
+		if(odd) blocksum=((blocksum&0xFF)<<8)|(blocksum>>8); // this block started on the high byte of a word
+		chksum_temp+=blocksum;
+		odd^=n&1;
+		chksum_length-=n;
+		startbyte=0;
+		mb=mb->next;
+	}
+	chksum_temp= (chksum_temp&0xFFFF) +(chksum_temp>>16);
+	chksum_temp= (chksum_temp&0xFFFF) +(chksum_temp>>16);
 	return chksum_temp;
 }
 int sgIP_memblock_CopyToLinear(sgIP_memblock * mb, void * dest_buf, int startbyte, int copy_length) {
 	int copylen,ofs_src, tot_copy;
+	if(!mb) return 0;
+	if(startbyte+copy_length>mb->totallength) copy_length=mb->totallength-startbyte; // (only the first block's length is kept up to date)
+	if(copy_length<0) copy_length=0;
 	ofs_src=startbyte;
 	while(mb && ofs_src>=mb->thislength) { ofs_src-=mb->thislength; mb=mb->next; }
 	if(!mb) return 0;
-	if(startbyte+copy_length>mb->totallength) copy_length=mb->totallength-startbyte;
-	if(copy_length<0) copy_length=0;
 	tot_copy=0;
 	while(copy_length>0) {
 		copylen=copy_length;
@@ -272,13 +618,66 @@ int sgIP_memblock_CopyToLinear(sgIP_memblock * mb, void * dest_buf, int startbyt
 	}
 	return tot_copy;
 }
+// CopyToLinear that also adds the checksum of what it copies (unfolded, placed by startbyte) into *chksum
+int sgIP_memblock_CopyToLinearChecksum(sgIP_memblock * mb, void * dest_buf, int startbyte, int copy_length, unsigned long * chksum) {
+	int copylen,ofs_src, tot_copy, odd;
+	unsigned long blocksum;
+	if(!mb) return 0;
+	if(startbyte+copy_length>mb->totallength) copy_length=mb->totallength-startbyte; // (only the first block's length is kept up to date)
+	if(copy_length<0) copy_length=0;
+	odd=startbyte&1;
+	ofs_src=startbyte;
+	while(mb && ofs_src>=mb->thislength) { ofs_src-=mb->thislength; mb=mb->next; }
+	if(!mb) return 0;
+	tot_copy=0;
+	while(copy_length>0) {
+		copylen=copy_length;
+		if(copylen>mb->thislength-ofs_src) copylen=mb->thislength-ofs_src;
+		blocksum=sgIP_memblock_CopyChecksumBuf(((char *)dest_buf)+tot_copy,mb->datastart+ofs_src,copylen);
+		if(odd) blocksum=((blocksum&0xFF)<<8)|(blocksum>>8);
+		*chksum+=blocksum;
+		odd^=copylen&1;
+		copy_length-=copylen;
+		tot_copy+=copylen;
+		ofs_src=0;
+		mb=mb->next;
+		if(!mb) break;
+	}
+	return tot_copy;
+}
+// the index'th contiguous piece of the packet's data from startbyte on, in place: its length, and
+//  where it is in *data.  0 once index is past the end.
+int sgIP_memblock_GetSpan(sgIP_memblock * mb, int startbyte, int index, const char ** data) {
+	int len,ofs_src,remaining;
+	if(!mb) return 0;
+	remaining=mb->totallength-startbyte; // (only the first block's length is kept up to date)
+	ofs_src=startbyte;
+	while(mb && remaining>0) {
+		len=mb->thislength-ofs_src;
+		if(len>remaining) len=remaining;
+		if(len>0) {
+			if(!index) {
+				if(data) *data=mb->datastart+ofs_src;
+				return len;
+			}
+			index--;
+			remaining-=len;
+			ofs_src=0;
+		} else {
+			ofs_src=-len;
+		}
+		mb=mb->next;
+	}
+	return 0;
+}
 int sgIP_memblock_CopyFromLinear(sgIP_memblock * mb, void * src_buf, int startbyte, int copy_length) {
 	int copylen,ofs_src, tot_copy;
+	if(!mb) return 0;
+	if(startbyte+copy_length>mb->totallength) copy_length=mb->totallength-startbyte; // (only the first block's length is kept up to date)
+	if(copy_length<0) copy_length=0;
 	ofs_src=startbyte;
 	while(mb && ofs_src>=mb->thislength) { ofs_src-=mb->thislength; mb=mb->next; }
 	if(!mb) return 0;
-	if(startbyte+copy_length>mb->totallength) copy_length=mb->totallength-startbyte;
-	if(copy_length<0) copy_length=0;
 	tot_copy=0;
 	while(copy_length>0) {
 		copylen=copy_length;
@@ -293,8 +692,89 @@ int sgIP_memblock_CopyFromLinear(sgIP_memblock * mb, void * src_buf, int startby
 	return tot_copy;
 
 }
+// CopyFromLinear, adding the checksum of the bytes copied into *chksum (as IPChecksum from the start
+//  of mb would count them, so the sums of several pieces and the header can just be added up)
+int sgIP_memblock_CopyFromLinearChecksum(sgIP_memblock * mb, void * src_buf, int startbyte, int copy_length, unsigned long * chksum) {
+	int copylen,ofs_src, tot_copy, odd;
+	unsigned long blocksum;
+	if(!mb) return 0;
+	if(startbyte+copy_length>mb->totallength) copy_length=mb->totallength-startbyte;
+	if(copy_length<0) copy_length=0;
+	odd=startbyte&1;
+	ofs_src=startbyte;
+	while(mb && ofs_src>=mb->thislength) { ofs_src-=mb->thislength; mb=mb->next; }
+	if(!mb) return 0;
+	tot_copy=0;
+	while(copy_length>0) {
+		copylen=copy_length;
+		if(copylen>mb->thislength-ofs_src) copylen=mb->thislength-ofs_src;
+		blocksum=sgIP_memblock_CopyChecksumBuf(mb->datastart+ofs_src,((char *)src_buf)+tot_copy,copylen);
+		if(odd) blocksum=((blocksum&0xFF)<<8)|(blocksum>>8);
+		*chksum+=blocksum;
+		odd^=copylen&1;
+		copy_length-=copylen;
+		tot_copy+=copylen;
+		ofs_src=0;
+		mb=mb->next;
+		if(!mb) break;
+	}
+	return tot_copy;
+}
 int sgIP_memblock_CopyBlock(sgIP_memblock * mb_src, sgIP_memblock * mb_dest, int start_src, int start_dest, int copy_length) {
+	int copylen, tot_copy;
+	if(!mb_src || !mb_dest) return 0;
+	if(start_src+copy_length>mb_src->totallength) copy_length=mb_src->totallength-start_src;
+	if(start_dest+copy_length>mb_dest->totallength) copy_length=mb_dest->totallength-start_dest;
+	while(mb_src && start_src>=mb_src->thislength) { start_src-=mb_src->thislength; mb_src=mb_src->next; }
+	while(mb_dest && start_dest>=mb_dest->thislength) { start_dest-=mb_dest->thislength; mb_dest=mb_dest->next; }
+	tot_copy=0;
+	while(copy_length>0 && mb_src && mb_dest) {
+		copylen=copy_length;
+		if(copylen>mb_src->thislength-start_src) copylen=mb_src->thislength-start_src;
+		if(copylen>mb_dest->thislength-start_dest) copylen=mb_dest->thislength-start_dest;
+		memcpy(mb_dest->datastart+start_dest,mb_src->datastart+start_src,copylen);
+		copy_length-=copylen;
+		tot_copy+=copylen;
+		start_src+=copylen;
+		start_dest+=copylen;
+		if(start_src>=mb_src->thislength) { start_src=0; mb_src=mb_src->next; }
+		if(start_dest>=mb_dest->thislength) { start_dest=0; mb_dest=mb_dest->next; }
+	}
+	return tot_copy;
+}
 
-	return 0;
+// link tail (and whatever is chained after it) onto the end of mb's data, handing over the
+//  caller's hold on it.  tail may be shared with other packets; it isn't written to.
+void sgIP_memblock_append(sgIP_memblock * mb, sgIP_memblock * tail) {
+	int totlen;
+	if(!mb || !tail) return;
+	totlen=mb->totallength+tail->totallength;
+	while(mb->next) {
+		mb->totallength=totlen;
+		mb=mb->next;
+	}
+	mb->totallength=totlen;
+	mb->next=tail;
+}
+// a new block of headersize bytes (with the usual hardware header room in front of it) with
+//  payload chained behind it.  returns the new packet, or 0 if out of memory - payload is then
+//  left as it was, and still the caller's.
+sgIP_memblock * sgIP_memblock_prepend(sgIP_memblock * payload, int headersize) {
+	sgIP_memblock * mb;
+	mb=sgIP_memblock_alloc(headersize);
+	if(!mb) return 0;
+	sgIP_memblock_append(mb,payload);
+	return mb;
+}
+// another packet with the same data as mb, without copying any of it: an empty block chained
+//  in front of a new hold on mb.  the data is shared from then on, so it should be left alone;
+//  headers can still be added to the front of either packet.
+sgIP_memblock * sgIP_memblock_clone(sgIP_memblock * mb) {
+	sgIP_memblock * c;
+	if(!mb) return 0;
+	sgIP_memblock_addref(mb);
+	c=sgIP_memblock_prepend(mb,0);
+	if(!c) sgIP_memblock_free(mb);
+	return c;
 }
 
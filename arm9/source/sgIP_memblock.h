@@ -29,18 +29,45 @@ SOFTWARE.
 
 #include "sgIP_Config.h"
 
+#ifndef SGIP_MEMBLOCK_DYNAMIC_MALLOC_ALL
+#undef SGIP_MEMBLOCK_SLABS // (the fixed pool is used instead)
+#endif
+
 
 typedef struct SGIP_MEMBLOCK {
 	int totallength;
 	int thislength;
 	struct SGIP_MEMBLOCK * next;
 	char * datastart;
-	char reserved[SGIP_MEMBLOCK_DATASIZE-16]; // assume the other 4 values are 16 bytes total in length.
+	int refcount; // holders of this block; sgIP_memblock_free only releases it when the last one lets go
+	struct SGIP_MEMBLOCK * nextpacket; // link for queues of whole packets (not part of this packet's data)
+	char reserved[SGIP_MEMBLOCK_DATASIZE-24]; // assume the other 6 values are 24 bytes total in length.
 } sgIP_memblock;
 
-#define SGIP_MEMBLOCK_HEADERSIZE 16
-#define SGIP_MEMBLOCK_INTERNALSIZE (SGIP_MEMBLOCK_DATASIZE-16)
-#define SGIP_MEMBLOCK_FIRSTINTERNALSIZE (SGIP_MEMBLOCK_DATASIZE-16-SGIP_MAXHWHEADER)
+#ifdef SGIP_MEMBLOCK_SLABS
+#define SGIP_MEMSLAB_NUMCLASSES 3
+
+typedef struct SGIP_MEMSLAB {
+	struct SGIP_MEMSLAB * next; // the other slabs of the same size class
+	sgIP_memblock * freelist; // linked by next
+	int numfree;
+	int sizeclass;
+} sgIP_memslab;
+#endif
+
+typedef struct SGIP_MEMBLOCK_STATS {
+	unsigned long allocs, frees; // memblocks allocated and freed
+	unsigned long heapallocs; // calls to sgIP_malloc made for them (all of them, unless slabs/the pool are in use)
+	unsigned long failed; // allocations that found no memory
+	unsigned long slabsgrown, slabsreleased;
+	int inuse, peakinuse; // memblocks
+	int bytesheld; // heap held by slabs or the pool, used or not
+	unsigned long allocticks, freeticks; // time spent in alloc/free, if SGIP_MEMBLOCK_TICKS is defined
+} sgIP_memblock_Stats;
+
+#define SGIP_MEMBLOCK_HEADERSIZE 24
+#define SGIP_MEMBLOCK_INTERNALSIZE (SGIP_MEMBLOCK_DATASIZE-24)
+#define SGIP_MEMBLOCK_FIRSTINTERNALSIZE (SGIP_MEMBLOCK_DATASIZE-24-SGIP_MAXHWHEADER)
 
 #ifdef __cplusplus
 extern "C" {
@@ -50,13 +77,24 @@ extern "C" {
 	extern sgIP_memblock * sgIP_memblock_alloc(int packetsize);
 	extern sgIP_memblock * sgIP_memblock_allocHW(int headersize, int packetsize);
 	extern void sgIP_memblock_free(sgIP_memblock * mb);
+	extern void sgIP_memblock_addref(sgIP_memblock * mb);
+	extern void sgIP_memblock_GetStats(sgIP_memblock_Stats * stats);
 	extern void sgIP_memblock_exposeheader(sgIP_memblock * mb, int change);
 	extern void sgIP_memblock_trimsize(sgIP_memblock * mb, int newsize);
 
+	extern unsigned long sgIP_memblock_ChecksumBuf(const void * buf, int length);
+	extern unsigned long sgIP_memblock_CopyChecksumBuf(void * dest, const void * src, int length);
+	extern unsigned short sgIP_memblock_ChecksumAdjust(unsigned short checksum, unsigned short oldword, unsigned short newword);
 	extern int sgIP_memblock_IPChecksum(sgIP_memblock * mb, int startbyte, int chksum_length);
 	extern int sgIP_memblock_CopyToLinear(sgIP_memblock * mb, void * dest_buf, int startbyte, int copy_length);
+	extern int sgIP_memblock_CopyToLinearChecksum(sgIP_memblock * mb, void * dest_buf, int startbyte, int copy_length, unsigned long * chksum);
+	extern int sgIP_memblock_GetSpan(sgIP_memblock * mb, int startbyte, int index, const char ** data);
 	extern int sgIP_memblock_CopyFromLinear(sgIP_memblock * mb, void * src_buf, int startbyte, int copy_length);
+	extern int sgIP_memblock_CopyFromLinearChecksum(sgIP_memblock * mb, void * src_buf, int startbyte, int copy_length, unsigned long * chksum);
 	extern int sgIP_memblock_CopyBlock(sgIP_memblock * mb_src, sgIP_memblock * mb_dest, int start_src, int start_dest, int copy_length);
+	extern void sgIP_memblock_append(sgIP_memblock * mb, sgIP_memblock * tail);
+	extern sgIP_memblock * sgIP_memblock_prepend(sgIP_memblock * payload, int headersize);
+	extern sgIP_memblock * sgIP_memblock_clone(sgIP_memblock * mb);
 #ifdef __cplusplus
 };
 #endif
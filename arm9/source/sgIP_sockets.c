@@ -24,10 +24,13 @@ SOFTWARE.
 ******************************************************************************/
 
 #include "sgIP_sockets.h"
+#include "sgIP_Hub.h"
 #include "sgIP_TCP.h"
 #include "sgIP_UDP.h"
 #include "sgIP_ICMP.h"
 #include "sgIP_DNS.h"
+#include "netinet/tcp.h"
+#include <string.h>
 
 
 sgIP_socket_data socketlist[SGIP_SOCKET_MAXSOCKETS];
@@ -203,8 +206,7 @@ int connect(int socket, const struct sockaddr * addr, int addr_len) {
 			if(i==SGIP_TCP_STATE_CLOSED || i==SGIP_TCP_STATE_UNUSED || i==SGIP_TCP_STATE_LISTEN || i==SGIP_TCP_STATE_NODATA) 
 			{	retval=SGIP_ERROR(((sgIP_Record_TCP *)socketlist[socket].conn_ptr)->errorcode); break; }
 			if(socketlist[socket].flags&SGIP_SOCKET_FLAG_NONBLOCKING) {
-				retval = -1;
-				SGIP_ERROR(EINPROGRESS);
+				retval=SGIP_ERROR(EINPROGRESS);
 				break;
 			}
 			SGIP_INTR_UNPROTECT();
@@ -295,6 +297,119 @@ int recvfrom(int socket, void * data, int recvlength, int flags, struct sockaddr
 	SGIP_INTR_UNPROTECT();
 	return retval;
 }
+// udp only: zero-copy recvfrom.  the datagram is handed over in place rather than copied out; read
+//  it with dgram_getspan() and give it back with dgram_release().  returns the payload length.
+int recvfrom_zc(int socket, dgram_t * dgram, int flags, struct sockaddr * addr, int * addr_len) {
+	if(socket<1 || socket>SGIP_SOCKET_MAXSOCKETS) return -1;
+	if(!dgram) return SGIP_ERROR(EFAULT);
+	SGIP_INTR_PROTECT();
+	int retval=SGIP_ERROR(EINVAL);
+	unsigned long srcip;
+	unsigned short srcport;
+	sgIP_memblock * mb;
+	socket--;
+	*dgram=0;
+	if(!(socketlist[socket].flags&SGIP_SOCKET_FLAG_VALID)) { SGIP_INTR_UNPROTECT(); return SGIP_ERROR(EINVAL); }
+	if((socketlist[socket].flags&SGIP_SOCKET_FLAG_TYPEMASK)==SGIP_SOCKET_FLAG_TYPE_UDP) {
+		do {
+			mb=sgIP_UDP_RecvPacket((sgIP_Record_UDP *)socketlist[socket].conn_ptr,&srcip,&srcport);
+			if(mb) break;
+			if(errno!=EWOULDBLOCK) break;
+			if(socketlist[socket].flags&SGIP_SOCKET_FLAG_NONBLOCKING) break;
+			SGIP_INTR_UNPROTECT(); // give interrupts a chance to occur.
+			SGIP_WAITEVENT(); // don't just try again immediately
+			SGIP_INTR_REPROTECT();
+		} while(1);
+		if(mb) {
+			*dgram=mb;
+			retval=mb->totallength-SGIP_UDP_PAYLOADOFFSET;
+			if(addr && addr_len && *addr_len>=sizeof(struct sockaddr_in)) {
+				((struct sockaddr_in *)addr)->sin_family=AF_INET;
+				((struct sockaddr_in *)addr)->sin_addr.s_addr=srcip;
+				((struct sockaddr_in *)addr)->sin_port=srcport;
+				*addr_len=sizeof(struct sockaddr_in);
+			}
+		} else retval=-1;
+	}
+	SGIP_INTR_UNPROTECT();
+	return retval;
+}
+// the index'th contiguous piece of a datagram from recvfrom_zc: its length, with *data pointing at it
+//  (read only).  0 once index is past the end.
+int dgram_getspan(dgram_t dgram, int index, const void ** data) {
+	if(!dgram || index<0) return 0;
+	return sgIP_memblock_GetSpan((sgIP_memblock *)dgram,SGIP_UDP_PAYLOADOFFSET,index,(const char **)data);
+}
+void dgram_release(dgram_t dgram) {
+	sgIP_memblock_free((sgIP_memblock *)dgram);
+}
+// udp only: send up to count datagrams in one go; the frames are handed to the hardware as one
+//  transmit batch.  returns the number sent; an error only if the first one couldn't be.
+int sendmmsg(int socket, struct mmsghdr * msgs, unsigned int count, int flags) {
+	if(socket<1 || socket>SGIP_SOCKET_MAXSOCKETS) return -1;
+	if(!msgs) return SGIP_ERROR(EFAULT);
+	SGIP_INTR_PROTECT();
+	int retval=SGIP_ERROR(EINVAL);
+	unsigned int i;
+	sgIP_Record_UDP * rec;
+	socket--;
+	if(!(socketlist[socket].flags&SGIP_SOCKET_FLAG_VALID)) { SGIP_INTR_UNPROTECT(); return SGIP_ERROR(EINVAL); }
+	if((socketlist[socket].flags&SGIP_SOCKET_FLAG_TYPEMASK)==SGIP_SOCKET_FLAG_TYPE_UDP) {
+		rec=(sgIP_Record_UDP *)socketlist[socket].conn_ptr;
+		sgIP_Hub_TxBatchStart();
+		for(i=0;i<count;i++) {
+			if(!msgs[i].msg_addr) retval=SGIP_ERROR(EINVAL);
+			else retval=sgIP_UDP_SendTo(rec,msgs[i].msg_data,msgs[i].msg_datalen,flags,((struct sockaddr_in *)msgs[i].msg_addr)->sin_addr.s_addr,((struct sockaddr_in *)msgs[i].msg_addr)->sin_port);
+			if(retval<0) break;
+			msgs[i].msg_len=retval;
+		}
+		sgIP_Hub_TxBatchEnd();
+		if(i>0) retval=i;
+	}
+	SGIP_INTR_UNPROTECT();
+	return retval;
+}
+// udp only: receive up to count datagrams; blocks (unless nonblocking) for the first one only, then
+//  takes whatever else is already queued.  returns the number received; an error only if none were.
+int recvmmsg(int socket, struct mmsghdr * msgs, unsigned int count, int flags) {
+	if(socket<1 || socket>SGIP_SOCKET_MAXSOCKETS) return -1;
+	if(!msgs) return SGIP_ERROR(EFAULT);
+	SGIP_INTR_PROTECT();
+	int retval=SGIP_ERROR(EINVAL);
+	unsigned int i;
+	unsigned long srcip;
+	unsigned short srcport;
+	sgIP_Record_UDP * rec;
+	struct sockaddr_in * sain;
+	socket--;
+	if(!(socketlist[socket].flags&SGIP_SOCKET_FLAG_VALID)) { SGIP_INTR_UNPROTECT(); return SGIP_ERROR(EINVAL); }
+	if((socketlist[socket].flags&SGIP_SOCKET_FLAG_TYPEMASK)==SGIP_SOCKET_FLAG_TYPE_UDP) {
+		rec=(sgIP_Record_UDP *)socketlist[socket].conn_ptr;
+		for(i=0;i<count;i++) {
+			do {
+				retval=sgIP_UDP_RecvFrom(rec,msgs[i].msg_data,msgs[i].msg_datalen,flags,&srcip,&srcport);
+				if(retval!=-1 || i>0) break;
+				if(errno!=EWOULDBLOCK) break;
+				if(socketlist[socket].flags&SGIP_SOCKET_FLAG_NONBLOCKING) break;
+				SGIP_INTR_UNPROTECT(); // give interrupts a chance to occur.
+				SGIP_WAITEVENT(); // don't just try again immediately
+				SGIP_INTR_REPROTECT();
+			} while(1);
+			if(retval<0) break;
+			msgs[i].msg_len=retval;
+			if(msgs[i].msg_addr && msgs[i].msg_addrlen>=sizeof(struct sockaddr_in)) {
+				sain=(struct sockaddr_in *)msgs[i].msg_addr;
+				sain->sin_family=AF_INET;
+				sain->sin_addr.s_addr=srcip;
+				sain->sin_port=srcport;
+				msgs[i].msg_addrlen=sizeof(struct sockaddr_in);
+			}
+		}
+		if(i>0) retval=i;
+	}
+	SGIP_INTR_UNPROTECT();
+	return retval;
+}
 int listen(int socket, int max_connections) {
    if(socket<1 || socket>SGIP_SOCKET_MAXSOCKETS) return SGIP_ERROR(EINVAL);
    SGIP_INTR_PROTECT();
@@ -378,15 +493,13 @@ int ioctl(int socket, long cmd, void * arg) {
 			retval=SGIP_ERROR(EINVAL);
 		} else {
 			if((socketlist[socket].flags&SGIP_SOCKET_FLAG_TYPEMASK)==SGIP_SOCKET_FLAG_TYPE_TCP) {
-				i=((sgIP_Record_TCP *)socketlist[socket].conn_ptr)->buf_rx_out-((sgIP_Record_TCP *)socketlist[socket].conn_ptr)->buf_rx_in;
-				if(i<0) i+=SGIP_TCP_RECEIVEBUFFERLENGTH;
-				*((int *)arg)=i;
+				*((int *)arg)=sgIP_Ring_Used(&((sgIP_Record_TCP *)socketlist[socket].conn_ptr)->rx);
 			} else if((socketlist[socket].flags&SGIP_SOCKET_FLAG_TYPEMASK)==SGIP_SOCKET_FLAG_TYPE_UDP) {
 				sgIP_Record_UDP *rec = (sgIP_Record_UDP *)socketlist[socket].conn_ptr;
 				if(rec->incoming_queue == 0) {
 					*((int *)arg)=0;
 				} else {
-					i = rec->incoming_queue->totallength-12;
+					i = rec->incoming_queue->totallength-SGIP_UDP_PAYLOADOFFSET;
 					*((int *)arg) = i;
 				}
 			} else {
@@ -401,9 +514,98 @@ int ioctl(int socket, long cmd, void * arg) {
 }
 
 int setsockopt(int socket, int level, int option_name, const void * data, int data_len) {
+	if(socket<1 || socket>SGIP_SOCKET_MAXSOCKETS) return SGIP_ERROR(EBADF);
+	if(level==SOL_SOCKET && (option_name==SO_RCVBUF || option_name==SO_SNDBUF)) {
+		int size;
+		if(!data) return SGIP_ERROR(EFAULT);
+		if(data_len<sizeof(int)) return SGIP_ERROR(EINVAL);
+		socket--;
+		if(!(socketlist[socket].flags&SGIP_SOCKET_FLAG_VALID)) return SGIP_ERROR(EBADF);
+		size=*(const int *)data;
+		if(size<=0) return SGIP_ERROR(EINVAL);
+		if((socketlist[socket].flags&SGIP_SOCKET_FLAG_TYPEMASK)==SGIP_SOCKET_FLAG_TYPE_UDP) { // udp only has a receive queue to limit
+			if(option_name==SO_RCVBUF) sgIP_UDP_SetBufferSize((sgIP_Record_UDP *)socketlist[socket].conn_ptr,size);
+			return 0;
+		}
+		if((socketlist[socket].flags&SGIP_SOCKET_FLAG_TYPEMASK)!=SGIP_SOCKET_FLAG_TYPE_TCP) return 0;
+		if(option_name==SO_RCVBUF) sgIP_TCP_SetBufferSize((sgIP_Record_TCP *)socketlist[socket].conn_ptr,size,0);
+		else sgIP_TCP_SetBufferSize((sgIP_Record_TCP *)socketlist[socket].conn_ptr,0,size);
+		return 0;
+	}
+	if(level==SOL_SOCKET && option_name==SO_RCVDROPOLDEST) {
+		if(!data) return SGIP_ERROR(EFAULT);
+		if(data_len<sizeof(int)) return SGIP_ERROR(EINVAL);
+		socket--;
+		if(!(socketlist[socket].flags&SGIP_SOCKET_FLAG_VALID)) return SGIP_ERROR(EBADF);
+		if((socketlist[socket].flags&SGIP_SOCKET_FLAG_TYPEMASK)!=SGIP_SOCKET_FLAG_TYPE_UDP) return SGIP_ERROR(ENOPROTOOPT);
+		((sgIP_Record_UDP *)socketlist[socket].conn_ptr)->dropoldest=(*(const int *)data)?1:0;
+		return 0;
+	}
+	if(level==SOL_TCP && (option_name==TCP_NODELAY || option_name==TCP_CORK)) {
+		int on;
+		if(!data) return SGIP_ERROR(EFAULT);
+		if(data_len<sizeof(int)) return SGIP_ERROR(EINVAL);
+		socket--;
+		if(!(socketlist[socket].flags&SGIP_SOCKET_FLAG_VALID)) return SGIP_ERROR(EBADF);
+		if((socketlist[socket].flags&SGIP_SOCKET_FLAG_TYPEMASK)!=SGIP_SOCKET_FLAG_TYPE_TCP) return SGIP_ERROR(ENOPROTOOPT);
+		on=*(const int *)data;
+		if(option_name==TCP_NODELAY) sgIP_TCP_SetNoDelay((sgIP_Record_TCP *)socketlist[socket].conn_ptr,on,-1);
+		else sgIP_TCP_SetNoDelay((sgIP_Record_TCP *)socketlist[socket].conn_ptr,-1,on);
+		return 0;
+	}
    return 0;
 } 
 int getsockopt(int socket, int level, int option_name, void * data, int * data_len) {
+	if(socket<1 || socket>SGIP_SOCKET_MAXSOCKETS) return SGIP_ERROR(EBADF);
+	if(level==SOL_TCP && option_name==TCP_INFO) {
+		struct tcp_info info;
+		if(!data || !data_len || *data_len<0) return SGIP_ERROR(EFAULT);
+		socket--;
+		if(!(socketlist[socket].flags&SGIP_SOCKET_FLAG_VALID)) return SGIP_ERROR(EBADF);
+		if((socketlist[socket].flags&SGIP_SOCKET_FLAG_TYPEMASK)!=SGIP_SOCKET_FLAG_TYPE_TCP) return SGIP_ERROR(ENOPROTOOPT);
+		sgIP_TCP_GetInfo((sgIP_Record_TCP *)socketlist[socket].conn_ptr,&info);
+		if(*data_len>sizeof(info)) *data_len=sizeof(info); // a shorter buffer gets the leading fields
+		memcpy(data,&info,*data_len);
+		return 0;
+	}
+	if(level==SOL_SOCKET && (option_name==SO_RCVBUF || option_name==SO_RCVDROPPED || option_name==SO_RCVDROPOLDEST)
+		&& (socketlist[socket-1].flags&SGIP_SOCKET_FLAG_TYPEMASK)==SGIP_SOCKET_FLAG_TYPE_UDP) {
+		sgIP_Record_UDP * urec;
+		if(!data || !data_len) return SGIP_ERROR(EFAULT);
+		if(*data_len<sizeof(int)) return SGIP_ERROR(EINVAL);
+		socket--;
+		if(!(socketlist[socket].flags&SGIP_SOCKET_FLAG_VALID)) return SGIP_ERROR(EBADF);
+		urec=(sgIP_Record_UDP *)socketlist[socket].conn_ptr;
+		if(option_name==SO_RCVDROPPED) *(int *)data=urec->rx_dropped;
+		else if(option_name==SO_RCVDROPOLDEST) *(int *)data=urec->dropoldest;
+		else *(int *)data=urec->buf_rx_size;
+		*data_len=sizeof(int);
+		return 0;
+	}
+	if(level==SOL_SOCKET && (option_name==SO_RCVBUF || option_name==SO_SNDBUF)) {
+		sgIP_Record_TCP * rec;
+		if(!data || !data_len) return SGIP_ERROR(EFAULT);
+		if(*data_len<sizeof(int)) return SGIP_ERROR(EINVAL);
+		socket--;
+		if(!(socketlist[socket].flags&SGIP_SOCKET_FLAG_VALID)) return SGIP_ERROR(EBADF);
+		if((socketlist[socket].flags&SGIP_SOCKET_FLAG_TYPEMASK)!=SGIP_SOCKET_FLAG_TYPE_TCP) return SGIP_ERROR(ENOPROTOOPT);
+		rec=(sgIP_Record_TCP *)socketlist[socket].conn_ptr;
+		*(int *)data=(option_name==SO_RCVBUF)?rec->buf_rx_want:rec->buf_tx_want;
+		*data_len=sizeof(int);
+		return 0;
+	}
+	if(level==SOL_TCP && (option_name==TCP_NODELAY || option_name==TCP_CORK)) {
+		sgIP_Record_TCP * rec;
+		if(!data || !data_len) return SGIP_ERROR(EFAULT);
+		if(*data_len<sizeof(int)) return SGIP_ERROR(EINVAL);
+		socket--;
+		if(!(socketlist[socket].flags&SGIP_SOCKET_FLAG_VALID)) return SGIP_ERROR(EBADF);
+		if((socketlist[socket].flags&SGIP_SOCKET_FLAG_TYPEMASK)!=SGIP_SOCKET_FLAG_TYPE_TCP) return SGIP_ERROR(ENOPROTOOPT);
+		rec=(sgIP_Record_TCP *)socketlist[socket].conn_ptr;
+		*(int *)data=(option_name==TCP_NODELAY)?rec->nodelay:rec->cork;
+		*data_len=sizeof(int);
+		return 0;
+	}
    return 0;
 }
 
@@ -501,7 +703,7 @@ extern int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *errorfds,
 	SGIP_INTR_PROTECT();
 	nfds=SGIP_SOCKET_MAXSOCKETS;
 
-	int i,j,retval;
+	int i,retval;
 	while(timeout_ms>0) { // check all fd sets
 		// readfds
 		if(readfds) {
@@ -512,7 +714,7 @@ extern int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *errorfds,
 						if(rec->tcpstate==SGIP_TCP_STATE_LISTEN && rec->listendata && rec->listendata[0]){ timeout_ms=0; break; }
 						if(rec->tcpstate==SGIP_TCP_STATE_CLOSED || 
 								(rec->tcpstate == SGIP_TCP_STATE_CLOSE_WAIT && rec->want_shutdown==0)) { timeout_ms=0; break; }
-						if(rec->buf_rx_in!=rec->buf_rx_out) { timeout_ms=0; break; }
+						if(sgIP_Ring_Used(&rec->rx)) { timeout_ms=0; break; }
 					} else if((socketlist[i].flags&SGIP_SOCKET_FLAG_TYPEMASK)==SGIP_SOCKET_FLAG_TYPE_UDP) {
 						urec = (sgIP_Record_UDP *)socketlist[i].conn_ptr;
 						if(urec->incoming_queue) { timeout_ms=0; break;	}
@@ -527,9 +729,7 @@ extern int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *errorfds,
 				if(FD_ISSET(i+1,writefds)) {
 					if((socketlist[i].flags&SGIP_SOCKET_FLAG_TYPEMASK)==SGIP_SOCKET_FLAG_TYPE_TCP) {
 						rec = (sgIP_Record_TCP *)socketlist[i].conn_ptr;
-						j=rec->buf_tx_in-1;
-						if(j<0) j=SGIP_TCP_TRANSMITBUFFERLENGTH-1;
-						if(rec->buf_tx_out!=j) { timeout_ms=0; break; }
+						if(!rec->buf_tx_size || sgIP_TCP_SendSpace(rec)) { timeout_ms=0; break; }
 					}
 				}
 			}
@@ -556,7 +756,7 @@ extern int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *errorfds,
 					if(rec->tcpstate==SGIP_TCP_STATE_LISTEN && rec->listendata && rec->listendata[0]){ retval++; }
 					else if(rec->tcpstate==SGIP_TCP_STATE_CLOSED || 
 							(rec->tcpstate==SGIP_TCP_STATE_CLOSE_WAIT && rec->want_shutdown==0)) { retval++; }
-					else if(rec->buf_rx_in==rec->buf_rx_out) { FD_CLR(i+1,readfds);} 
+					else if(!sgIP_Ring_Used(&rec->rx)) { FD_CLR(i+1,readfds);} 
 					else retval++;
 				} else if((socketlist[i].flags&SGIP_SOCKET_FLAG_TYPEMASK)==SGIP_SOCKET_FLAG_TYPE_UDP) {
 					urec = (sgIP_Record_UDP *)socketlist[i].conn_ptr;
@@ -572,9 +772,7 @@ extern int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *errorfds,
 			if(FD_ISSET(i+1,writefds)) {
 				if((socketlist[i].flags&SGIP_SOCKET_FLAG_TYPEMASK)==SGIP_SOCKET_FLAG_TYPE_TCP) {
 					rec = (sgIP_Record_TCP *)socketlist[i].conn_ptr;
-					j=rec->buf_tx_in-1;
-					if(j<0) j=SGIP_TCP_TRANSMITBUFFERLENGTH-1;
-					if(rec->buf_tx_out==j) { FD_CLR(i+1,writefds); } else retval++;
+					if(rec->buf_tx_size && !sgIP_TCP_SendSpace(rec)) { FD_CLR(i+1,writefds); } else retval++;
 				}
 			}
 		}
@@ -76,15 +76,21 @@ void sgIP_free(void * ptr) __attribute__((weak));
 
 //////////////////////////////////////////////////////////////////////////
 // wifi heap allocator system
+// a two-level segregated fit allocator (after TLSF): free blocks are kept in lists by size, the
+//  first level a power of two and the second splitting that into WHEAP_SL_COUNT steps, with a
+//  bitmap of which lists have anything in them.  alloc and free take the same time however
+//  fragmented the heap is; each block knows the one before it, and free blocks are merged with
+//  their neighbours as soon as they're freed.
 
-#define WHEAP_RECORD_FLAG_INUSE     0
-#define WHEAP_RECORD_FLAG_UNUSED    1
-#define WHEAP_RECORD_FLAG_FREED     2
+#define WHEAP_RECORD_FLAG_FREE      1 // in the low bit of size
 
 typedef struct WHEAP_RECORD {
-    struct WHEAP_RECORD * next;
-    unsigned short flags, unused;
-    int size;
+    struct WHEAP_RECORD * prev; // the block just before this one in memory (0 for the first)
+    int size; // bytes after the header, and WHEAP_RECORD_FLAG_FREE
+#ifdef SGIP_DEBUG
+    int reqsize; // size asked for, to find the padding after it
+#endif
+    struct WHEAP_RECORD * nextfree, * prevfree; // (only while free - this is the start of the data otherwise)
 } wHeapRecord;
 
 #ifdef SGIP_DEBUG
@@ -98,66 +104,135 @@ typedef struct WHEAP_RECORD {
 #define WHEAP_PAD_END       0
 #undef WHEAP_DO_PAD
 #endif
-#define WHEAP_RECORD_SIZE   (sizeof(wHeapRecord))
+#define WHEAP_RECORD_SIZE   (sizeof(wHeapRecord)-2*sizeof(wHeapRecord *))
 #define WHEAP_PAD_SIZE      ((WHEAP_PAD_START)+(WHEAP_PAD_END))
-#define WHEAP_SIZE_CUTOFF   ((WHEAP_RECORD_SIZE)+64)
+#define WHEAP_MIN_SIZE      (2*sizeof(wHeapRecord *)) // room for the free list links
+#define WHEAP_SL_LOG        3
+#define WHEAP_SL_COUNT      (1<<WHEAP_SL_LOG)
+#define WHEAP_FL_SHIFT      (WHEAP_SL_LOG+4) // blocks smaller than this many bits go in 16-byte steps
+#define WHEAP_FL_COUNT      16 // up to 4MB
+#define WHEAP_SIZE(rec)     ((rec)->size&~3)
+#define WHEAP_NEXT(rec)     ((wHeapRecord *)(((char *)(rec))+WHEAP_RECORD_SIZE+WHEAP_SIZE(rec)))
 
 
 int wHeapsize;
 wHeapRecord * wHeapStart; // start of heap
-wHeapRecord * wHeapFirst; // first free block
+unsigned int wHeapFLBitmap; // which first level lists have any free blocks
+unsigned char wHeapSLBitmap[WHEAP_FL_COUNT]; // and which second level ones
+wHeapRecord * wHeapLists[WHEAP_FL_COUNT][WHEAP_SL_COUNT];
+int wHeapUsed, wHeapHighWater, wHeapUsedBlocks;
+u32 wHeapAllocs, wHeapFrees, wHeapFailed;
+
+// the free list for blocks of this size
+void wHeapMapping(int size, int * fl, int * sl) {
+    int f;
+    if(size<(1<<WHEAP_FL_SHIFT)) {
+        *fl=0;
+        *sl=size>>(WHEAP_FL_SHIFT-WHEAP_SL_LOG);
+    } else {
+        f=31-__builtin_clz(size);
+        *fl=f-WHEAP_FL_SHIFT+1;
+        *sl=(size>>(f-WHEAP_SL_LOG))&(WHEAP_SL_COUNT-1);
+    }
+}
+void wHeapInsert(wHeapRecord * rec) {
+    int fl,sl;
+    wHeapMapping(WHEAP_SIZE(rec),&fl,&sl);
+    rec->size=WHEAP_SIZE(rec)|WHEAP_RECORD_FLAG_FREE;
+    rec->prevfree=0;
+    rec->nextfree=wHeapLists[fl][sl];
+    if(rec->nextfree) rec->nextfree->prevfree=rec;
+    wHeapLists[fl][sl]=rec;
+    wHeapFLBitmap|=1<<fl;
+    wHeapSLBitmap[fl]|=1<<sl;
+}
+void wHeapRemove(wHeapRecord * rec) {
+    int fl,sl;
+    wHeapMapping(WHEAP_SIZE(rec),&fl,&sl);
+    if(rec->nextfree) rec->nextfree->prevfree=rec->prevfree;
+    if(rec->prevfree) rec->prevfree->nextfree=rec->nextfree;
+    else {
+        wHeapLists[fl][sl]=rec->nextfree;
+        if(!rec->nextfree) {
+            wHeapSLBitmap[fl]&=~(1<<sl);
+            if(!wHeapSLBitmap[fl]) wHeapFLBitmap&=~(1<<fl);
+        }
+    }
+    rec->size&=~WHEAP_RECORD_FLAG_FREE;
+}
+// a free block of at least size bytes: the first one in the first non-empty list whose blocks
+//  are all big enough.
+wHeapRecord * wHeapFind(int size) {
+    int fl,sl;
+    unsigned int bits;
+    // round up to the next list, unless it's the size at the bottom of its own
+    if(size<(1<<WHEAP_FL_SHIFT)) size+=(1<<(WHEAP_FL_SHIFT-WHEAP_SL_LOG))-1;
+    else size+=(1<<(31-__builtin_clz(size)-WHEAP_SL_LOG))-1;
+    wHeapMapping(size,&fl,&sl);
+    if(fl>=WHEAP_FL_COUNT) return 0;
+    bits=wHeapSLBitmap[fl]&(~0U<<sl);
+    if(!bits) {
+        bits=wHeapFLBitmap&(~0U<<(fl+1));
+        if(!bits) return 0;
+        fl=__builtin_ctz(bits);
+        bits=wHeapSLBitmap[fl];
+    }
+    sl=__builtin_ctz(bits);
+    return wHeapLists[fl][sl];
+}
+
 void wHeapAllocInit(int size) {
+    wHeapRecord * end;
+    int fl;
     wHeapStart=(wHeapRecord *)malloc(size);
     if (!wHeapStart) return;
-    wHeapFirst=wHeapStart;
-    wHeapStart->flags=WHEAP_RECORD_FLAG_UNUSED;
-    wHeapStart->next=0;
-    wHeapStart->size=size-sizeof(wHeapRecord);
+    wHeapsize=size;
+    wHeapFLBitmap=0;
+    for(fl=0;fl<WHEAP_FL_COUNT;fl++) {
+        wHeapSLBitmap[fl]=0;
+        memset(wHeapLists[fl],0,sizeof(wHeapLists[fl]));
+    }
+    wHeapUsed=wHeapHighWater=wHeapUsedBlocks=0;
+    wHeapAllocs=wHeapFrees=wHeapFailed=0;
+    // one free block, and an empty used one at the end so there's always a block after a free one.
+    wHeapStart->prev=0;
+    wHeapStart->size=(size-2*WHEAP_RECORD_SIZE)&~3;
+    end=WHEAP_NEXT(wHeapStart);
+    end->prev=wHeapStart;
+    end->size=0;
+    wHeapInsert(wHeapStart);
 }
 
 
 void * wHeapAlloc(int size) {
-    wHeapRecord * rec = wHeapFirst;
-    void * voidptr;
+    wHeapRecord * rec, * rec2;
     int n;
     size=(size+3)&(~3);
-    if(size==0) size=4;
     size+=WHEAP_PAD_SIZE;
-    if(!rec) { SGIP_DEBUG_MESSAGE(("wHeapAlloc: heap full!")); return 0; } // should not happen given normal use.
-    while(rec->size<size) {
-        if(!rec->next) { SGIP_DEBUG_MESSAGE(("wHeapAlloc: heap too full!")); return 0; } // cannot alloc
-        if(rec->next->flags!=WHEAP_RECORD_FLAG_INUSE) { // try to merge with next one
-            rec->size+=rec->next->size+WHEAP_RECORD_SIZE;
-            rec->next=rec->next->next;
-        } else { // skip ahead to more friendly waters
-            rec=rec->next;
-            while(rec->next) {
-                if(rec->flags!=WHEAP_RECORD_FLAG_INUSE) break;
-                rec=rec->next;
-            }
-            if(rec->flags==WHEAP_RECORD_FLAG_INUSE) { SGIP_DEBUG_MESSAGE(("wHeapAlloc: heap too full!")); return 0; } // no empty slots :(
-        }
+    if(size<WHEAP_MIN_SIZE) size=WHEAP_MIN_SIZE;
+    rec=wHeapFind(size);
+    if(!rec) { // nothing sure to be big enough; there may still be a block that is, in size's own list
+        int fl,sl;
+        wHeapMapping(size,&fl,&sl);
+        if(fl<WHEAP_FL_COUNT) for(rec=wHeapLists[fl][sl];rec && WHEAP_SIZE(rec)<size;rec=rec->nextfree);
     }
-    rec->flags=WHEAP_RECORD_FLAG_INUSE;
-    n=rec->size-size;
-    voidptr = ((char *)rec)+WHEAP_RECORD_SIZE+WHEAP_PAD_START;
-    if(n<WHEAP_SIZE_CUTOFF) { // pad to include unused portion
-        rec->unused=n;
-    } else { // chop block into 2
-        wHeapRecord * rec2;
-        rec2=(wHeapRecord *)(((char *)rec)+WHEAP_RECORD_SIZE+size);
-        rec2->flags=WHEAP_RECORD_FLAG_UNUSED;
-        rec2->size=rec->size-size-WHEAP_RECORD_SIZE;
+    if(!rec) { SGIP_DEBUG_MESSAGE(("wHeapAlloc: heap too full!")); wHeapFailed++; return 0; } // cannot alloc
+    wHeapRemove(rec);
+    n=WHEAP_SIZE(rec)-size;
+    if(n>=(int)(WHEAP_RECORD_SIZE+WHEAP_MIN_SIZE)) { // chop block into 2
         rec->size=size;
-        rec2->next=rec->next;
-        rec->next=rec2;
-        rec->unused=0;
-    }
-    if(rec==wHeapFirst) {
-        while(wHeapFirst->next && wHeapFirst->flags==WHEAP_RECORD_FLAG_INUSE) wHeapFirst=wHeapFirst->next;
-        if(wHeapFirst->flags==WHEAP_RECORD_FLAG_INUSE) wHeapFirst=0;
+        rec2=WHEAP_NEXT(rec);
+        rec2->prev=rec;
+        rec2->size=n-WHEAP_RECORD_SIZE;
+        WHEAP_NEXT(rec2)->prev=rec2;
+        wHeapInsert(rec2);
     }
+    wHeapAllocs++;
+    wHeapUsedBlocks++;
+    wHeapUsed+=WHEAP_RECORD_SIZE+WHEAP_SIZE(rec);
+    if(wHeapUsed>wHeapHighWater) wHeapHighWater=wHeapUsed;
 #ifdef WHEAP_DO_PAD
+    rec->reqsize=size;
     {
         int i;
         for(i=0;i<WHEAP_PAD_START;i++) {
@@ -168,14 +243,15 @@ void * wHeapAlloc(int size) {
         }
     }
 #endif
-    return voidptr;    
+    return ((char *)rec)+WHEAP_RECORD_SIZE+WHEAP_PAD_START;
 }
 
 void wHeapFree(void * data) {
     wHeapRecord * rec = (wHeapRecord *)(((char *)data)-WHEAP_RECORD_SIZE-WHEAP_PAD_START);
+    wHeapRecord * next;
 #ifdef WHEAP_DO_PAD
     {
-        int size=rec->size-rec->unused;
+        int size=rec->reqsize;
         int i;
         for(i=0;i<WHEAP_PAD_START;i++) {
             if((((unsigned char *)rec)+WHEAP_RECORD_SIZE)[i]!=WHEAP_FILL_START) break;
@@ -191,11 +267,54 @@ void wHeapFree(void * data) {
         }
     }
 #endif
-    if(rec->flags!=WHEAP_RECORD_FLAG_INUSE) { // note heap error
+    if(rec->size&WHEAP_RECORD_FLAG_FREE) { // note heap error
         SGIP_DEBUG_MESSAGE(("wHeapFree: Data already freed! 0x%X",data));
+        return;
+    }
+    wHeapFrees++;
+    wHeapUsedBlocks--;
+    wHeapUsed-=WHEAP_RECORD_SIZE+WHEAP_SIZE(rec);
+    rec->size|=WHEAP_RECORD_FLAG_FREE; // (left in the header if it's merged away, to catch freeing it again)
+    next=WHEAP_NEXT(rec);
+    if(next->size&WHEAP_RECORD_FLAG_FREE) { // merge with the block after
+        wHeapRemove(next);
+        rec->size=(WHEAP_SIZE(rec)+WHEAP_RECORD_SIZE+WHEAP_SIZE(next))|WHEAP_RECORD_FLAG_FREE;
+        WHEAP_NEXT(rec)->prev=rec;
     }
-    rec->flags=WHEAP_RECORD_FLAG_FREED;
-    if(rec<wHeapFirst || !wHeapFirst) wHeapFirst=rec; // reposition the "starting" pointer.
+    if(rec->prev && (rec->prev->size&WHEAP_RECORD_FLAG_FREE)) { // and the one before
+        next=rec;
+        rec=rec->prev;
+        wHeapRemove(rec);
+        rec->size+=WHEAP_RECORD_SIZE+WHEAP_SIZE(next);
+        WHEAP_NEXT(rec)->prev=rec;
+    }
+    wHeapInsert(rec);
+}
+
+int Wifi_GetHeapStats(Wifi_HeapStats * stats) {
+    wHeapRecord * rec;
+    int n;
+    if(!stats || !wHeapStart) return -1;
+    SGIP_INTR_PROTECT(); // the stack allocates from interrupts; take the counters and walk the heap in one piece
+    stats->size=wHeapsize;
+    stats->used=wHeapUsed;
+    stats->highwater=wHeapHighWater;
+    stats->usedblocks=wHeapUsedBlocks;
+    stats->allocs=wHeapAllocs;
+    stats->frees=wHeapFrees;
+    stats->failed=wHeapFailed;
+    stats->free=stats->freeblocks=stats->largestfree=0;
+    for(rec=wHeapStart;WHEAP_SIZE(rec);rec=WHEAP_NEXT(rec)) {
+        if(!(rec->size&WHEAP_RECORD_FLAG_FREE)) continue;
+        n=WHEAP_SIZE(rec)-WHEAP_PAD_SIZE;
+        if(n<0) n=0;
+        stats->free+=n;
+        stats->freeblocks++;
+        if(n>(int)stats->largestfree) stats->largestfree=n;
+    }
+    SGIP_INTR_UNPROTECT();
+    stats->fragmentation=stats->free?100-stats->largestfree*100/stats->free:0;
+    return 0;
 }
 
 
@@ -783,6 +902,8 @@ int Wifi_DisconnectAP() {
 
 
 
+int wifi_txsyncpending; // frames were queued in a transmit batch without telling the arm7
+
 int Wifi_TransmitFunction(sgIP_Hub_HWInterface * hw, sgIP_memblock * mb) {
 	// convert ethernet frame into wireless frame and output.
 	// ethernet header: 6byte dest, 6byte src, 2byte protocol_id
@@ -881,10 +1002,22 @@ int Wifi_TransmitFunction(sgIP_Hub_HWInterface * hw, sgIP_memblock * mb) {
    if(copytotal!=copyexpect) {
       SGIP_DEBUG_MESSAGE(("Tx exp:%i que:%i",copyexpect,copytotal));
    }
-   if(synchandler) synchandler();
+   // in a transmit batch, one sync at the end will do - unless the buffer is getting full.
+   if(sgIP_Hub_TxBatching() && Wifi_TxBufferWordsAvailable()>WIFI_TXBUFFER_SIZE/4) {
+      wifi_txsyncpending=1;
+   } else {
+      wifi_txsyncpending=0;
+      if(synchandler) synchandler();
+   }
 	return 0;
 }
 
+void Wifi_TransmitFlush(sgIP_Hub_HWInterface * hw) {
+   if(!wifi_txsyncpending) return;
+   wifi_txsyncpending=0;
+   if(synchandler) synchandler();
+}
+
 int Wifi_Interface_Init(sgIP_Hub_HWInterface * hw) {
 	hw->MTU=2300;
 	hw->ipaddr=(192)|(168<<8)|(1<<16)|(151<<24);
@@ -894,12 +1027,15 @@ int Wifi_Interface_Init(sgIP_Hub_HWInterface * hw) {
 	hw->hwaddrlen=6;
 	Wifi_CopyMacAddr(hw->hwaddr,WifiData->MacAddr);
 	hw->userdata=0;
+	hw->FlushFunction=Wifi_TransmitFlush;
 	return 0;
 }
 
 void Wifi_Timer(int num_ms) {
 	Wifi_Update();
+	sgIP_Hub_TxBatchStart(); // retransmits and delayed acks due now go out with one sync
 	sgIP_Timer(num_ms);
+	sgIP_Hub_TxBatchEnd();
 }
 
 #endif
@@ -943,6 +1079,10 @@ int Wifi_CheckInit() {
 void Wifi_Update() {
 	int cnt;
 	int base, base2, len, fulllen;
+#ifdef WIFI_USE_TCP_SGIP
+	sgIP_memblock * rxbatch, * rxbatch_end; // frames for the stack, handed over SGIP_HUB_RXBATCH at a time
+	int rxbatch_count;
+#endif
 	if(!WifiData) return;
 
 #ifdef WIFI_USE_TCP_SGIP
@@ -953,6 +1093,7 @@ void Wifi_Update() {
 			// add network interface.
 			wifi_hw = sgIP_Hub_AddHardwareInterface(&Wifi_TransmitFunction,&Wifi_Interface_Init);
             sgIP_timems=WifiData->random; //hacky! but it should work just fine :)
+            sgIP_TCP_AddEntropy(WifiData->random); // the wifi chip's random number generator, before anything can arrive
 		}
 	}
 	if(WifiData->authlevel!=WIFI_AUTHLEVEL_ASSOCIATED && WifiData->flags9&WFLAG_ARM9_NETUP) {
@@ -965,6 +1106,10 @@ void Wifi_Update() {
 
 	// check for received packets, forward to whatever wants them.
 	cnt=0;
+#ifdef WIFI_USE_TCP_SGIP
+	rxbatch=rxbatch_end=0;
+	rxbatch_count=0;
+#endif
 	while(WifiData->rxbufIn!=WifiData->rxbufOut) {
 		base = WifiData->rxbufIn;
 		len=Wifi_RxReadOffset(base,4);
@@ -973,6 +1118,7 @@ void Wifi_Update() {
 		// Do lwIP interfacing for rx here
 		if((Wifi_RxReadOffset(base,6)&0x01CF)==0x0008) // if it is a non-null data packet coming from the AP (toDS==0)
 		{
+			sgIP_TCP_AddEntropy((Wifi_RxReadOffset(base,5)<<16)^WifiData->random); // signal strength noise, for the SYN cookie secrets
 			u16 framehdr[6+12+2+4];
 			sgIP_memblock * mb;
 			int hdrlen;
@@ -1007,7 +1153,14 @@ void Wifi_Update() {
 						ethhdr_print('R',mb->datastart);
 
 						// Done generating recieved data packet... now distribute it.
-						sgIP_Hub_ReceiveHardwarePacket(wifi_hw,mb);
+						mb->nextpacket=0;
+						if(rxbatch_end) rxbatch_end->nextpacket=mb; else rxbatch=mb;
+						rxbatch_end=mb;
+						if(++rxbatch_count>=SGIP_HUB_RXBATCH) {
+							sgIP_Hub_ReceiveHardwarePackets(wifi_hw,rxbatch);
+							rxbatch=rxbatch_end=0;
+							rxbatch_count=0;
+						}
 
 					}
 				}
@@ -1029,6 +1182,9 @@ void Wifi_Update() {
 
 		if(cnt++>80) break;
 	}
+#ifdef WIFI_USE_TCP_SGIP
+	if(rxbatch) sgIP_Hub_ReceiveHardwarePackets(wifi_hw,rxbatch);
+#endif
 }
 
 
@@ -68,6 +68,17 @@ extern "C" {
 
 extern volatile Wifi_MainStruct * WifiData;
 
+typedef struct WIFI_HEAPSTATS {
+	u32 size; // bytes in the heap
+	u32 used; // bytes in allocated blocks, headers included
+	u32 highwater; // the most that has been used at once
+	u32 free; // bytes in free blocks, that could be allocated
+	u32 largestfree; // the biggest single allocation that would succeed right now
+	u32 fragmentation; // 0-100, how much of the free space is outside the largest free block
+	u32 usedblocks, freeblocks;
+	u32 allocs, frees, failed; // counts since Wifi_Init
+} Wifi_HeapStats;
+
 enum WIFIGETDATA {
 	WIFIGETDATA_MACADDRESS,			// MACADDRESS: returns data in the buffer, requires at least 6 bytes
 	WIFIGETDATA_NUMWFCAPS,			// NUM WFC APS: returns number between 0 and 3, doesn't use buffer.
@@ -125,6 +136,7 @@ extern void Wifi_Sync();
 extern void Wifi_Timer(int num_ms);
 extern void Wifi_SetIP(u32 IPaddr, u32 gateway, u32 subnetmask, u32 dns1, u32 dns2);
 extern u32 Wifi_GetIP();
+extern int Wifi_GetHeapStats(Wifi_HeapStats * stats);
 
 #endif
 
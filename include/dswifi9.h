@@ -144,6 +144,18 @@ enum WIFI_ASSOCSTATUS {
 
 extern const char * ASSOCSTATUS_STRINGS[];
 
+// WIFI_HEAPSTATS: the state of the heap sgIP allocates from (set up by Wifi_Init, see Wifi_GetHeapStats)
+typedef struct WIFI_HEAPSTATS {
+	u32 size; // bytes in the heap
+	u32 used; // bytes in allocated blocks, headers included
+	u32 highwater; // the most that has been used at once
+	u32 free; // bytes in free blocks, that could be allocated
+	u32 largestfree; // the biggest single allocation that would succeed right now
+	u32 fragmentation; // 0-100, how much of the free space is outside the largest free block
+	u32 usedblocks, freeblocks;
+	u32 allocs, frees, failed; // counts since Wifi_Init
+} Wifi_HeapStats;
+
 // most user code will never need to know about the WIFI_TXHEADER or WIFI_RXHEADER
 typedef struct WIFI_TXHEADER {
 	u16 enable_flags;
@@ -306,6 +318,11 @@ extern int Wifi_GetData(int datatype, int bufferlen, unsigned char * buffer);
 //  int statnum:		Element from the WIFI_STATS enum, indicating what statistic to return
 //  Returns:			the requested stat, or 0 for failure
 extern u32 Wifi_GetStats(int statnum);
+
+// Wifi_GetHeapStats: Retreive usage and fragmentation information for the wifi heap
+//  Wifi_HeapStats * stats:	Pointer to the structure to fill in
+//  Returns:			0 for ok, -1 for failure (WIFIINIT_OPTION_USECUSTOMALLOC means there's no wifi heap)
+extern int Wifi_GetHeapStats(Wifi_HeapStats * stats);
 //////////////////////////////////////////////////////////////////////////
 // Raw Send/Receive functions
 
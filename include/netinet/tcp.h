@@ -0,0 +1,87 @@
+// DSWifi Project - socket emulation layer defines/prototypes (netinet/tcp.h)
+// Copyright (C) 2005-2006 Stephen Stair - sgstair@akkit.org - http://www.akkit.org
+/****************************************************************************** 
+DSWifi Lib and test materials are licenced under the MIT open source licence:
+Copyright (c) 2005-2006 Stephen Stair
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+******************************************************************************/
+
+#ifndef NETINET_TCP_H
+#define NETINET_TCP_H
+
+// socket options for level SOL_TCP
+#define TCP_NODELAY			1	/* send small segments at once, without waiting for acks (Nagle) */
+#define TCP_CORK			3	/* only send full segments until cleared, or the socket is closed */
+#define TCP_INFO			11	/* get struct tcp_info (getsockopt only) */
+
+// tcpi_state values
+#define TCP_ESTABLISHED		1
+#define TCP_SYN_SENT		2
+#define TCP_SYN_RECV		3
+#define TCP_FIN_WAIT1		4
+#define TCP_FIN_WAIT2		5
+#define TCP_TIME_WAIT		6
+#define TCP_CLOSE			7
+#define TCP_CLOSE_WAIT		8
+#define TCP_LAST_ACK		9
+#define TCP_LISTEN			10
+#define TCP_CLOSING			11
+
+// tcpi_ca_state values
+#define TCP_CA_Open			0	/* nothing lost */
+#define TCP_CA_Disorder		1	/* duplicate acks seen */
+#define TCP_CA_Recovery		3	/* fast recovery */
+#define TCP_CA_Loss			4	/* recovering from a retransmit timeout */
+
+// tcpi_snd_ssthresh before the first loss: slow start has no threshold yet
+#define TCP_INFINITE_SSTHRESH	0x7fffffff
+
+// tcpi_options bits
+#define TCPI_OPT_SACK		2
+#define TCPI_OPT_WSCALE		4
+
+// struct tcp_info: a snapshot of a connection's state, from getsockopt(s,SOL_TCP,TCP_INFO,...)
+//  names follow Linux; times are in microseconds and cwnd/ssthresh in segments.
+struct tcp_info {
+	unsigned char	tcpi_state;
+	unsigned char	tcpi_ca_state;
+	unsigned char	tcpi_backoff;		/* retransmit timer doublings since the last ack */
+	unsigned char	tcpi_options;
+	unsigned char	tcpi_snd_wscale : 4, tcpi_rcv_wscale : 4;
+
+	unsigned long	tcpi_rto;
+	unsigned long	tcpi_ato;			/* delayed ack timeout */
+	unsigned long	tcpi_snd_mss;
+	unsigned long	tcpi_unacked;		/* bytes sent and not yet acknowledged */
+	unsigned long	tcpi_sacked;		/* of those, bytes the remote end has SACKed */
+
+	unsigned long	tcpi_rtt;			/* smoothed round trip time, 0 until measured */
+	unsigned long	tcpi_rttvar;
+	unsigned long	tcpi_snd_ssthresh;	/* TCP_INFINITE_SSTHRESH until the first loss */
+	unsigned long	tcpi_snd_cwnd;
+	unsigned long	tcpi_total_retrans;	/* segments sent more than once */
+
+	unsigned long	tcpi_segs_out;		/* segments sent, including retransmits and pure acks */
+	unsigned long	tcpi_segs_in;
+	unsigned long	tcpi_data_segs_out;	/* of those, the ones carrying data */
+	unsigned long	tcpi_data_segs_in;
+};
+
+#endif
@@ -54,7 +54,7 @@ SOFTWARE.
 #define SOCKET_ERROR	-1
 
 // send()/recv()/etc flags
-// at present, only MSG_PEEK is implemented though.
+// at present, only MSG_PEEK (tcp and udp) and MSG_TRUNC (udp) are implemented though.
 #define MSG_WAITALL		0x40000000
 #define MSG_TRUNC		0x20000000
 #define MSG_PEEK		0x10000000
@@ -95,12 +95,26 @@ SOFTWARE.
 #define SO_RCVTIMEO  0x1006    /* receive timeout */
 #define  SO_ERROR  0x1007    /* get error status and clear */
 #define  SO_TYPE    0x1008    /* get socket type */
+#define SO_RCVDROPPED  0x1009    /* (udp) datagrams dropped because the receive queue was full (get only) */
+#define SO_RCVDROPOLDEST  0x100A    /* (udp) when the receive queue is full, drop the oldest datagrams instead of the new one */
 
 struct sockaddr {
 	unsigned short		sa_family;
 	char				sa_data[14];
 };
 
+// one datagram of a sendmmsg()/recvmmsg() batch (a single flat buffer, rather than the iovec list of a POSIX msghdr)
+struct mmsghdr {
+	void * msg_data;			// payload to send, or the buffer to receive into
+	int msg_datalen;			// bytes to send, or the size of the receive buffer
+	struct sockaddr * msg_addr;	// destination (sendmmsg) or sender (recvmmsg, may be 0)
+	int msg_addrlen;			// size of msg_addr; set to the size of the sender's address by recvmmsg
+	int msg_len;				// out: bytes sent or received
+};
+
+// a datagram lent to the application by recvfrom_zc(), still in the stack's own buffers
+typedef void * dgram_t;
+
 #ifndef ntohs
 #define ntohs(num) htons(num)
 #define ntohl(num) htonl(num)
@@ -117,6 +131,11 @@ extern "C" {
 	extern int recv(int socket, void * data, int recvlength, int flags);
 	extern int sendto(int socket, const void * data, int sendlength, int flags, const struct sockaddr * addr, int addr_len);
 	extern int recvfrom(int socket, void * data, int recvlength, int flags, struct sockaddr * addr, int * addr_len);
+	extern int recvfrom_zc(int socket, dgram_t * dgram, int flags, struct sockaddr * addr, int * addr_len);
+	extern int dgram_getspan(dgram_t dgram, int index, const void ** data);
+	extern void dgram_release(dgram_t dgram);
+	extern int sendmmsg(int socket, struct mmsghdr * msgs, unsigned int count, int flags);
+	extern int recvmmsg(int socket, struct mmsghdr * msgs, unsigned int count, int flags);
 	extern int listen(int socket, int max_connections);
 	extern int accept(int socket, struct sockaddr * addr, int * addr_len);
 	extern int shutdown(int socket, int shutdown_type);
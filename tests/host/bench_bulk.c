@@ -0,0 +1,20 @@
+// bulk TCP throughput over the simulated link (~2Mbit, 3ms each way): average KB/s over 12 loss
+//  patterns for each loss rate and write size
+#include "harness.h"
+#include "bulk.h"
+
+int main(void) {
+	static const int losses[3]={0,20,50}, chunks[3]={100,1000,4096};
+	int l, c, seed, kbs, sum, n, failed;
+	net_init();
+	for(l=0;l<3;l++) for(c=0;c<3;c++) {
+		sum=n=failed=0;
+		for(seed=1;seed<=12;seed++) {
+			rnd_seed(seed);
+			kbs=bulk(80,200000,losses[l],chunks[c]);
+			if(kbs<0) failed++; else { sum+=kbs; n++; }
+		}
+		printf("bulk, %d.%d%% loss, %4d-byte writes: %3d KB/s (%d runs failed)\n",losses[l]/10,losses[l]%10,chunks[c],n?sum/n:0,failed);
+	}
+	return 0;
+}
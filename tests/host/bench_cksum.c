@@ -0,0 +1,44 @@
+// checksum kernels against a byte-pair loop: ChecksumBuf aligned and odd, CopyChecksumBuf against
+//  memcpy followed by ChecksumBuf, and IPChecksum over a three-block chain
+#include "harness.h"
+
+#define ITERS 200000
+
+static unsigned int pair_sum(const unsigned char * p, int len) {
+	unsigned int sum=0;
+	int i;
+	for(i=0;i+1<len;i+=2) sum+=p[i]|(p[i+1]<<8);
+	if(len&1) sum+=p[len-1];
+	while(sum>>16) sum=(sum&0xFFFF)+(sum>>16);
+	return sum;
+}
+
+static void report(const char * what, double ns, int len) {
+	printf("cksum, %-34s %5.0f ns, %5.0f MB/s\n",what,ns/ITERS,(double)len*ITERS/ns*1000);
+}
+
+int main(void) {
+	static unsigned char src[2048], dst[2048];
+	unsigned int sink=0;
+	int i, k;
+	double t0;
+	sgIP_memblock * mb, * b2, * b3;
+	net_init();
+	for(i=0;i<(int)sizeof(src);i++) src[i]=rnd();
+
+	t0=host_ns(); for(k=0;k<ITERS;k++) sink+=pair_sum(src,1460); report("byte pairs, 1460:",host_ns()-t0,1460);
+	t0=host_ns(); for(k=0;k<ITERS;k++) sink+=sgIP_memblock_ChecksumBuf(src,1460); report("ChecksumBuf, 1460 aligned:",host_ns()-t0,1460);
+	t0=host_ns(); for(k=0;k<ITERS;k++) sink+=sgIP_memblock_ChecksumBuf(src+1,1460); report("ChecksumBuf, 1460 from an odd byte:",host_ns()-t0,1460);
+	t0=host_ns(); for(k=0;k<ITERS;k++) { memcpy(dst,src,1460); sink+=sgIP_memblock_ChecksumBuf(dst,1460); } report("memcpy+ChecksumBuf, 1460:",host_ns()-t0,1460);
+	t0=host_ns(); for(k=0;k<ITERS;k++) sink+=sgIP_memblock_CopyChecksumBuf(dst,src,1460); report("CopyChecksumBuf, 1460 aligned:",host_ns()-t0,1460);
+	t0=host_ns(); for(k=0;k<ITERS;k++) sink+=sgIP_memblock_CopyChecksumBuf(dst+2,src,1460); report("CopyChecksumBuf, 1460 halfword off:",host_ns()-t0,1460);
+	t0=host_ns(); for(k=0;k<ITERS;k++) sink+=sgIP_memblock_CopyChecksumBuf(dst+1,src,1460); report("CopyChecksumBuf, 1460 byte off:",host_ns()-t0,1460);
+
+	mb=sgIP_memblock_alloc(40); b2=sgIP_memblock_alloc(501); b3=sgIP_memblock_alloc(919);
+	memcpy(mb->datastart,src,40); memcpy(b2->datastart,src+40,501); memcpy(b3->datastart,src+541,919);
+	sgIP_memblock_append(mb,b2); sgIP_memblock_append(mb,b3);
+	t0=host_ns(); for(k=0;k<ITERS;k++) sink+=sgIP_memblock_IPChecksum(mb,0,1460); report("IPChecksum, 40+501+919 chain:",host_ns()-t0,1460);
+	sgIP_memblock_free(mb);
+	printf("(%u)\n",sink&1);
+	return 0;
+}
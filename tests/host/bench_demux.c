@@ -0,0 +1,42 @@
+// connection lookup cost, hashed against the old walk of the whole record list
+#include "harness.h"
+
+extern sgIP_Record_TCP * tcprecords;
+sgIP_Record_TCP * sgIP_TCP_FindRecord(unsigned long srcip, unsigned long destip, unsigned short srcport, unsigned short destport, int flags);
+void sgIP_TCP_HashInsert(sgIP_Record_TCP * rec, int which);
+
+static void bench(int n) {
+	int i, k, iters=2000000, hit=0;
+	sgIP_Record_TCP ** r = malloc(sizeof(*r)*n), * q;
+	double t0, t1, t2;
+	for(i=0;i<n;i++) {
+		r[i]=sgIP_TCP_AllocRecord();
+		r[i]->srcip=0x0100000a; r[i]->srcport=htons(40000+i);
+		r[i]->destip=0x0200000a+(i<<24); r[i]->destport=htons(80);
+		r[i]->tcpstate=SGIP_TCP_STATE_ESTABLISHED;
+		sgIP_TCP_HashInsert(r[i],SGIP_TCP_HASHED_CONN);
+		sgIP_TCP_HashInsert(r[i],SGIP_TCP_HASHED_BIND);
+	}
+	t0=host_ns();
+	for(k=0;k<iters;k++) {
+		i=(int)(((unsigned)k*7919u)%(unsigned)n);
+		if(sgIP_TCP_FindRecord(r[i]->destip,r[i]->srcip,r[i]->destport,r[i]->srcport,SGIP_TCP_FLAG_ACK)==r[i]) hit++;
+	}
+	t1=host_ns();
+	for(k=0;k<iters;k++) {
+		i=(int)(((unsigned)k*7919u)%(unsigned)n);
+		for(q=tcprecords;q;q=q->next)
+			if(q->srcport==r[i]->srcport && q->destport==r[i]->destport && q->destip==r[i]->destip) break;
+		if(q==r[i]) hit++;
+	}
+	t2=host_ns();
+	printf("demux, %4d connections: hashed %.1f ns per lookup, list walk %.1f ns (%d of %d found)\n",n,(t1-t0)/iters,(t2-t1)/iters,hit,2*iters);
+	for(i=0;i<n;i++) sgIP_TCP_FreeRecord(r[i]);
+	free(r);
+}
+
+int main(void) {
+	net_init();
+	bench(10); bench(100); bench(1000);
+	return 0;
+}
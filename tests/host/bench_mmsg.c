@@ -0,0 +1,52 @@
+// host cost of 8-datagram sendmmsg/recvmmsg batches against sendto/recvfrom loops
+#include "harness.h"
+
+#define ROUNDS 20000
+
+int main(void) {
+	int rx, tx, i, k, n, fl, got, s0;
+	unsigned long one=1;
+	char bufs[16][600], big[600];
+	struct sockaddr_in ra, d, f, from[16];
+	struct mmsghdr m[16];
+	double t0, tb, ts;
+	net_init();
+	ra=mkaddr(5100);
+	rx=socket(AF_INET,SOCK_DGRAM,0);
+	bind(rx,(struct sockaddr*)&ra,sizeof(ra));
+	ioctl(rx,FIONBIO,&one);
+	tx=socket(AF_INET,SOCK_DGRAM,0);
+	ioctl(tx,FIONBIO,&one);
+	d=mkaddr(5100);
+	memset(bufs,0,sizeof(bufs));
+	sendto(tx,big,1,0,(struct sockaddr*)&d,sizeof(d)); // resolve our address first
+	pump(50);
+	fl=sizeof(f); recvfrom(rx,big,sizeof(big),0,(struct sockaddr*)&f,&fl);
+	bw_bytes_per_ms=1000000; // keep the link out of the way
+
+	for(i=0;i<8;i++) { m[i].msg_data=bufs[i]; m[i].msg_datalen=64; m[i].msg_addr=(struct sockaddr*)&d; m[i].msg_addrlen=sizeof(d); }
+	got=0; s0=hw_syncs; t0=host_ns();
+	for(k=0;k<ROUNDS;k++) {
+		sendmmsg(tx,m,8,0);
+		if(k%2==1) { // read before SGIP_UDP_MAXQUEUED wait
+			pump(1);
+			for(i=8;i<16;i++) { m[i].msg_data=bufs[i]; m[i].msg_datalen=600; m[i].msg_addr=(struct sockaddr*)&from[i]; m[i].msg_addrlen=sizeof(from[i]); }
+			while((n=recvmmsg(rx,m+8,8,0))>0) got+=n;
+		}
+	}
+	tb=host_ns()-t0;
+	printf("mmsg, batches of 8:  %4.0f ns per datagram, %d of %d received, %d syncs\n",tb/(ROUNDS*8),got,ROUNDS*8,hw_syncs-s0);
+
+	got=0; s0=hw_syncs; t0=host_ns();
+	for(k=0;k<ROUNDS;k++) {
+		for(i=0;i<8;i++) sendto(tx,bufs[i],64,0,(struct sockaddr*)&d,sizeof(d));
+		if(k%2==1) { // read before SGIP_UDP_MAXQUEUED wait
+			pump(1);
+			for(;;) { fl=sizeof(f); if(recvfrom(rx,big,600,0,(struct sockaddr*)&f,&fl)<=0) break; got++; }
+		}
+	}
+	ts=host_ns()-t0;
+	printf("mmsg, single calls:  %4.0f ns per datagram, %d of %d received, %d syncs\n",ts/(ROUNDS*8),got,ROUNDS*8,hw_syncs-s0);
+	closesocket(rx); closesocket(tx);
+	return 0;
+}
@@ -0,0 +1,53 @@
+// host cost of moving 1460 byte segments through a 16KB ring: sgIP_Ring's two-span memcpy
+//  against a byte at a time, and WriteMemblock from a three block chain
+#include "harness.h"
+#include "sgIP_Ring.h"
+
+#define ITERS		200000
+#define RING_BYTES	16384
+#define SEG		1460
+
+// the same ring, a byte at a time
+static int byte_write(sgIP_Ring * r, const unsigned char * src, int len) {
+	int i;
+	if(len>sgIP_Ring_Space(r)) len=sgIP_Ring_Space(r);
+	for(i=0;i<len;i++) { r->buf[r->out++]=src[i]; if(r->out==r->size) r->out=0; }
+	return len;
+}
+static int byte_read(sgIP_Ring * r, unsigned char * dest, int len) {
+	int i;
+	if(len>sgIP_Ring_Used(r)) len=sgIP_Ring_Used(r);
+	for(i=0;i<len;i++) { dest[i]=r->buf[r->in++]; if(r->in==r->size) r->in=0; }
+	return len;
+}
+
+static void report(const char * what, double ns) {
+	printf("ring, %-30s %6.0f ns, %5.0f MB/s\n",what,ns/ITERS,(double)SEG*ITERS/ns*1000);
+}
+
+int main(void) {
+	static unsigned char src[SEG], dst[SEG];
+	sgIP_Ring r;
+	sgIP_memblock * mb;
+	unsigned int sink=0;
+	int i, k;
+	double t0;
+	net_init();
+	for(i=0;i<SEG;i++) src[i]=rnd();
+	mb=sgIP_memblock_alloc(40);
+	sgIP_memblock_append(mb,sgIP_memblock_alloc(501));
+	sgIP_memblock_append(mb,sgIP_memblock_alloc(SEG-40-501));
+	sgIP_memblock_CopyFromLinear(mb,src,0,SEG);
+	sgIP_Ring_Alloc(&r,RING_BYTES);
+
+	t0=host_ns(); for(k=0;k<ITERS;k++) { byte_write(&r,src,SEG); sink+=byte_read(&r,dst,SEG); } report("byte loop, write+read:",host_ns()-t0);
+	t0=host_ns(); for(k=0;k<ITERS;k++) { sgIP_Ring_Write(&r,src,SEG); sink+=sgIP_Ring_Read(&r,dst,SEG,0); } report("Write+Read:",host_ns()-t0);
+	t0=host_ns(); for(k=0;k<ITERS;k++) { sgIP_Ring_WriteMemblock(&r,mb,0,SEG); sink+=sgIP_Ring_Read(&r,dst,SEG,0); } report("WriteMemblock+Read, 3 blocks:",host_ns()-t0);
+	t0=host_ns(); for(k=0;k<ITERS;k++) { memcpy(dst,src,SEG); sink+=dst[k%SEG]; } report("one memcpy, for scale:",host_ns()-t0);
+	if(memcmp(dst,src,SEG)) printf("ring, data mismatch\n");
+
+	sgIP_Ring_Free(&r);
+	sgIP_memblock_free(mb);
+	printf("(%u)\n",sink&1);
+	return 0;
+}
@@ -0,0 +1,63 @@
+// host cost of a memblock from the slabs against the malloc-all path (an sgIP_malloc and
+//  sgIP_free of the same block, which is what allocHW does without SGIP_MEMBLOCK_SLABS): one
+//  block at a time, bursts of a segment's worth of mixed sizes, and random alloc/free
+#include "harness.h"
+
+#define ITERS	200000
+#define BURST	32
+#define LIVE	64
+
+static const int burst_size[4]={40,1460,600,80};
+
+static int gets;
+
+static sgIP_memblock * slab_get(int size) { gets++; return sgIP_memblock_allocHW(0,size); }
+static void slab_put(void * p) { sgIP_memblock_free(p); }
+static sgIP_memblock * heap_get(int size) { gets++; return sgIP_malloc(SGIP_MEMBLOCK_HEADERSIZE+SGIP_MAXHWHEADER+size); }
+static void heap_put(void * p) { sgIP_free(p); }
+
+static double run(int pattern, sgIP_memblock * (*get)(int), void (*put)(void *)) {
+	static void * live[LIVE];
+	int k, i, j;
+	double t0;
+	memset(live,0,sizeof(live));
+	rnd_seed(7);
+	gets=0;
+	t0=host_ns();
+	switch(pattern) {
+	case 0:
+		for(k=0;k<ITERS;k++) put(get(1460));
+		break;
+	case 1:
+		for(k=0;k<ITERS/BURST;k++) {
+			for(i=0;i<BURST;i++) live[i]=get(burst_size[i&3]);
+			for(i=0;i<BURST;i++) put(live[i]);
+		}
+		break;
+	default:
+		for(k=0;k<ITERS;k++) {
+			j=rnd()%LIVE;
+			if(live[j]) { put(live[j]); live[j]=0; } else live[j]=get(1+rnd()%1600);
+		}
+		for(j=0;j<LIVE;j++) if(live[j]) put(live[j]);
+		break;
+	}
+	return (host_ns()-t0)/gets;
+}
+
+int main(void) {
+	static const char * name[3]={"one 1460 block","bursts of 32 mixed","random, 64 live"};
+	sgIP_memblock_Stats st0, st;
+	double ts, th;
+	int p;
+	net_init();
+	for(p=0;p<3;p++) {
+		sgIP_memblock_GetStats(&st0);
+		ts=run(p,slab_get,slab_put);
+		sgIP_memblock_GetStats(&st);
+		th=run(p,heap_get,heap_put);
+		printf("slab, %-20s slabs %5.1f ns, malloc %5.1f ns per alloc+free, %.4f heap calls per alloc\n",name[p],ts,th,
+			(double)(st.heapallocs-st0.heapallocs)/(st.allocs-st0.allocs));
+	}
+	return 0;
+}
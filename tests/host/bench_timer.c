@@ -0,0 +1,37 @@
+// cost of one sgIP_Timer tick with many TCP records that have nothing due
+#include "harness.h"
+
+void sgIP_TCP_UpdateTimer(sgIP_Record_TCP * rec);
+
+static double tick_ns(int iters) {
+	int i;
+	double t0=host_ns();
+	for(i=0;i<iters;i++) sgIP_Timer(50);
+	return (host_ns()-t0)/iters;
+}
+
+int main(void) {
+	static const int counts[3]={10,100,1000};
+	int k, i;
+	sgIP_Record_TCP * r;
+	net_init();
+	// connected records, as real connections leave them
+	for(k=0;k<3;k++) {
+		sgIP_Record_TCP ** recs=malloc(sizeof(*recs)*counts[k]);
+		for(i=0;i<counts[k];i++) {
+			r=recs[i]=sgIP_TCP_AllocRecord();
+			r->tcpstate=SGIP_TCP_STATE_ESTABLISHED; r->sequence=r->sequence_next=1000; r->txwindow=5000;
+			r->time_last_action=sgIP_timems; r->time_backoff=500;
+			sgIP_TCP_UpdateTimer(r);
+		}
+		printf("timer, %4d idle connections: %.0f ns per tick\n",counts[k],tick_ns(2000));
+		for(i=0;i<counts[k];i++) {
+			r=recs[i]; r->tcpstate=SGIP_TCP_STATE_TIME_WAIT; r->time_last_action=sgIP_timems+i*100;
+			sgIP_TCP_UpdateTimer(r);
+		}
+		printf("timer, %4d in TIME_WAIT:     %.0f ns per tick\n",counts[k],tick_ns(2000));
+		for(i=0;i<counts[k];i++) sgIP_TCP_FreeRecord(recs[i]);
+		free(recs);
+	}
+	return 0;
+}
@@ -0,0 +1,42 @@
+// UDP demux cost: datagrams for the first and for the last of n bound sockets
+#include "harness.h"
+
+static double deliver(int port, int sock, int iters) {
+	int k, fl, rx=0;
+	char buf[64];
+	struct sockaddr_in from;
+	sgIP_memblock * mb;
+	sgIP_Header_UDP * u;
+	double t0=host_ns();
+	for(k=0;k<iters;k++) {
+		mb=sgIP_memblock_alloc(8+32);
+		u=(sgIP_Header_UDP *)mb->datastart;
+		u->srcport=htons(9); u->destport=htons(port); u->length=htons(40); u->checksum=0;
+		sgIP_UDP_ReceivePacket(mb,hw->ipaddr,hw->ipaddr);
+		fl=sizeof(from);
+		if(recvfrom(sock,buf,sizeof(buf),0,(struct sockaddr*)&from,&fl)==32) rx++;
+	}
+	if(rx!=iters) printf("only %d of %d datagrams delivered\n",rx,iters);
+	return (host_ns()-t0)/iters;
+}
+
+int main(void) {
+	static const int counts[3]={1,8,24};
+	int c[24], i, k, n;
+	unsigned long one=1;
+	struct sockaddr_in ba;
+	net_init();
+	for(k=0;k<3;k++) {
+		n=counts[k];
+		for(i=0;i<n;i++) {
+			c[i]=socket(AF_INET,SOCK_DGRAM,0);
+			ba=mkaddr(7000+i);
+			bind(c[i],(struct sockaddr*)&ba,sizeof(ba));
+			ioctl(c[i],FIONBIO,&one);
+		}
+		printf("udp demux, %2d bound sockets: first %4.0f ns, last %4.0f ns per datagram\n",n,
+			deliver(7000,c[0],200000),deliver(7000+n-1,c[n-1],200000));
+		for(i=0;i<n;i++) closesocket(c[i]);
+	}
+	return 0;
+}
@@ -0,0 +1,51 @@
+// datagrams per second through the UDP receive side (sgIP_UDP_ReceivePacket, then recvfrom), with
+//  and without a checksum to check.  datagrams are built untimed, 16 at a time.
+#include "harness.h"
+
+#define BATCHES 6400
+
+int main(void) {
+	static const int sz[3]={64,512,1400};
+	static sgIP_memblock * pre[16];
+	int s, z, chk, rep, j, k, i, fl, got, v=65536;
+	unsigned long one=1;
+	char buf[2000];
+	struct sockaddr_in ba, f;
+	sgIP_memblock * mb;
+	sgIP_Header_UDP * u;
+	double best, br, bq, tr, tq, ta, tm, tb;
+	net_init();
+	s=socket(AF_INET,SOCK_DGRAM,0);
+	ba=mkaddr(5300);
+	bind(s,(struct sockaddr*)&ba,sizeof(ba));
+	ioctl(s,FIONBIO,&one);
+	setsockopt(s,SOL_SOCKET,SO_RCVBUF,&v,sizeof(int));
+	for(chk=1;chk>=0;chk--)
+		for(z=0;z<3;z++) {
+			best=1e18; br=bq=0; got=0;
+			for(rep=0;rep<5;rep++) {
+				tr=tq=0;
+				for(j=0;j<BATCHES;j++) {
+					for(k=0;k<16;k++) {
+						mb=sgIP_memblock_alloc(8+sz[z]);
+						for(i=0;i<sz[z];i++) mb->datastart[8+i]=(char)(i*3+1);
+						u=(sgIP_Header_UDP *)mb->datastart;
+						u->srcport=htons(9); u->destport=htons(5300); u->length=htons(8+sz[z]); u->checksum=0;
+						if(chk) u->checksum=sgIP_UDP_CalcChecksum(mb,hw->ipaddr,hw->ipaddr,mb->totallength);
+						pre[k]=mb;
+					}
+					ta=host_ns();
+					for(k=0;k<16;k++) sgIP_UDP_ReceivePacket(pre[k],hw->ipaddr,hw->ipaddr);
+					tm=host_ns();
+					for(k=0;k<16;k++) { fl=sizeof(f); if(recvfrom(s,buf,sizeof(buf),0,(struct sockaddr*)&f,&fl)==sz[z]) got++; }
+					tb=host_ns();
+					tr+=tm-ta; tq+=tb-tm;
+				}
+				if(tr+tq<best) { best=tr+tq; br=tr; bq=tq; }
+			}
+			printf("udp receive, %4d bytes, %s: %5.0fk datagrams/s (arrival %3.0f ns + recvfrom %3.0f ns), %d of %d received\n",
+				sz[z],chk?"checksummed":"no checksum",BATCHES*16/(best/1e9)/1000,br/(BATCHES*16),bq/(BATCHES*16),got,5*BATCHES*16);
+		}
+	closesocket(s);
+	return 0;
+}
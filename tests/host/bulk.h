@@ -0,0 +1,37 @@
+// one-way bulk TCP transfer over the simulated link, shared by test_bulk and bench_bulk
+#ifndef BULK_H
+#define BULK_H
+
+// send total bytes in writes of chunk with loss_permille set to loss once connected.  returns the
+//  KB/s achieved, or -1 if data came out wrong or the transfer took over 10 simulated minutes.
+static int bulk(int port, int total, int loss, int chunk) {
+	int ls, cs, ss, sent=0, rcvd=0, bad=0, i, n, r;
+	unsigned long one=1;
+	unsigned int t0, dt;
+	char buf[4096];
+	ls=tcp_pair(port,&cs,&ss);
+	if(ss<0) { printf("connect failed\n"); return -1; }
+	ioctl(cs,FIONBIO,&one); ioctl(ss,FIONBIO,&one);
+	loss_permille=loss;
+	t0=now_ms;
+	while(rcvd<total) {
+		if(sent<total) {
+			n=total-sent; if(n>chunk) n=chunk;
+			for(i=0;i<n;i++) buf[i]=(char)((sent+i)*7+3);
+			r=send(cs,buf,n,0); if(r>0) sent+=r;
+		}
+		r=recv(ss,buf,sizeof(buf),0);
+		if(r>0) { for(i=0;i<r;i++) if(buf[i]!=(char)((rcvd+i)*7+3)) bad++; rcvd+=r; }
+		pump(1);
+		if(now_ms-t0>600000) { printf("timed out after %d of %d bytes\n",rcvd,total); bad=-1; break; }
+	}
+	dt=now_ms-t0;
+	loss_permille=0;
+	if(bad>0) printf("%d bytes wrong\n",bad);
+	closesocket(cs); closesocket(ss); closesocket(ls);
+	pump(SGIP_TCP_TIMEMS_2MSL+2000); // out of TIME_WAIT, so the sockets can be used again
+	if(bad) return -1;
+	return dt ? (int)((double)total*1000/1024/dt) : 0;
+}
+
+#endif
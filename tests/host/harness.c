@@ -0,0 +1,198 @@
+// host harness for the arm9 sgIP stack: the simulated link and the functions the stack expects
+//  its platform to provide.
+#include "harness.h"
+
+unsigned int now_ms;
+int loss_permille = 0;
+int latency_ms = 3;
+int bw_bytes_per_ms = 250; // ~2Mbit
+int txq_ms = 40;
+int rx_batch = 0;
+int drop_srcport = -1;
+void (*tx_hook)(unsigned char *, int);
+int (*rx_hook)(unsigned char *, int);
+
+int frames_tx, frames_dropped, frames_oversize, hw_syncs;
+int tcp_data_segs, tcp_pure_acks, tcp_opt_data_segs;
+int malloc_count, malloc_bytes;
+int malloc_limit = 0;
+sgIP_Hub_HWInterface * hw;
+
+static unsigned int rng = 12345;
+static uint64_t link_free_us; // when the link has sent everything queued so far
+static int hw_syncpending;
+
+unsigned int rnd(void) { rng = rng * 1103515245 + 12345; return (rng >> 16) & 0x7fff; }
+void rnd_seed(unsigned int seed) { rng = seed; }
+
+double host_ns(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+void * sgIP_malloc(int size) {
+	int * p;
+	if(malloc_limit && malloc_bytes + size > malloc_limit) return 0;
+	p = malloc(size + 8);
+	if(!p) return 0;
+	p[0] = size; malloc_count++; malloc_bytes += size;
+	return p + 2;
+}
+void sgIP_free(void * ptr) {
+	int * p = ((int *)ptr) - 2;
+	malloc_count--; malloc_bytes -= p[0];
+	free(p);
+}
+void sgIP_dbgprint(char * s, ...) { }
+
+typedef struct FRAME { struct FRAME * next; unsigned int due; int len; unsigned char data[2048]; } frame;
+static frame * fq_head, * fq_tail;
+
+static void enqueue(frame * f) {
+	if((int)(rnd() % 1000) < loss_permille && f->data[12]==0x08 && f->data[13]==0) { frames_dropped++; free(f); return; }
+	f->next = 0;
+	if(fq_tail) fq_tail->next = f; else fq_head = f;
+	fq_tail = f;
+}
+
+void link_queue(const unsigned char * data, int len, int delay) {
+	frame * f = malloc(sizeof(frame));
+	memcpy(f->data, data, len);
+	f->len = len;
+	f->due = now_ms + delay;
+	enqueue(f);
+}
+
+unsigned short csum16(const unsigned char * d, int len, unsigned int sum) {
+	int i;
+	for(i=0;i+1<len;i+=2) sum += (d[i]<<8)|d[i+1];
+	if(len&1) sum += d[len-1]<<8;
+	while(sum>>16) sum=(sum&0xffff)+(sum>>16);
+	return ~sum;
+}
+
+static void count_tcp(unsigned char * d, int len) {
+	int ihl, tot, hl, dl;
+	if(len < 14+20+20 || d[12]!=0x08 || d[13]!=0 || d[14+9]!=6) return;
+	ihl = (d[14]&15)*4;
+	tot = (d[16]<<8)|d[17];
+	hl = (d[14+ihl+12]>>4)*4;
+	dl = tot - ihl - hl;
+	if(dl>0) {
+		tcp_data_segs++;
+		if(hl>20) tcp_opt_data_segs++;
+	} else if((d[14+ihl+13]&0x17)==SGIP_TCP_FLAG_ACK) tcp_pure_acks++;
+}
+
+static int fake_tx(sgIP_Hub_HWInterface * h, sgIP_memblock * mb) {
+	frame * f = malloc(sizeof(frame));
+	int mtu = h->MTU<SGIP_MTU_OVERRIDE ? h->MTU : SGIP_MTU_OVERRIDE;
+	if(sgIP_Hub_TxBatching()) hw_syncpending=1; else hw_syncs++;
+	f->len = sgIP_memblock_CopyToLinear(mb, f->data, 0, mb->totallength);
+	sgIP_memblock_free(mb);
+	frames_tx++;
+	if(f->len>=34 && f->data[12]==0x08 && f->data[13]==0 && ((f->data[16]<<8)|f->data[17])>mtu) frames_oversize++;
+	count_tcp(f->data, f->len);
+	if(tx_hook) tx_hook(f->data, f->len);
+	if(drop_srcport>=0 && f->len>=54 && f->data[23]==6 && ((f->data[34]<<8)|f->data[35])==drop_srcport) { free(f); return 0; }
+	if(link_free_us < (uint64_t)now_ms*1000) link_free_us = (uint64_t)now_ms*1000;
+	if(link_free_us - (uint64_t)now_ms*1000 > (uint64_t)txq_ms*1000) { frames_dropped++; free(f); return 0; }
+	link_free_us += (uint64_t)f->len*1000/bw_bytes_per_ms;
+	f->due = (link_free_us + 999) / 1000 + latency_ms;
+	enqueue(f);
+	return 0;
+}
+static void fake_flush(sgIP_Hub_HWInterface * h) {
+	if(hw_syncpending) { hw_syncpending=0; hw_syncs++; }
+}
+static int fake_init(sgIP_Hub_HWInterface * h) {
+	int i;
+	h->FlushFunction = fake_flush;
+	h->MTU = 1500;
+	h->ipaddr = 10 | (0<<8) | (0<<16) | (1<<24);
+	h->snmask = 0x00FFFFFF;
+	h->gateway = 10 | (254<<24);
+	h->hwaddrlen = 6;
+	for(i=0;i<6;i++) h->hwaddr[i] = 0x10+i;
+	return 0;
+}
+
+static void deliver(void) {
+	sgIP_memblock * mb, * bh=0, * bt=0;
+	int bn=0;
+	while(fq_head && fq_head->due <= now_ms) {
+		frame * f = fq_head;
+		fq_head = f->next; if(!fq_head) fq_tail = 0;
+		if(rx_hook && rx_hook(f->data, f->len)) { free(f); continue; }
+		mb = sgIP_memblock_allocHW(14, f->len - 14);
+		if(mb) {
+			sgIP_memblock_CopyFromLinear(mb, f->data, 0, f->len);
+			if(rx_batch) {
+				mb->nextpacket=0; if(bt) bt->nextpacket=mb; else bh=mb; bt=mb;
+				if(++bn>=rx_batch) { sgIP_Hub_ReceiveHardwarePackets(hw,bh); bh=bt=0; bn=0; }
+			} else sgIP_Hub_ReceiveHardwarePacket(hw, mb);
+		}
+		free(f);
+	}
+	if(bh) sgIP_Hub_ReceiveHardwarePackets(hw,bh);
+}
+
+void pump(int ms) {
+	while(ms-- > 0) {
+		now_ms++;
+		deliver();
+		if(now_ms % 50 == 0) sgIP_Timer(50);
+	}
+}
+void sgIP_IntrWaitEvent() { pump(1); }
+
+void net_init(void) {
+	sgIP_Init();
+	hw = sgIP_Hub_AddHardwareInterface(fake_tx, fake_init);
+	pump(100);
+}
+
+struct sockaddr_in mkaddr(int port) {
+	struct sockaddr_in a;
+	memset(&a,0,sizeof(a));
+	a.sin_family = AF_INET; a.sin_port = htons(port); a.sin_addr.s_addr = hw->ipaddr;
+	return a;
+}
+
+int tcp_pair(int port, int * cs, int * ss) {
+	struct sockaddr_in a = mkaddr(port), pa;
+	int pl = sizeof(pa);
+	int ls = socket(AF_INET, SOCK_STREAM, 0);
+	bind(ls,(struct sockaddr*)&a,sizeof(a));
+	listen(ls,4);
+	*cs = socket(AF_INET, SOCK_STREAM, 0);
+	if(connect(*cs,(struct sockaddr*)&a,sizeof(a))) { *ss=-1; return ls; }
+	*ss = accept(ls,(struct sockaddr*)&pa,&pl);
+	return ls;
+}
+
+void inject_ack(sgIP_Record_TCP * c, unsigned long ack, int win, int nsack, const unsigned long * sack) {
+	int i, ol = nsack ? 4+8*nsack : 0;
+	sgIP_memblock * mb = sgIP_memblock_alloc(20+ol);
+	sgIP_Header_TCP * t = (sgIP_Header_TCP *)mb->datastart;
+	unsigned char * o = (unsigned char*)mb->datastart+20;
+	memset(t,0,20);
+	t->srcport=c->destport; t->destport=c->srcport;
+	t->seqnum=htonl(c->ack); t->acknum=htonl(ack);
+	t->dataofs_=((20+ol)/4)<<4; t->tcpflags=SGIP_TCP_FLAG_ACK; t->window=htons(win);
+	if(nsack) {
+		o[0]=1; o[1]=1; o[2]=5; o[3]=2+8*nsack;
+		for(i=0;i<nsack*2;i++) { unsigned long v=sack[i]; o[4+i*4]=v>>24; o[5+i*4]=v>>16; o[6+i*4]=v>>8; o[7+i*4]=v; }
+	}
+	sgIP_TCP_ReceivePacket(mb, c->destip, c->srcip);
+}
+
+void print_tcpinfo(const char * n, int s) {
+	struct tcp_info ti;
+	int l=sizeof(ti);
+	if(getsockopt(s,SOL_TCP,TCP_INFO,&ti,&l)) { printf("%s: TCP_INFO failed\n",n); return; }
+	printf("%s: rto=%uus rtt=%uus cwnd=%u ssthresh=%u retrans=%u segs_out=%u data_segs_out=%u ws=%d/%d\n",n,
+		(unsigned)ti.tcpi_rto,(unsigned)ti.tcpi_rtt,(unsigned)ti.tcpi_snd_cwnd,(unsigned)ti.tcpi_snd_ssthresh,(unsigned)ti.tcpi_total_retrans,
+		(unsigned)ti.tcpi_segs_out,(unsigned)ti.tcpi_data_segs_out,ti.tcpi_snd_wscale,ti.tcpi_rcv_wscale);
+}
@@ -0,0 +1,50 @@
+// host harness for the arm9 sgIP stack: a simulated link takes the place of the wifi hardware.
+//  the stack and one test run in one process, on simulated time that only pump() advances.
+#ifndef HARNESS_H
+#define HARNESS_H
+
+#include "sgIP.h"
+#include "sgIP_ICMP.h"
+#include "netinet/tcp.h"
+
+// the link.  frames queue behind a bandwidth limit (one that would wait more than txq_ms is
+//  dropped, like a full tx ring), arrive latency_ms after they're sent, and ip frames are lost at
+//  random with loss_permille.  everything sent comes back to the same interface.
+extern unsigned int now_ms;
+extern int loss_permille, latency_ms, bw_bytes_per_ms, txq_ms;
+extern int rx_batch;		// >0: hand arrivals to the hub in lists of up to this many
+extern int drop_srcport;	// >=0: lose every tcp frame sent from this port
+extern void (*tx_hook)(unsigned char * frame, int len);	// sees every frame the stack sends
+extern int (*rx_hook)(unsigned char * frame, int len);	// sees arrivals first; nonzero keeps one from the stack
+
+// what the stack sent
+extern int frames_tx, frames_dropped, frames_oversize, hw_syncs;
+extern int tcp_data_segs, tcp_pure_acks, tcp_opt_data_segs;
+// sgIP_malloc blocks and bytes outstanding
+extern int malloc_count, malloc_bytes;
+extern int malloc_limit;	// >0: sgIP_malloc fails rather than have more bytes than this outstanding
+
+extern sgIP_Hub_HWInterface * hw;
+extern sgIP_socket_data socketlist[];
+
+void net_init(void);
+void pump(int ms);
+unsigned int rnd(void);
+void rnd_seed(unsigned int seed);
+double host_ns(void);
+
+// put a frame the test built on the link, to arrive delay ms from now (it can be lost too)
+void link_queue(const unsigned char * frame, int len, int delay);
+// internet checksum over big-endian words, ready to store high byte first
+unsigned short csum16(const unsigned char * d, int len, unsigned int sum);
+
+struct sockaddr_in mkaddr(int port);
+// listen on port and connect to it; returns the listening socket
+int tcp_pair(int port, int * cs, int * ss);
+#define tcp_rec(s) ((sgIP_Record_TCP *)socketlist[(s)-1].conn_ptr)
+#define udp_rec(s) ((sgIP_Record_UDP *)socketlist[(s)-1].conn_ptr)
+// hand rec an ack from its peer, with nsack SACK blocks (start,end pairs in sack)
+void inject_ack(sgIP_Record_TCP * rec, unsigned long ack, int win, int nsack, const unsigned long * sack);
+void print_tcpinfo(const char * name, int s);
+
+#endif
@@ -0,0 +1,21 @@
+// forced in front of every file built here (-include).
+//
+// the stack is written for the ARM9, where int, long and pointers are all 32 bits, and it needs
+//  long to be 32 bits: addresses, sequence numbers and header fields are unsigned long.  the
+//  Makefile builds with -m32 where the compiler can; where it can't, long is narrowed below.  that
+//  keeps the stack's arithmetic and header layouts right, but it can't make code that keeps a
+//  pointer in a long work, and anything that means exactly 32 bits has to say uint32_t.
+#include <stdint.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/select.h>
+#if __SIZEOF_LONG__ != 4
+#define long int
+#endif
+
+// SGIP_ENTROPY() reads DS timer registers by default
+#define SGIP_ENTROPY() ((unsigned long)clock())
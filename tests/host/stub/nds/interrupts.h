@@ -0,0 +1,6 @@
+// libnds stand-in: the host build runs on one thread, so there is nothing to mask
+#ifndef STUB_INTERRUPTS_H
+#define STUB_INTERRUPTS_H
+static inline int enterCriticalSection(void){return 0;}
+static inline void leaveCriticalSection(int x){(void)x;}
+#endif
@@ -0,0 +1,75 @@
+// SO_RCVBUF/SO_SNDBUF: what a socket costs for each buffer size, transfers through small and big
+//  buffers, and buffers grown and shrunk while data is moving.
+#include "harness.h"
+
+static int buf_xfer(int cs, int ss, int total, int resize_at, int newsize) {
+	unsigned long one=1;
+	int sent=0, rcvd=0, bad=0, n, r, i;
+	unsigned int t0=now_ms;
+	char buf[4096];
+	ioctl(cs,FIONBIO,&one); ioctl(ss,FIONBIO,&one);
+	while(rcvd<total) {
+		if(sent<total) {
+			n=total-sent; if(n>1000) n=1000;
+			for(i=0;i<n;i++) buf[i]=(char)((sent+i)*7+3);
+			r=send(cs,buf,n,0); if(r>0) sent+=r;
+		}
+		r=recv(ss,buf,sizeof(buf),0);
+		if(r>0) { for(i=0;i<r;i++) if(buf[i]!=(char)((rcvd+i)*7+3)) bad++; rcvd+=r; }
+		if(resize_at && rcvd>=resize_at) {
+			setsockopt(ss,SOL_SOCKET,SO_RCVBUF,&newsize,sizeof(int));
+			setsockopt(cs,SOL_SOCKET,SO_SNDBUF,&newsize,sizeof(int));
+			resize_at=0;
+		}
+		pump(1);
+		if(now_ms-t0>600000) { printf("  timed out: %d sent, %d received\n",sent,rcvd); return 1; }
+	}
+	printf("  %d bytes in %u ms (%d KB/s), %d bad, rx buffer %d, tx limit %d\n",total,now_ms-t0,
+		(int)((double)total*1000/1024/(now_ms-t0)),bad,tcp_rec(ss)->rx.size,tcp_rec(cs)->buf_tx_size);
+	return bad?1:0;
+}
+
+int main(void) {
+	static const int sizes[4]={1024,8192,65536,262144};
+	int heap[4];
+	int b0, ls, cs, ss, k, ns, fails=0;
+	struct sockaddr_in a, pa;
+	int pl=sizeof(pa);
+	net_init();
+	a=mkaddr(80);
+	printf("sizeof(sgIP_Record_TCP)=%d\n",(int)sizeof(sgIP_Record_TCP));
+	b0=malloc_bytes;
+	ls=socket(AF_INET,SOCK_STREAM,0);
+	bind(ls,(struct sockaddr*)&a,sizeof(a)); listen(ls,4);
+	printf("listening socket: %d bytes of heap\n",malloc_bytes-b0);
+	if(malloc_bytes-b0>(int)sizeof(sgIP_Record_TCP)+256) fails++; // no buffers for a socket that moves no data
+	for(k=0;k<4;k++) {
+		setsockopt(ls,SOL_SOCKET,SO_RCVBUF,&sizes[k],sizeof(int));
+		cs=socket(AF_INET,SOCK_STREAM,0);
+		setsockopt(cs,SOL_SOCKET,SO_SNDBUF,&sizes[k],sizeof(int));
+		b0=malloc_bytes;
+		connect(cs,(struct sockaddr*)&a,sizeof(a));
+		ss=accept(ls,(struct sockaddr*)&pa,&pl);
+		heap[k]=malloc_bytes-b0;
+		printf("buffers %d: the pair holds %d bytes of heap\n",sizes[k],heap[k]);
+		fails+=buf_xfer(cs,ss,200000,0,0);
+		closesocket(cs); closesocket(ss); pump(1000);
+	}
+	if(heap[0]>=heap[1] || heap[1]>=heap[2]) fails++;
+
+	ns=1024;
+	setsockopt(ls,SOL_SOCKET,SO_RCVBUF,&ns,sizeof(int));
+	cs=socket(AF_INET,SOCK_STREAM,0);
+	connect(cs,(struct sockaddr*)&a,sizeof(a));
+	ss=accept(ls,(struct sockaddr*)&pa,&pl);
+	printf("grow 1024 -> 16384 mid-transfer:\n");
+	fails+=buf_xfer(cs,ss,200000,50000,16384);
+	if(tcp_rec(ss)->rx.size<16384) fails++;
+	printf("shrink 16384 -> 600 mid-transfer:\n");
+	fails+=buf_xfer(cs,ss,200000,50000,600);
+	if(tcp_rec(ss)->rx.size>=16384) fails++;
+	closesocket(cs); closesocket(ss); closesocket(ls);
+	pump(SGIP_TCP_TIMEMS_2MSL+10000);
+	printf("heap after close: %d bytes\n",malloc_bytes);
+	return fails?1:0;
+}
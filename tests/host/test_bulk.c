@@ -0,0 +1,50 @@
+// bulk transfer between two sockets of this stack, clean and at 5% loss: everything arrives, in
+//  order, and congestion control keeps a lossy transfer moving at a reasonable rate.  then again
+//  with arrivals handed over in batches, and a burst of segments that arrives as one batch has to be
+//  answered with a single ack.
+#include "harness.h"
+#include "bulk.h"
+
+// 4 full segments sent back to back arrive in the same millisecond; how many pure acks go back
+static int burst_acks(int port) {
+	int ls, cs, ss, n, one=1;
+	char buf[4*1420]; // within the default receive window
+	ls=tcp_pair(port,&cs,&ss);
+	setsockopt(cs,SOL_TCP,TCP_NODELAY,&one,sizeof(int));
+	tcp_rec(cs)->cwnd=sizeof(buf); // the whole burst goes out at once
+	pump(500);
+	memset(buf,1,sizeof(buf));
+	bw_bytes_per_ms=20000;
+	n=tcp_pure_acks;
+	send(cs,buf,sizeof(buf),0);
+	pump(20);
+	n=tcp_pure_acks-n;
+	bw_bytes_per_ms=250;
+	closesocket(cs); closesocket(ss); closesocket(ls);
+	pump(SGIP_TCP_TIMEMS_2MSL+2000);
+	return n;
+}
+
+int main(void) {
+	int fails=0, kbs, acks, batched;
+	net_init();
+	rnd_seed(3);
+	kbs=bulk(80,200000,0,1000);
+	printf("no loss: %d KB/s\n",kbs);
+	if(kbs<150) fails++;
+	kbs=bulk(80,200000,50,1000);
+	printf("5%% loss: %d KB/s\n",kbs);
+	if(kbs<50) fails++;
+	rx_batch=8;
+	kbs=bulk(80,200000,50,1000);
+	printf("5%% loss, batches of 8: %d KB/s\n",kbs);
+	if(kbs<50) fails++;
+	rx_batch=0;
+	acks=burst_acks(81);
+	rx_batch=8;
+	batched=burst_acks(82);
+	rx_batch=0;
+	printf("pure acks for a burst of 4 segments: %d one at a time, %d as one batch\n",acks,batched);
+	if(batched!=1 || acks<=batched) fails++;
+	return fails?1:0;
+}
@@ -0,0 +1,101 @@
+// checksum kernels against a byte-pair reference: ChecksumBuf and CopyChecksumBuf from every
+//  alignment, and IPChecksum over random chains with odd-length and empty blocks, misaligned
+//  block starts and nonzero start offsets.
+#include "harness.h"
+
+// one's complement sum of 16bit words in host order, pairs counted from the first byte
+static unsigned int ref_sum(const unsigned char * p, int len) {
+	unsigned int sum=0;
+	unsigned short w;
+	unsigned char last[2]={0,0};
+	int i;
+	for(i=0;i+1<len;i+=2) { memcpy(&w,p+i,2); sum+=w; }
+	if(len&1) { last[0]=p[len-1]; memcpy(&w,last,2); sum+=w; }
+	while(sum>>16) sum=(sum&0xFFFF)+(sum>>16);
+	return sum;
+}
+// 0 and 0xFFFF are the same one's complement value
+static int same_sum(unsigned int a, unsigned int b) { return a%0xFFFF==b%0xFFFF; }
+
+static void fill(unsigned char * p, int len) {
+	int i;
+	for(i=0;i<len;i++) p[i]=rnd();
+	if(len>=8 && (rnd()&3)==0) memset(p,0xFF,len); // sums that carry all the way round
+}
+
+static int test_buf(void) {
+	static unsigned char src[2100], dst[2100];
+	int ofs, dofs, len, i, k, bad=0, cases=0;
+	unsigned int sum;
+	for(ofs=0;ofs<8;ofs++)
+		for(k=0;k<300;k++) {
+			len=k<80 ? k : (int)(rnd()%2000);
+			fill(src+ofs,len);
+			sum=sgIP_memblock_ChecksumBuf(src+ofs,len);
+			cases++;
+			if(!same_sum(sum,ref_sum(src+ofs,len))) {
+				if(bad++<5) printf("ChecksumBuf: offset %d length %d: %04x, want %04x\n",ofs,len,sum,ref_sum(src+ofs,len));
+			}
+			for(dofs=0;dofs<8;dofs++) {
+				memset(dst,0xA5,sizeof(dst));
+				sum=sgIP_memblock_CopyChecksumBuf(dst+dofs,src+ofs,len);
+				cases++;
+				for(i=0;i<dofs;i++) if(dst[i]!=0xA5) break;
+				if(i<dofs || dst[dofs+len]!=0xA5 || memcmp(dst+dofs,src+ofs,len) || !same_sum(sum,ref_sum(src+ofs,len))) {
+					if(bad++<5) printf("CopyChecksumBuf: from offset %d to %d, length %d: %04x, want %04x%s\n",ofs,dofs,len,sum,
+						ref_sum(src+ofs,len),memcmp(dst+dofs,src+ofs,len)?", copy wrong":"");
+				}
+			}
+		}
+	printf("ChecksumBuf/CopyChecksumBuf: %d cases, %d wrong\n",cases,bad);
+	return bad;
+}
+
+// a chain of up to 6 blocks of 0..300 bytes, each starting 0..3 bytes into its buffer, the same
+//  bytes laid out linearly in lin.  the 2nd block is empty after an odd first one every so often.
+static sgIP_memblock * random_chain(unsigned char * lin, int * total) {
+	sgIP_memblock * head=0, * mb;
+	int nb=1+rnd()%6, b, len, skew, force=(rnd()&3)==0;
+	*total=0;
+	for(b=0;b<nb;b++) {
+		len=rnd()%301;
+		if(force && b==0) len|=1;
+		if(force && b==1) len=0;
+		skew=rnd()&3;
+		mb=sgIP_memblock_alloc(len+skew);
+		sgIP_memblock_exposeheader(mb,-skew);
+		fill((unsigned char *)mb->datastart,len);
+		memcpy(lin+*total,mb->datastart,len);
+		*total+=len;
+		if(head) sgIP_memblock_append(head,mb); else head=mb;
+	}
+	return head;
+}
+
+static int test_chain(void) {
+	static unsigned char lin[6*301];
+	sgIP_memblock * mb;
+	int k, total, start, len, bad=0;
+	unsigned int sum;
+	for(k=0;k<20000;k++) {
+		mb=random_chain(lin,&total);
+		start=total ? rnd()%(total+1) : 0;
+		len=total-start;
+		if(len && (rnd()&1)) len=rnd()%(len+1);
+		sum=sgIP_memblock_IPChecksum(mb,start,len);
+		if(!same_sum(sum,ref_sum(lin+start,len))) {
+			if(bad++<5) printf("IPChecksum: %d bytes from %d of a %d byte chain: %04x, want %04x\n",len,start,total,sum,ref_sum(lin+start,len));
+		}
+		sgIP_memblock_free(mb);
+	}
+	printf("IPChecksum: %d chains, %d wrong\n",k,bad);
+	return bad;
+}
+
+int main(void) {
+	int fails=0;
+	net_init();
+	fails+=test_buf();
+	fails+=test_chain();
+	return fails?1:0;
+}
@@ -0,0 +1,58 @@
+// connection lookup: every record is found by its own 4-tuple and nothing else, a connection beats
+//  a listener on the same port, only SYNs reach listeners, and freed records are gone.
+#include "harness.h"
+
+sgIP_Record_TCP * sgIP_TCP_FindRecord(unsigned long srcip, unsigned long destip, unsigned short srcport, unsigned short destport, int flags);
+void sgIP_TCP_HashInsert(sgIP_Record_TCP * rec, int which);
+
+#define N 1000
+#define LOCALIP 0x0100000a
+
+static sgIP_Record_TCP * conn(int i) {
+	sgIP_Record_TCP * r=sgIP_TCP_AllocRecord();
+	r->srcip=LOCALIP; r->srcport=htons(40000+i%500);
+	r->destip=0x0200000a+((i/500)<<24); r->destport=htons(80+i%7);
+	r->tcpstate=SGIP_TCP_STATE_ESTABLISHED;
+	sgIP_TCP_HashInsert(r,SGIP_TCP_HASHED_CONN);
+	sgIP_TCP_HashInsert(r,SGIP_TCP_HASHED_BIND);
+	return r;
+}
+
+int main(void) {
+	sgIP_Record_TCP * r[N], * l, * f;
+	int i, fails=0, wrong=0, stray=0;
+	net_init();
+	for(i=0;i<N;i++) r[i]=conn(i);
+	for(i=0;i<N;i++) {
+		if(sgIP_TCP_FindRecord(r[i]->destip,LOCALIP,r[i]->destport,r[i]->srcport,SGIP_TCP_FLAG_ACK)!=r[i]) wrong++;
+		if(sgIP_TCP_FindRecord(r[i]->destip,LOCALIP,htons(ntohs(r[i]->destport)+7),r[i]->srcport,SGIP_TCP_FLAG_ACK)) stray++;
+		if(sgIP_TCP_FindRecord(r[i]->destip+(9<<24),LOCALIP,r[i]->destport,r[i]->srcport,SGIP_TCP_FLAG_ACK)) stray++;
+	}
+	printf("%d connections: %d not found by their own 4-tuple, %d found by someone else's\n",N,wrong,stray);
+	if(wrong || stray) fails++;
+
+	l=sgIP_TCP_AllocRecord();
+	l->srcip=0; l->srcport=r[0]->srcport; l->tcpstate=SGIP_TCP_STATE_LISTEN;
+	sgIP_TCP_HashInsert(l,SGIP_TCP_HASHED_LISTEN);
+	f=sgIP_TCP_FindRecord(r[0]->destip,LOCALIP,r[0]->destport,r[0]->srcport,SGIP_TCP_FLAG_SYN);
+	printf("SYN for an existing connection: %s\n",f==r[0]?"connection":f==l?"listener":"nothing");
+	if(f!=r[0]) fails++;
+	f=sgIP_TCP_FindRecord(0x0300000a,LOCALIP,htons(1234),r[0]->srcport,SGIP_TCP_FLAG_SYN);
+	printf("SYN from a new peer: %s\n",f==l?"listener":"not the listener");
+	if(f!=l) fails++;
+	f=sgIP_TCP_FindRecord(0x0300000a,LOCALIP,htons(1234),r[0]->srcport,SGIP_TCP_FLAG_ACK);
+	printf("ACK from a new peer: %s\n",f?"found a record":"nothing");
+	if(f) fails++;
+
+	for(i=0;i<N;i+=2) sgIP_TCP_FreeRecord(r[i]);
+	wrong=stray=0;
+	for(i=0;i<N;i++) {
+		f=sgIP_TCP_FindRecord(0x0200000a+((i/500)<<24),LOCALIP,htons(80+i%7),htons(40000+i%500),SGIP_TCP_FLAG_ACK);
+		if(i&1) { if(f!=r[i]) wrong++; } else if(f) stray++;
+	}
+	printf("after freeing half: %d survivors lost, %d freed records still found\n",wrong,stray);
+	if(wrong || stray) fails++;
+	for(i=1;i<N;i+=2) sgIP_TCP_FreeRecord(r[i]);
+	sgIP_TCP_FreeRecord(l);
+	return fails?1:0;
+}
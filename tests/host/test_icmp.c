@@ -0,0 +1,42 @@
+// echo requests of odd and even sizes, random and all-zero payloads; every reply has to carry
+//  valid IP and ICMP checksums (the reply's is patched from the request's, not recomputed).
+#include "harness.h"
+
+static int replies, badsum;
+static void icmp_check(unsigned char * d, int len) {
+	unsigned char * ip=d+14;
+	int ihl, tot;
+	if(len<14+20+8 || d[12]!=8 || d[13]!=0 || ip[9]!=1) return;
+	ihl=(ip[0]&15)*4; tot=(ip[2]<<8)|ip[3];
+	if(ip[ihl]!=0) return; // echo replies only
+	replies++;
+	if(csum16(ip,ihl,0) || csum16(ip+ihl,tot-ihl,0)) badsum++;
+}
+
+int main(void) {
+	static const int sizes[7]={0,1,2,3,56,57,1000};
+	int k, i, zero, dl, before, fails=0;
+	unsigned short c;
+	sgIP_memblock * mb;
+	unsigned char * p;
+	net_init();
+	tx_hook=icmp_check;
+	for(k=0;k<7;k++)
+		for(zero=0;zero<2;zero++) {
+			dl=sizes[k];
+			mb=sgIP_memblock_alloc(34+8+dl);
+			sgIP_memblock_exposeheader(mb,-34);
+			p=(unsigned char*)mb->datastart;
+			p[0]=8; p[1]=0; p[2]=p[3]=0;
+			for(i=4;i<8+dl;i++) p[i]=zero?0:rnd();
+			c=~sgIP_memblock_IPChecksum(mb,0,8+dl); if(!c) c=0xFFFF;
+			memcpy(p+2,&c,2);
+			before=replies;
+			sgIP_ICMP_ReceivePacket(mb,hw->ipaddr,hw->ipaddr);
+			for(i=0;i<100 && replies==before;i++) pump(1); // the first waits on ARP
+			if(replies==before) { printf("no reply to a %d byte echo request\n",dl); fails++; }
+		}
+	tx_hook=0;
+	printf("%d echo replies, %d with a bad checksum\n",replies,badsum);
+	return (fails || badsum)?1:0;
+}
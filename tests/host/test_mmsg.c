@@ -0,0 +1,61 @@
+// sendmmsg/recvmmsg: a batch goes out with one hardware sync, comes back in order with lengths
+//  and addresses filled in, an empty queue reports EWOULDBLOCK, and a short buffer truncates just
+//  its own datagram.
+#include "harness.h"
+
+int main(void) {
+	int rx, tx, i, n, ok, fl, s0, s1, s2, fails=0;
+	unsigned long one=1;
+	char bufs[16][600], big[600];
+	struct sockaddr_in ra, d, f, from[16];
+	struct mmsghdr m[16];
+	net_init();
+	ra=mkaddr(5100);
+	rx=socket(AF_INET,SOCK_DGRAM,0);
+	bind(rx,(struct sockaddr*)&ra,sizeof(ra));
+	ioctl(rx,FIONBIO,&one);
+	tx=socket(AF_INET,SOCK_DGRAM,0);
+	ioctl(tx,FIONBIO,&one);
+	d=mkaddr(5100);
+	memset(big,0,sizeof(big));
+	sendto(tx,big,1,0,(struct sockaddr*)&d,sizeof(d)); // resolve our address first
+	pump(50);
+	fl=sizeof(f); recvfrom(rx,big,sizeof(big),0,(struct sockaddr*)&f,&fl);
+
+	for(i=0;i<8;i++) {
+		memset(bufs[i],i+1,100+i*50);
+		m[i].msg_data=bufs[i]; m[i].msg_datalen=100+i*50;
+		m[i].msg_addr=(struct sockaddr*)&d; m[i].msg_addrlen=sizeof(d); m[i].msg_len=-1;
+	}
+	s0=hw_syncs;
+	n=sendmmsg(tx,m,8,0);
+	s1=hw_syncs;
+	for(i=0;i<8;i++) sendto(tx,bufs[i],100+i*50,0,(struct sockaddr*)&d,sizeof(d));
+	s2=hw_syncs;
+	printf("sendmmsg of 8: %d sent, %d syncs (8 sendto: %d), last msg_len %d\n",n,s1-s0,s2-s1,m[7].msg_len);
+	if(n!=8 || s1-s0!=1 || m[7].msg_len!=450) fails++;
+	pump(50);
+
+	for(i=0;i<16;i++) {
+		m[i].msg_data=bufs[i]; m[i].msg_datalen=600;
+		m[i].msg_addr=(struct sockaddr*)&from[i]; m[i].msg_addrlen=sizeof(from[i]); m[i].msg_len=-1;
+	}
+	n=recvmmsg(rx,m,16,0);
+	ok=1;
+	for(i=0;i<n;i++)
+		if(m[i].msg_len!=100+(i%8)*50 || bufs[i][0]!=(i%8)+1 || from[i].sin_port==0 || m[i].msg_addrlen!=sizeof(struct sockaddr_in)) ok=0;
+	printf("recvmmsg of 16: %d received%s\n",n,ok?"":", some wrong");
+	if(n!=16 || !ok) fails++;
+	n=recvmmsg(rx,m,16,0);
+	printf("recvmmsg on an empty queue: %d, errno %d\n",n,errno);
+	if(n!=-1 || errno!=EWOULDBLOCK) fails++;
+
+	for(i=0;i<3;i++) sendto(tx,big,300,0,(struct sockaddr*)&d,sizeof(d));
+	pump(50);
+	m[0].msg_datalen=100;
+	n=recvmmsg(rx,m,4,0);
+	printf("100 byte first buffer: %d received, lengths %d %d %d\n",n,m[0].msg_len,m[1].msg_len,m[2].msg_len);
+	if(n!=3 || m[0].msg_len!=100 || m[1].msg_len!=300) fails++;
+	closesocket(rx); closesocket(tx);
+	return fails?1:0;
+}
@@ -0,0 +1,104 @@
+// Nagle, TCP_NODELAY and TCP_CORK: small writes, latency and segment counts, and a corked
+//  partial segment held until it's uncorked or the socket is shut down.
+#include "harness.h"
+
+static int nagle_pair(int * pcs, int * pss, int nodelay, int cork) {
+	static int ls=0;
+	struct sockaddr_in a=mkaddr(81), pa;
+	int pl=sizeof(pa);
+	unsigned long one=1;
+	if(!ls) { ls=socket(AF_INET,SOCK_STREAM,0); bind(ls,(struct sockaddr*)&a,sizeof(a)); listen(ls,4); }
+	*pcs=socket(AF_INET,SOCK_STREAM,0);
+	if(connect(*pcs,(struct sockaddr*)&a,sizeof(a))) return 1;
+	*pss=accept(ls,(struct sockaddr*)&pa,&pl);
+	ioctl(*pcs,FIONBIO,&one); ioctl(*pss,FIONBIO,&one);
+	if(nodelay) setsockopt(*pcs,SOL_TCP,TCP_NODELAY,&nodelay,sizeof(int));
+	if(cork) setsockopt(*pcs,SOL_TCP,TCP_CORK,&cork,sizeof(int));
+	return 0;
+}
+static int wait_recv(int s, int want) {
+	char buf[256];
+	int got=0, r;
+	unsigned int t0=now_ms;
+	while(got<want) {
+		r=recv(s,buf,sizeof(buf),0);
+		if(r>0) got+=r; else pump(1);
+		if(now_ms-t0>5000) return 1;
+	}
+	return 0;
+}
+// ping-pong of small messages; returns the average round trip in ms*100, -1 on a stall
+static int nagle_rtt(int nodelay) {
+	int cs, ss, i, n=50;
+	unsigned int t0, tot=0;
+	if(nagle_pair(&cs,&ss,nodelay,0)) return -1;
+	for(i=0;i<n;i++) {
+		t0=now_ms;
+		send(cs,"ping",4,0);
+		if(wait_recv(ss,4)) return -1;
+		send(ss,"pong",4,0);
+		if(wait_recv(cs,4)) return -1;
+		tot+=now_ms-t0;
+	}
+	printf("ping-pong, nodelay %d: %u.%02u ms average over %d\n",nodelay,tot/n,(tot*100/n)%100,n);
+	closesocket(cs); closesocket(ss); pump(500);
+	return tot*100/n;
+}
+// many tiny writes; returns the number of data segments they took, -1 on a stall
+static int nagle_tiny(int nodelay, int cork, int total) {
+	int cs, ss, d0=tcp_data_segs, sent=0, rcvd=0, r, blocked, z=0;
+	unsigned int t0=now_ms;
+	char buf[4096];
+	if(nagle_pair(&cs,&ss,nodelay,cork)) return -1;
+	while(rcvd<total) {
+		blocked=0;
+		if(sent<total) {
+			r=send(cs,"0123456789",10,0);
+			if(r>0) sent+=r; else blocked=1;
+			if(sent>=total && cork) setsockopt(cs,SOL_TCP,TCP_CORK,&z,sizeof(int));
+		}
+		r=recv(ss,buf,sizeof(buf),0); if(r>0) rcvd+=r;
+		if(blocked || !(sent%100) || sent>=total) pump(1);
+		if(now_ms-t0>60000) { printf("tiny writes stalled: %d sent, %d received\n",sent,rcvd); return -1; }
+	}
+	printf("tiny writes, nodelay %d cork %d: %d bytes in %u ms, %d data segments\n",nodelay,cork,total,now_ms-t0,tcp_data_segs-d0);
+	closesocket(cs); closesocket(ss); pump(500);
+	return tcp_data_segs-d0;
+}
+// cork holds a partial segment until uncorked; shutdown flushes it
+static int nagle_cork(void) {
+	int cs, ss, r, v, l=sizeof(v), z=0, one=1, fails=0;
+	char buf[256];
+	if(nagle_pair(&cs,&ss,0,1)) return 1;
+	send(cs,"hdr",3,0); pump(500);
+	r=recv(ss,buf,sizeof(buf),0);
+	getsockopt(cs,SOL_TCP,TCP_CORK,&v,&l);
+	printf("corked 3 bytes: after 500 ms the receiver has %d (TCP_CORK reads %d)\n",r,v);
+	if(r>0 || !v) fails++;
+	send(cs,"body",4,0);
+	setsockopt(cs,SOL_TCP,TCP_CORK,&z,sizeof(int)); pump(50);
+	r=recv(ss,buf,sizeof(buf),0);
+	printf("uncorked: the receiver has %d\n",r);
+	if(r!=7) fails++;
+	setsockopt(cs,SOL_TCP,TCP_CORK,&one,sizeof(int));
+	send(cs,"tail",4,0); shutdown(cs,1); pump(200);
+	r=recv(ss,buf,sizeof(buf),0);
+	printf("corked, then shut down: the receiver has %d\n",r);
+	if(r!=4) fails++;
+	closesocket(cs); closesocket(ss); pump(500);
+	return fails;
+}
+
+int main(void) {
+	int rtt_nagle, rtt_nodelay, nagle, nodelay, cork, fails=0;
+	net_init();
+	rtt_nagle=nagle_rtt(0);
+	rtt_nodelay=nagle_rtt(1);
+	if(rtt_nagle<0 || rtt_nodelay<0 || rtt_nodelay>rtt_nagle) fails++;
+	nagle=nagle_tiny(0,0,20000);
+	nodelay=nagle_tiny(1,0,20000);
+	cork=nagle_tiny(0,1,20000);
+	if(nagle<0 || nodelay<0 || cork<0 || nagle>=nodelay || cork>nagle) fails++;
+	fails+=nagle_cork();
+	return fails?1:0;
+}
@@ -0,0 +1,46 @@
+// out-of-order queue: segments past a hole are held, including duplicates and overlaps, and
+//  delivered in order once the hole is filled; nothing is left allocated afterwards.
+#include "harness.h"
+
+static void inject(sgIP_Record_TCP * srv, unsigned long seq, int len, int base) {
+	int i;
+	sgIP_memblock * mb = sgIP_memblock_alloc(20+len);
+	sgIP_Header_TCP * t = (sgIP_Header_TCP *)mb->datastart;
+	memset(t,0,20);
+	t->srcport=srv->destport; t->destport=srv->srcport;
+	t->seqnum=htonl(seq); t->acknum=htonl(srv->sequence);
+	t->dataofs_=5<<4; t->tcpflags=SGIP_TCP_FLAG_ACK; t->window=htons(1400);
+	for(i=0;i<len;i++) mb->datastart[20+i]=(char)(base+i);
+	sgIP_TCP_ReceivePacket(mb, srv->destip, srv->srcip);
+}
+
+int main(void) {
+	int cs, ss, ls, i, r, adv, bad=0, fails=0, mc0;
+	sgIP_Record_TCP * srv;
+	unsigned long a0;
+	char buf[2000];
+	net_init();
+	ls=tcp_pair(81,&cs,&ss);
+	srv=tcp_rec(ss);
+	a0=srv->ack; mc0=malloc_count;
+	inject(srv,a0+500,500,500);
+	inject(srv,a0+1000,400,1000);
+	inject(srv,a0+500,300,500); // duplicate of part of what's queued
+	inject(srv,a0+800,400,800); // overlaps both
+	printf("queued past a hole: ack advanced %d\n",(int)(srv->ack-a0));
+	if(srv->ack!=a0) fails++;
+	inject(srv,a0,600,0); // fills the hole and overlaps the queue
+	adv=(int)(srv->ack-a0);
+	printf("hole filled: ack advanced %d, queue %s\n",adv,srv->rxooo?"not empty":"empty");
+	if(adv!=1400 || srv->rxooo) fails++;
+	r=recv(ss,buf,sizeof(buf),0);
+	for(i=0;i<r;i++) if(buf[i]!=(char)i) bad++;
+	printf("received %d bytes, %d wrong\n",r,bad);
+	if(r!=1400 || bad) fails++;
+	inject(srv,srv->ack+100,100,0); // left queued at close
+	closesocket(cs); closesocket(ss); closesocket(ls);
+	pump(200);
+	printf("malloc_count after close %d (before %d)\n",malloc_count,mc0);
+	if(malloc_count!=mc0) fails++;
+	return fails?1:0;
+}
@@ -0,0 +1,36 @@
+// TCP options on data segments: both ends send full segments over a lossy link, so data carries
+//  SACK blocks for what each side holds out of order.  no IP datagram may come out over the MTU.
+#include "harness.h"
+
+int main(void) {
+	int ls, cs, ss, i, k, n, r, s[2], sent[2]={0,0}, rcvd[2]={0,0}, bad=0, total=200000;
+	unsigned long one=1;
+	unsigned int t0;
+	char buf[4096];
+	net_init();
+	ls=tcp_pair(81,&cs,&ss);
+	if(ss<0) { printf("connect failed\n"); return 1; }
+	ioctl(cs,FIONBIO,&one); ioctl(ss,FIONBIO,&one);
+	s[0]=cs; s[1]=ss;
+	loss_permille=80;
+	t0=now_ms;
+	while(rcvd[0]<total || rcvd[1]<total) {
+		for(k=0;k<2;k++) {
+			if(sent[k]<total) {
+				n=total-sent[k]; if(n>sizeof(buf)) n=sizeof(buf);
+				for(i=0;i<n;i++) buf[i]=(char)((sent[k]+i)*(5+k));
+				r=send(s[k],buf,n,0); if(r>0) sent[k]+=r;
+			}
+			r=recv(s[!k],buf,sizeof(buf),0);
+			if(r>0) { for(i=0;i<r;i++) if(buf[i]!=(char)((rcvd[k]+i)*(5+k))) bad++; rcvd[k]+=r; }
+		}
+		pump(1);
+		if(now_ms-t0>600000) { printf("timed out: %d/%d and %d/%d bytes\n",rcvd[0],total,rcvd[1],total); return 1; }
+	}
+	printf("2x%d bytes at 8%% loss in %u ms: %d datagrams over the MTU, %d data segments with options, %d bytes wrong\n",
+		total,now_ms-t0,frames_oversize,tcp_opt_data_segs,bad);
+	loss_permille=0;
+	closesocket(cs); closesocket(ss); closesocket(ls);
+	pump(2000);
+	return (bad || frames_oversize || !tcp_opt_data_segs)?1:0;
+}
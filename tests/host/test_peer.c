@@ -0,0 +1,158 @@
+// window scaling against a scripted receiver: the stack sends to a peer on port 9000 that lives in
+//  rx_hook, offering each window scale in turn with the same effective window.  the stack has to
+//  fill that window (so it scaled the raw value) without overrunning it, and its own window,
+//  with a 256KB SO_RCVBUF, has to be scaled past 64KB.
+#include "harness.h"
+
+#define PEER_PORT 9000
+#define PEER_MAX (1<<20)
+#define PEER_WINDOW 16000
+static struct {
+	int active, sack, mss, wscale, win;
+	unsigned int iss, irs, rcv_nxt, cip;
+	int cport, my_wscale, maxwin;
+	unsigned char cmac[6];
+	unsigned char * got, * data;
+	int segs, dupsegs, acks;
+} peer;
+
+static void peer_emit(int flags, unsigned int seq, const unsigned char * opts, int optlen) {
+	unsigned char f[128], * e=f, * ip=e+14, * t=ip+20;
+	int i, tl=20+optlen, tot=20+tl;
+	unsigned int ps=0, a=peer.rcv_nxt;
+	unsigned short c;
+	memset(f,0,sizeof(f));
+	memcpy(e,peer.cmac,6); memcpy(e+6,peer.cmac,6); e[12]=8; e[13]=0;
+	ip[0]=0x45; ip[2]=tot>>8; ip[3]=tot; ip[8]=64; ip[9]=6;
+	memcpy(ip+12,&peer.cip,4); memcpy(ip+16,&peer.cip,4);
+	c=csum16(ip,20,0); ip[10]=c>>8; ip[11]=c;
+	t[0]=PEER_PORT>>8; t[1]=PEER_PORT&255; t[2]=peer.cport>>8; t[3]=peer.cport;
+	t[4]=seq>>24; t[5]=seq>>16; t[6]=seq>>8; t[7]=seq; t[8]=a>>24; t[9]=a>>16; t[10]=a>>8; t[11]=a;
+	t[12]=(tl/4)<<4; t[13]=flags; t[14]=peer.win>>8; t[15]=peer.win;
+	memcpy(t+20,opts,optlen);
+	for(i=0;i<8;i+=2) ps+=(ip[12+i]<<8)|ip[13+i];
+	ps+=6+tl;
+	c=csum16(t,tl,ps); t[16]=c>>8; t[17]=c;
+	link_queue(f,14+tot,latency_ms); // acks ride a separate, uncongested path back
+}
+
+// ack rcv_nxt, with SACK blocks for up to 3 ranges received above it
+static void peer_ack(void) {
+	unsigned char o[40], * b=o+4;
+	unsigned int i, s, S, E, off=peer.rcv_nxt-peer.irs-1;
+	int n=0, ol=0;
+	if(peer.sack) {
+		for(i=off;i<PEER_MAX && n<3;) {
+			while(i<PEER_MAX && !peer.got[i] && i-off<200000) i++;
+			if(i>=PEER_MAX || !peer.got[i]) break;
+			s=i; while(i<PEER_MAX && peer.got[i]) i++;
+			S=s+peer.irs+1; E=i+peer.irs+1;
+			b[0]=S>>24; b[1]=S>>16; b[2]=S>>8; b[3]=S; b[4]=E>>24; b[5]=E>>16; b[6]=E>>8; b[7]=E;
+			b+=8; n++;
+		}
+		if(n) { o[0]=1; o[1]=1; o[2]=5; o[3]=2+8*n; ol=4+8*n; }
+	}
+	peer.acks++;
+	peer_emit(SGIP_TCP_FLAG_ACK,peer.iss+1,o,ol);
+}
+
+static int peer_intercept(unsigned char * d, int len) {
+	unsigned char * ip=d+14, * t;
+	int i, k, hl, tot, dl, dup, fl;
+	unsigned int seq, off, n;
+	if(len<54 || d[12]!=8 || d[13]!=0 || d[23]!=6) return 0;
+	t=ip+(ip[0]&15)*4;
+	if(((t[2]<<8)|t[3])!=PEER_PORT) return 0;
+	hl=(t[12]>>4)*4; tot=(ip[2]<<8)|ip[3]; dl=tot-(ip[0]&15)*4-hl;
+	seq=(t[4]<<24)|(t[5]<<16)|(t[6]<<8)|t[7];
+	fl=t[13];
+	if(fl&SGIP_TCP_FLAG_SYN) {
+		unsigned char o[12]={2,4,peer.mss>>8,peer.mss&255, 1,1,4,2, 1,3,3,peer.wscale};
+		memcpy(peer.cmac,d+6,6); memcpy(&peer.cip,ip+12,4); peer.cport=(t[0]<<8)|t[1];
+		peer.irs=seq; peer.rcv_nxt=seq+1; peer.iss=77777; peer.active=1;
+		peer.my_wscale=-1; peer.maxwin=0; peer.segs=peer.dupsegs=peer.acks=0;
+		for(k=20;k<hl;k+=(t[k]<2)?1:t[k+1]) { // the stack's own window scale
+			if(t[k]==0) break;
+			if(t[k]==3) peer.my_wscale=t[k+2];
+		}
+		memset(peer.got,0,PEER_MAX);
+		if(!peer.sack) { o[6]=1; o[7]=1; }
+		peer_emit(SGIP_TCP_FLAG_SYN|SGIP_TCP_FLAG_ACK,peer.iss,o,peer.wscale>=0?12:8);
+		return 1;
+	}
+	if(!peer.active) return 1;
+	k=((t[14]<<8)|t[15])<<(peer.my_wscale>=0 && peer.wscale>=0?peer.my_wscale:0);
+	if(k>peer.maxwin) peer.maxwin=k;
+	if(dl>0) {
+		peer.segs++;
+		off=seq-peer.irs-1; dup=1;
+		for(i=0;i<dl && off+i<PEER_MAX;i++) { if(!peer.got[off+i]) dup=0; peer.got[off+i]=1; peer.data[off+i]=t[hl+i]; }
+		if(dup) peer.dupsegs++;
+		n=peer.rcv_nxt-peer.irs-1; while(n<PEER_MAX && peer.got[n]) n++;
+		peer.rcv_nxt=n+peer.irs+1;
+		peer_ack();
+	}
+	return 1;
+}
+
+// send total bytes to the peer, 4KB at a time; fails on a stall, a bad byte or a window
+//  overrun, or if the flight never got near the window
+static int peer_bulk(int total, int loss) {
+	struct sockaddr_in a=mkaddr(PEER_PORT);
+	unsigned long one=1;
+	int cs, sent=0, bad=0, maxflight=0, n, r, i, rb=262144;
+	unsigned int dt, t0;
+	char buf[4096];
+	sgIP_Record_TCP * c;
+	peer.win=PEER_WINDOW>>(peer.wscale>0?peer.wscale:0);
+	loss_permille=0;
+	cs=socket(AF_INET,SOCK_STREAM,0);
+	setsockopt(cs,SOL_SOCKET,SO_RCVBUF,&rb,sizeof(int));
+	setsockopt(cs,SOL_SOCKET,SO_SNDBUF,&rb,sizeof(int));
+	if(connect(cs,(struct sockaddr*)&a,sizeof(a))) { printf("connect failed\n"); return 1; }
+	ioctl(cs,FIONBIO,&one);
+	c=tcp_rec(cs);
+	loss_permille=loss;
+	t0=now_ms;
+	while((int)(peer.rcv_nxt-peer.irs-1)<total) {
+		if(sent<total) {
+			n=total-sent; if(n>(int)sizeof(buf)) n=sizeof(buf);
+			for(i=0;i<n;i++) buf[i]=(char)((sent+i)*7+3);
+			r=send(cs,buf,n,0); if(r>0) sent+=r;
+		}
+		pump(1);
+		if((int)(c->sequence_next-c->sequence)>maxflight) maxflight=c->sequence_next-c->sequence;
+		if(now_ms-t0>600000) { printf("  timed out: %d sent, %d received\n",sent,(int)(peer.rcv_nxt-peer.irs-1)); loss_permille=0; return 1; }
+	}
+	dt=now_ms-t0;
+	loss_permille=0;
+	for(i=0;i<total;i++) if(peer.data[i]!=(unsigned char)(char)(i*7+3)) bad++;
+	printf("ws %2d sack %d loss %d.%d%%: %u ms (%d KB/s), %d segs, %d dup, %d acks, %d bad, flight up to %d, our window up to %d\n",
+		peer.wscale,peer.sack,loss/10,loss%10,dt,dt?(int)((double)total*1000/1024/dt):0,peer.segs,peer.dupsegs,peer.acks,bad,maxflight,peer.maxwin);
+	print_tcpinfo("  sender",cs);
+	closesocket(cs);
+	pump(100);
+	if(c->wscaleok!=(peer.wscale>=0)) bad++;
+	if(maxflight>PEER_WINDOW || maxflight<PEER_WINDOW/2) bad++;
+	if(peer.wscale>=0 && peer.maxwin<=65535) bad++;
+	return bad?1:0;
+}
+
+int main(void) {
+	static const int ws[3]={-1,0,3};
+	int i, loss, fails=0;
+	net_init();
+	latency_ms=20; // enough delay that the window, not the link, limits the flight
+	bw_bytes_per_ms=2000;
+	txq_ms=100;
+	peer.got=calloc(PEER_MAX,1); peer.data=calloc(PEER_MAX,1);
+	peer.mss=1460; peer.sack=1;
+	rx_hook=peer_intercept;
+	for(loss=0;loss<=20;loss+=20)
+		for(i=0;i<3;i++) {
+			peer.wscale=ws[i];
+			fails+=peer_bulk(500000,loss);
+		}
+	rx_hook=0;
+	return fails?1:0;
+}
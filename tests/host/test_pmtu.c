@@ -0,0 +1,54 @@
+// MSS and path MTU: the mss comes from the link MTU, TCP datagrams carry DF, and an ICMP
+//  fragmentation-needed quoting one of our segments shrinks the mss and what's resent.
+#include "harness.h"
+
+static int tx_port, tx_biggest, tx_nodf;
+static void tx_watch(unsigned char * d, int len) {
+	int tot;
+	if(len<54 || d[12]!=8 || d[13]!=0 || d[23]!=6 || ((d[34]<<8)|d[35])!=tx_port) return;
+	tot=(d[16]<<8)|d[17];
+	if(tot>tx_biggest) tx_biggest=tot;
+	if(!(d[20]&0x40)) tx_nodf++;
+}
+
+int main(void) {
+	int cs, ss, ls, fails=0, want;
+	unsigned long one=1;
+	char buf[3000];
+	sgIP_Record_TCP * c;
+	sgIP_memblock * mb;
+	unsigned char * d;
+	sgIP_Header_IP * ip;
+	sgIP_Header_TCP * t;
+	net_init();
+	ls=tcp_pair(83,&cs,&ss);
+	c=tcp_rec(cs);
+	want=SGIP_MTU_OVERRIDE-40;
+	printf("mss: client %d, server %d (want %d)\n",c->mss,tcp_rec(ss)->mss,want);
+	if(c->mss!=want || tcp_rec(ss)->mss!=want) fails++;
+	drop_srcport=83;
+	ioctl(cs,FIONBIO,&one);
+	memset(buf,'x',sizeof(buf));
+	inject_ack(c,c->sequence,8000,0,0);
+	tx_port=ntohs(c->srcport); tx_biggest=tx_nodf=0; tx_hook=tx_watch;
+	send(cs,buf,3000,0);
+	pump(10);
+	printf("before: biggest datagram %d, %d without DF\n",tx_biggest,tx_nodf);
+	if(tx_biggest!=SGIP_MTU_OVERRIDE || tx_nodf) fails++;
+	// ICMP fragmentation needed, next-hop mtu 1000, quoting our first segment
+	mb=sgIP_memblock_alloc(8+20+8);
+	d=(unsigned char*)mb->datastart; memset(d,0,36);
+	d[0]=3; d[1]=4; d[6]=1000>>8; d[7]=1000&255;
+	ip=(sgIP_Header_IP*)(d+8); ip->version_ihl=0x45; ip->protocol=6; ip->src_address=c->srcip; ip->dest_address=c->destip;
+	t=(sgIP_Header_TCP*)(d+28); t->srcport=c->srcport; t->destport=c->destport; t->seqnum=htonl(c->sequence);
+	sgIP_ICMP_ReceivePacket(mb,c->destip,c->srcip);
+	printf("mss after fragmentation needed: %d\n",c->mss);
+	if(c->mss!=1000-40) fails++;
+	tx_biggest=tx_nodf=0;
+	pump(2000);
+	printf("after: biggest datagram %d, %d without DF\n",tx_biggest,tx_nodf);
+	if(!tx_biggest || tx_biggest>1000 || tx_nodf) fails++;
+	tx_hook=0; drop_srcport=-1;
+	closesocket(cs); closesocket(ss); closesocket(ls);
+	return fails?1:0;
+}
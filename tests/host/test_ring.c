@@ -0,0 +1,135 @@
+// sgIP_Ring: Write, WriteMemblock, Read and peek of every length from every position, so each
+//  crosses the wrap point, a long random run against a model of the byte stream, and Resize when
+//  the count it's given is more than the ring holds.
+#include "harness.h"
+#include "sgIP_Ring.h"
+
+#define RING_SIZE	64
+#define RANDOM_OPS	100000
+#define STREAM_PERIOD	1024
+#define CHAIN_LEN	1460
+
+// the bytes written, which repeat so any offset into src or the chain can carry on from any other
+static unsigned char stream(int i) { i&=STREAM_PERIOD-1; return i*131+(i>>8); }
+
+// a three block chain, like a segment that arrived in pieces
+static sgIP_memblock * chain(const unsigned char * src) {
+	sgIP_memblock * mb;
+	mb=sgIP_memblock_alloc(40);
+	sgIP_memblock_append(mb,sgIP_memblock_alloc(501));
+	sgIP_memblock_append(mb,sgIP_memblock_alloc(CHAIN_LEN-40-501));
+	sgIP_memblock_CopyFromLinear(mb,(void *)src,0,CHAIN_LEN);
+	return mb;
+}
+
+// read len bytes back (peeking first), expecting stream(from..)
+static int read_back(sgIP_Ring * r, int from, int len) {
+	unsigned char buf[RING_SIZE*4];
+	int i, n, bad=0;
+	n=sgIP_Ring_Read(r,buf,len,1);
+	if(n!=len || sgIP_Ring_Used(r)!=len) bad++;
+	for(i=0;i<n;i++) if(buf[i]!=stream(from+i)) bad++;
+	memset(buf,0,sizeof(buf));
+	n=sgIP_Ring_Read(r,buf,len/3,0);
+	n+=sgIP_Ring_Read(r,buf+n,len,0);
+	if(n!=len || sgIP_Ring_Used(r)!=0) bad++;
+	for(i=0;i<n;i++) if(buf[i]!=stream(from+i)) bad++;
+	return bad;
+}
+
+int main(void) {
+	sgIP_Ring r;
+	sgIP_memblock * mb;
+	unsigned char src[2048], buf[2048];
+	int i, k, len, n, wpos, rpos, bad, fails=0;
+	net_init();
+	for(i=0;i<(int)sizeof(src);i++) src[i]=stream(i);
+	mb=chain(src);
+
+	// no buffer: nothing fits
+	sgIP_Ring_Init(&r);
+	if(sgIP_Ring_Space(&r)!=0 || sgIP_Ring_Write(&r,src,10)!=0 || sgIP_Ring_Read(&r,buf,10,0)!=0) fails++;
+
+	// every length from every position, from a buffer and from a memblock chain at odd offsets
+	sgIP_Ring_Alloc(&r,RING_SIZE);
+	bad=0;
+	for(k=0;k<RING_SIZE;k++) {
+		for(len=0;len<RING_SIZE;len++) {
+			r.in=r.out=k;
+			n=sgIP_Ring_Write(&r,src+len,len);
+			if(n!=len || sgIP_Ring_Space(&r)!=RING_SIZE-1-len) bad++;
+			bad+=read_back(&r,len,len);
+			r.in=r.out=k;
+			n=sgIP_Ring_WriteMemblock(&r,mb,37*len%(CHAIN_LEN-RING_SIZE),len); // starts in each of the three blocks
+			if(n!=len) bad++;
+			bad+=read_back(&r,37*len%(CHAIN_LEN-RING_SIZE),len);
+			if(r.in!=r.out) bad++;
+		}
+	}
+	printf("every length from every position of a %d byte ring: %d bad\n",RING_SIZE,bad);
+	if(bad) fails++;
+
+	// writes stop when it's full, reads when it's empty
+	r.in=r.out=RING_SIZE-5;
+	n=sgIP_Ring_Write(&r,src,RING_SIZE*2);
+	i=sgIP_Ring_Write(&r,src,1);
+	k=sgIP_Ring_WriteMemblock(&r,mb,0,1);
+	printf("overfilled: wrote %d then %d and %d; ",n,i,k);
+	if(n!=RING_SIZE-1 || i || k || sgIP_Ring_Space(&r)) fails++;
+	n=sgIP_Ring_Read(&r,buf,RING_SIZE*2,0);
+	i=sgIP_Ring_Read(&r,buf,1,0);
+	printf("read %d then %d\n",n,i);
+	if(n!=RING_SIZE-1 || i || memcmp(buf,src,n)) fails++;
+
+	// random writes and reads against the stream they should carry
+	wpos=rpos=bad=0;
+	for(k=0;k<RANDOM_OPS;k++) {
+		len=rnd()%(RING_SIZE+8);
+		switch(rnd()%4) {
+		case 0: wpos+=sgIP_Ring_Write(&r,src+wpos%STREAM_PERIOD,len); break;
+		case 1: wpos+=sgIP_Ring_WriteMemblock(&r,mb,wpos%STREAM_PERIOD,len); break;
+		case 2:
+			n=sgIP_Ring_Read(&r,buf,len,1);
+			for(i=0;i<n;i++) if(buf[i]!=stream(rpos+i)) bad++;
+			break;
+		default:
+			n=sgIP_Ring_Read(&r,buf,len,0);
+			for(i=0;i<n;i++) if(buf[i]!=stream(rpos+i)) bad++;
+			rpos+=n;
+			break;
+		}
+		if(wpos-rpos!=sgIP_Ring_Used(&r)) bad++;
+		if(rpos>=STREAM_PERIOD) { wpos-=STREAM_PERIOD; rpos-=STREAM_PERIOD; }
+	}
+	printf("%d random writes and reads: %d bad\n",RANDOM_OPS,bad);
+	if(bad) fails++;
+
+	// resize a wrapped ring holding 40 bytes, with a count that also has bytes still to come
+	r.in=r.out=RING_SIZE-10;
+	sgIP_Ring_Write(&r,src,40);
+	n=sgIP_Ring_Resize(&r,32,40);
+	printf("resize to 32 for 40: %d; ",n);
+	if(n || r.size!=RING_SIZE || sgIP_Ring_Used(&r)!=40) fails++;
+	n=sgIP_Ring_Resize(&r,48,48);
+	printf("to 48 for 48: %d; ",n);
+	if(n || r.size!=RING_SIZE) fails++;
+	malloc_limit=malloc_bytes+47;
+	n=sgIP_Ring_Resize(&r,48,45);
+	malloc_limit=0;
+	printf("to 48 for 45 with no memory: %d; ",n);
+	if(n || r.size!=RING_SIZE || sgIP_Ring_Used(&r)!=40) fails++;
+	k=malloc_bytes;
+	n=sgIP_Ring_Resize(&r,48,45);
+	printf("to 48 for 45: %d, size %d, %d bytes, %d space; ",n,r.size,sgIP_Ring_Used(&r),sgIP_Ring_Space(&r));
+	if(n!=1 || r.size!=48 || malloc_bytes!=k-RING_SIZE+48 || sgIP_Ring_Space(&r)!=7) fails++;
+	n=sgIP_Ring_Write(&r,src+40,7); // the rest of what the count allowed for
+	if(n!=7 || sgIP_Ring_Write(&r,src,1)) fails++;
+	n=sgIP_Ring_Resize(&r,RING_SIZE*4,60);
+	printf("to %d for 60: %d\n",RING_SIZE*4,n);
+	if(n!=1 || r.size!=RING_SIZE*4 || read_back(&r,0,47)) fails++;
+
+	sgIP_Ring_Free(&r);
+	if(r.buf || sgIP_Ring_Space(&r)) fails++;
+	sgIP_memblock_free(mb);
+	return fails?1:0;
+}
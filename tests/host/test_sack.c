@@ -0,0 +1,103 @@
+// SACK: both ends agree to it, SACK blocks land in the scoreboard, a retransmit timeout resends
+//  only what wasn't SACKed, and RFC 6675 recovery resends every hole after three duplicate acks.
+#include "harness.h"
+
+// payload segments the client sends, by offset from a starting sequence number
+static unsigned long seg_seq[64], seg_base;
+static int seg_n, seg_port;
+static void seg_hook(unsigned char * d, int len) {
+	unsigned char * t=d+34;
+	if(len<54 || d[23]!=6 || ((t[0]<<8)|t[1])!=seg_port || len-34-(t[12]>>4)*4<=0 || seg_n>=64) return;
+	seg_seq[seg_n++]=((t[4]<<24)|(t[5]<<16)|(t[6]<<8)|t[7])-seg_base;
+}
+static void seg_watch(sgIP_Record_TCP * c, unsigned long base) {
+	seg_n=0; seg_base=base; seg_port=ntohs(c->srcport); tx_hook=seg_hook;
+}
+// the segments seen since seg_watch, in units of m, must be exactly want[0..n)
+static int seg_expect(const char * what, int m, const int * want, int n) {
+	int i, bad=seg_n!=n;
+	printf("%s:",what);
+	for(i=0;i<seg_n;i++) { printf(" %d",(int)seg_seq[i]/m); if(i<n && seg_seq[i]!=want[i]*m) bad=1; }
+	printf("%s\n",bad?"  (wrong)":"");
+	tx_hook=0;
+	return bad;
+}
+
+// segments 1 and 3 of 4 SACKed.  the timeout resends 0; once that's acked, 2 goes and 3 doesn't.
+static int sack_rto(void) {
+	int cs, ss, ls, fails=0, m;
+	unsigned long s0, one=1;
+	char buf[6000];
+	static const int want[2]={0,2};
+	sgIP_Record_TCP * c;
+	ls=tcp_pair(82,&cs,&ss);
+	c=tcp_rec(cs);
+	printf("sackok: client %d, server %d\n",c->sackok,tcp_rec(ss)->sackok);
+	if(!c->sackok || !tcp_rec(ss)->sackok) fails++;
+	drop_srcport=82; // the server's acks never arrive; the test plays them
+	ioctl(cs,FIONBIO,&one);
+	memset(buf,'x',sizeof(buf));
+	s0=c->sequence; m=c->mss;
+	inject_ack(c,s0,8000,0,0);
+	c->cwnd=4*m;
+	send(cs,buf,4*m,0);
+	pump(20);
+	{
+		unsigned long sk[4]={ s0+m, s0+2*m, s0+3*m, s0+4*m };
+		inject_ack(c,s0,8000,2,sk);
+	}
+	printf("scoreboard: %d blocks [%d,%d) [%d,%d)\n",c->numsacked,(int)(c->sacked[0]-s0)/m,(int)(c->sacked[1]-s0)/m,(int)(c->sacked[2]-s0)/m,(int)(c->sacked[3]-s0)/m);
+	if(c->numsacked!=2 || c->sacked[0]!=s0+m || c->sacked[1]!=s0+2*m || c->sacked[2]!=s0+3*m || c->sacked[3]!=s0+4*m) fails++;
+	seg_watch(c,s0);
+	while(!seg_n && now_ms<100000) pump(1);
+	{
+		unsigned long sk[2]={ s0+3*m, s0+4*m };
+		inject_ack(c,s0+2*m,8000,1,sk);
+	}
+	pump(5);
+	fails+=seg_expect("resent after the timeout, then after its ack",m,want,2);
+	drop_srcport=-1;
+	closesocket(cs); closesocket(ss); closesocket(ls);
+	pump(2000);
+	return fails;
+}
+
+// segments 0, 4, 6 and 9 of 10 lost, the rest SACKed: after the third duplicate ack every hole goes
+//  out again, and the tail past the highest SACK as a rescue, without waiting for the timeout.
+static int sack_recovery(void) {
+	int cs, ss, ls, i, m, v=65536;
+	unsigned long s0, one=1;
+	static char buf[20000];
+	static const int want[4]={0,4,6,9};
+	sgIP_Record_TCP * c;
+	ls=tcp_pair(84,&cs,&ss);
+	c=tcp_rec(cs);
+	ioctl(cs,FIONBIO,&one);
+	setsockopt(cs,SOL_SOCKET,SO_SNDBUF,&v,sizeof(int));
+	drop_srcport=84;
+	memset(buf,'y',sizeof(buf));
+	s0=c->sequence; m=c->mss;
+	inject_ack(c,s0,60000,0,0);
+	c->cwnd=20*m;
+	send(cs,buf,10*m,0);
+	pump(5);
+	{
+		unsigned long sk[6]={ s0+1*m, s0+4*m, s0+5*m, s0+6*m, s0+7*m, s0+9*m };
+		seg_watch(c,s0);
+		for(i=0;i<3;i++) inject_ack(c,s0,60000,3,sk);
+	}
+	pump(5);
+	i=seg_expect("resent after 3 duplicate acks",m,want,4);
+	drop_srcport=-1;
+	closesocket(cs); closesocket(ss); closesocket(ls);
+	pump(2000);
+	return i;
+}
+
+int main(void) {
+	int fails;
+	net_init();
+	fails=sack_rto();
+	fails+=sack_recovery();
+	return fails?1:0;
+}
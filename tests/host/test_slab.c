@@ -0,0 +1,109 @@
+// memblock slabs: a class grows by whole slabs and gives them back down to one spare when its
+//  blocks are freed, random alloc/free of every size keeps each block's data its own, and an
+//  allocation the heap can't fit trims the spare slabs and retries.
+#include "harness.h"
+
+#define STRESS_OPS	20000
+#define STRESS_LIVE	64
+#define MID_SIZE	500	// one block of the middle size class
+#define BIG_SIZE	2000	// too big for any class
+
+extern const int memslab_classsize[];
+extern int memslab_numfree[];
+
+static void fill(sgIP_memblock * mb, int tag) {
+	memset(mb->datastart,tag,mb->totallength);
+}
+static int intact(sgIP_memblock * mb, int tag) {
+	int i;
+	for(i=0;i<mb->totallength;i++) if(((unsigned char *)mb->datastart)[i]!=(unsigned char)tag) return 0;
+	return 1;
+}
+
+int main(void) {
+	sgIP_memblock * mb[STRESS_LIVE], * big;
+	sgIP_memblock_Stats st0, st;
+	int tag[STRESS_LIVE];
+	int i, j, n, nf0, grown, inuse0, bad=0, fails=0;
+	net_init();
+	sgIP_memblock_GetStats(&st0);
+	inuse0=st0.inuse;
+
+	// grow: three slabs' worth from the middle class, from whatever it had free
+	nf0=memslab_numfree[1];
+	n=3*SGIP_MEMBLOCK_STEPNUM;
+	for(i=0;i<n;i++) { mb[i]=sgIP_memblock_allocHW(0,MID_SIZE); fill(mb[i],i); }
+	sgIP_memblock_GetStats(&st);
+	grown=st.slabsgrown-st0.slabsgrown;
+	printf("%d blocks of %d: %d slabs grown, %d free blocks left (had %d)\n",n,MID_SIZE,grown,memslab_numfree[1],nf0);
+	if(grown!=(n-nf0+SGIP_MEMBLOCK_STEPNUM-1)/SGIP_MEMBLOCK_STEPNUM || memslab_numfree[1]!=nf0+grown*SGIP_MEMBLOCK_STEPNUM-n) fails++;
+	for(i=0;i<n;i++) if(!intact(mb[i],i)) bad++;
+	if(bad) { printf("%d blocks overwritten\n",bad); fails++; }
+
+	// shrink: freeing them all gives back every slab but one spare
+	st0=st;
+	for(i=0;i<n;i++) { j=rnd()%(n-i); sgIP_memblock_free(mb[j]); mb[j]=mb[n-i-1]; }
+	sgIP_memblock_GetStats(&st);
+	printf("all freed: %d slabs released, %d free blocks kept\n",(int)(st.slabsreleased-st0.slabsreleased),memslab_numfree[1]);
+	if(st.slabsreleased-st0.slabsreleased<1 || memslab_numfree[1]<SGIP_MEMBLOCK_STEPNUM || memslab_numfree[1]>=2*SGIP_MEMBLOCK_STEPNUM) fails++;
+
+	// stress: random sizes across every class and the big ones, freed in random order
+	st0=st;
+	memset(mb,0,sizeof(mb));
+	for(i=0;i<STRESS_OPS;i++) {
+		j=rnd()%STRESS_LIVE;
+		if(mb[j]) {
+			if(!intact(mb[j],tag[j])) bad++;
+			sgIP_memblock_free(mb[j]);
+			mb[j]=0;
+		} else {
+			mb[j]=sgIP_memblock_allocHW(0,1+rnd()%1700);
+			tag[j]=i;
+			fill(mb[j],tag[j]);
+		}
+	}
+	for(j=0;j<STRESS_LIVE;j++) if(mb[j]) { if(!intact(mb[j],tag[j])) bad++; sgIP_memblock_free(mb[j]); }
+	sgIP_memblock_GetStats(&st);
+	printf("%d random ops: %d slabs grown, %d released, %d blocks overwritten, %d in use after (%d before), free blocks by class %d/%d/%d\n",
+		STRESS_OPS,(int)(st.slabsgrown-st0.slabsgrown),(int)(st.slabsreleased-st0.slabsreleased),bad,st.inuse,inuse0,
+		memslab_numfree[0],memslab_numfree[1],memslab_numfree[2]);
+	if(bad || st.inuse!=inuse0 || st.failed!=st0.failed) fails++;
+	for(i=0;i<SGIP_MEMSLAB_NUMCLASSES;i++) if(memslab_numfree[i]>=2*SGIP_MEMBLOCK_STEPNUM) fails++;
+
+	// trim: a big block the heap has no room for until the spare slabs go
+	st0=st;
+	malloc_limit=malloc_bytes+BIG_SIZE;
+	big=sgIP_memblock_allocHW(0,BIG_SIZE);
+	sgIP_memblock_GetStats(&st);
+	printf("%d bytes with no room: %s, %d spare slabs trimmed, free blocks by class %d/%d/%d\n",BIG_SIZE,big?"allocated":"failed",
+		(int)(st.slabsreleased-st0.slabsreleased),memslab_numfree[0],memslab_numfree[1],memslab_numfree[2]);
+	if(!big || st.slabsreleased-st0.slabsreleased<1 || memslab_numfree[0] || memslab_numfree[1] || memslab_numfree[2]) fails++;
+	if(big) { fill(big,0x5A); if(!intact(big,0x5A)) fails++; sgIP_memblock_free(big); }
+
+	// nothing left to trim: the allocation fails, and is counted
+	st0=st;
+	malloc_limit=malloc_bytes+100;
+	big=sgIP_memblock_allocHW(0,BIG_SIZE);
+	sgIP_memblock_GetStats(&st);
+	printf("%d bytes with nothing to trim: %s, failed %d\n",BIG_SIZE,big?"allocated":"failed",(int)(st.failed-st0.failed));
+	if(big || st.failed-st0.failed!=1) fails++;
+
+	// no room for a new slab: a small block comes from the heap on its own
+	st0=st;
+	malloc_limit=malloc_bytes+memslab_classsize[0]+100;
+	mb[0]=sgIP_memblock_allocHW(0,memslab_classsize[0]);
+	sgIP_memblock_GetStats(&st);
+	printf("%d bytes with no room for a slab: %s, %d slabs grown, %d heap allocs\n",memslab_classsize[0],mb[0]?"allocated":"failed",
+		(int)(st.slabsgrown-st0.slabsgrown),(int)(st.heapallocs-st0.heapallocs));
+	if(!mb[0] || st.slabsgrown!=st0.slabsgrown || st.heapallocs-st0.heapallocs!=1) fails++;
+	if(mb[0]) sgIP_memblock_free(mb[0]);
+
+	// and with the heap back, the classes grow again
+	malloc_limit=0;
+	st0=st;
+	mb[0]=sgIP_memblock_allocHW(0,MID_SIZE);
+	sgIP_memblock_GetStats(&st);
+	if(!mb[0] || st.slabsgrown-st0.slabsgrown!=1) fails++;
+	if(mb[0]) sgIP_memblock_free(mb[0]);
+	return fails?1:0;
+}
@@ -0,0 +1,104 @@
+// SYN cookies: a flood of SYNs gets an answer each without holding memory, a forged ACK is reset,
+//  a real one completes the handshake (with its data) long after its SYN, a stale cookie is
+//  refused, and a cookie handed out just before the secret rotates still works.
+#include "harness.h"
+
+#define FLOOD 50
+#define PORT0 20000
+static unsigned int sc_cookie[FLOOD]; static int sc_synacks, sc_rsts;
+
+// a segment from PORT0+i to our port 80
+static void sc_emit(int sport, int flags, unsigned int seq, unsigned int ack, const char * data, int dl) {
+	unsigned char f[200], * e=f, * ip=e+14, * t=ip+20;
+	static const unsigned char o[12]={2,4,0x05,0xb4,1,1,4,2,1,3,3,2}; // mss 1460, SACK ok, window scale 2
+	int i, ol=(flags&SGIP_TCP_FLAG_SYN)?12:0, tl=20+ol, tot=20+tl+dl;
+	unsigned int ps=0;
+	unsigned short c;
+	memset(f,0,sizeof(f));
+	memcpy(e,hw->hwaddr,6); memcpy(e+6,hw->hwaddr,6); e[12]=8; e[13]=0;
+	ip[0]=0x45; ip[2]=tot>>8; ip[3]=tot; ip[8]=64; ip[9]=6;
+	memcpy(ip+12,&hw->ipaddr,4); memcpy(ip+16,&hw->ipaddr,4);
+	c=csum16(ip,20,0); ip[10]=c>>8; ip[11]=c;
+	t[0]=sport>>8; t[1]=sport; t[2]=0; t[3]=80;
+	t[4]=seq>>24; t[5]=seq>>16; t[6]=seq>>8; t[7]=seq; t[8]=ack>>24; t[9]=ack>>16; t[10]=ack>>8; t[11]=ack;
+	t[12]=(tl/4)<<4; t[13]=flags; t[14]=0x40; t[15]=0;
+	memcpy(t+20,o,ol); memcpy(t+tl,data,dl);
+	for(i=0;i<8;i+=2) ps+=(ip[12+i]<<8)|ip[13+i];
+	ps+=6+tl+dl;
+	c=csum16(t,tl+dl,ps); t[16]=c>>8; t[17]=c;
+	link_queue(f,14+tot,1);
+}
+// take the stack's answers to the fake clients off the link
+static int sc_intercept(unsigned char * d, int len) {
+	unsigned char * t=d+34;
+	int sp, dp;
+	if(len<54 || d[23]!=6) return 0;
+	sp=(t[0]<<8)|t[1]; dp=(t[2]<<8)|t[3];
+	if(sp!=80 || dp<PORT0 || dp>=PORT0+FLOOD) return 0;
+	if((t[13]&(SGIP_TCP_FLAG_SYN|SGIP_TCP_FLAG_ACK))==(SGIP_TCP_FLAG_SYN|SGIP_TCP_FLAG_ACK)) {
+		sc_synacks++;
+		sc_cookie[dp-PORT0]=(t[4]<<24)|(t[5]<<16)|(t[6]<<8)|t[7];
+	}
+	if(t[13]&SGIP_TCP_FLAG_RST) sc_rsts++;
+	return 1;
+}
+
+int main(void) {
+	int ls, u, s, s2, stale, forged, r=-1, i, m0, fails=0;
+	struct sockaddr_in a, pa;
+	int pl=sizeof(pa);
+	unsigned long one=1;
+	char buf[32];
+	net_init();
+	rx_hook=sc_intercept;
+	a=mkaddr(80);
+	ls=socket(AF_INET,SOCK_STREAM,0);
+	bind(ls,(struct sockaddr*)&a,sizeof(a)); listen(ls,4); ioctl(ls,FIONBIO,&one);
+	// answers go to our own address: have it resolved before the flood, so none wait on ARP
+	u=socket(AF_INET,SOCK_DGRAM,0);
+	sendto(u,"x",1,0,(struct sockaddr*)&a,sizeof(a));
+	pump(100);
+	closesocket(u);
+	m0=malloc_count;
+	for(i=0;i<FLOOD;i++) { sc_emit(PORT0+i,SGIP_TCP_FLAG_SYN,1000000u*i,0,0,0); if(i%4==3) pump(1); }
+	pump(100);
+	printf("flood: %d SYNs, %d SYN-ACKs, malloc delta %d\n",FLOOD,sc_synacks,malloc_count-m0);
+	if(sc_synacks!=FLOOD || malloc_count!=m0) fails++;
+
+	sc_emit(PORT0+1,SGIP_TCP_FLAG_ACK,1000000u+1,sc_cookie[1]+12345,0,0);
+	pump(10);
+	forged=accept(ls,(struct sockaddr*)&pa,&pl);
+	printf("forged ACK: %d RSTs, accept %d\n",sc_rsts,forged);
+	if(sc_rsts!=1 || forged>0) fails++;
+
+	sc_emit(PORT0,SGIP_TCP_FLAG_ACK|SGIP_TCP_FLAG_PSH,1,sc_cookie[0]+1,"helloworld",10);
+	pump(10);
+	s=accept(ls,(struct sockaddr*)&pa,&pl);
+	if(s>0) { ioctl(s,FIONBIO,&one); r=recv(s,buf,sizeof(buf),0); }
+	printf("first SYN's handshake completed: accept %d, received %d from port %d\n",s,r,ntohs(pa.sin_port));
+	if(s<=0 || r!=10 || ntohs(pa.sin_port)!=PORT0) fails++;
+	// the SYN offered mss 1460, SACK and window scale 2; the cookie has to have kept all three
+	if(s>0) {
+		sgIP_Record_TCP * c=tcp_rec(s);
+		printf("from the cookie: mss %d, sack %d, window scale %d\n",c->mss,c->sackok,c->wscaleok?c->snd_wscale:-1);
+		if(c->mss!=1420 || !c->sackok || !c->wscaleok || c->snd_wscale!=2) fails++;
+	}
+
+	pump(200000);
+	sc_emit(PORT0+2,SGIP_TCP_FLAG_ACK,2000000u+1,sc_cookie[2]+1,0,0);
+	pump(10);
+	stale=accept(ls,(struct sockaddr*)&pa,&pl);
+	printf("cookie 200s old: %d RSTs, accept %d\n",sc_rsts,stale);
+	if(stale>0) fails++;
+
+	while(((sgIP_timems+300)>>SGIP_TCP_COOKIE_TIMESHIFT)==(sgIP_timems>>SGIP_TCP_COOKIE_TIMESHIFT)) pump(50);
+	sc_emit(PORT0+3,SGIP_TCP_FLAG_SYN,3000000u,0,0,0);
+	pump(600);
+	sc_emit(PORT0+3,SGIP_TCP_FLAG_ACK|SGIP_TCP_FLAG_PSH,3000000u+1,sc_cookie[3]+1,"x",1);
+	pump(10);
+	s2=accept(ls,(struct sockaddr*)&pa,&pl);
+	printf("cookie from before a secret rotation: accept %d\n",s2);
+	if(s2<=0) fails++;
+	rx_hook=0;
+	return fails?1:0;
+}
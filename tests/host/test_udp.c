@@ -0,0 +1,80 @@
+// UDP delivery and the bounded receive queue: broadcast fan-out to every socket on a port,
+//  datagrams queued behind one ARP request, and a reader too slow for its sender under both
+//  drop policies (drop the newest, SO_RCVDROPOLDEST).
+#include "harness.h"
+
+int main(void) {
+	int s[3], tx, r, i, k, n, n2, ok, fl, pol, v, vl, dropped, got, first, last, peak, m0, fails=0;
+	unsigned long one=1;
+	char buf[2000];
+	struct sockaddr_in a, d, ra, from;
+	net_init();
+	a=mkaddr(5000);
+	a.sin_addr.s_addr=0;
+	for(i=0;i<3;i++) {
+		s[i]=socket(AF_INET,SOCK_DGRAM,0);
+		bind(s[i],(struct sockaddr*)&a,sizeof(a));
+		ioctl(s[i],FIONBIO,&one);
+	}
+	tx=socket(AF_INET,SOCK_DGRAM,0);
+
+	// limited and directed broadcast reach all three
+	d=mkaddr(5000);
+	d.sin_addr.s_addr=0xFFFFFFFF;
+	for(i=0;i<1200;i++) buf[i]=(char)(i*13);
+	sendto(tx,buf,1200,0,(struct sockaddr*)&d,sizeof(d));
+	d.sin_addr.s_addr=10|(255u<<24);
+	sendto(tx,buf,7,0,(struct sockaddr*)&d,sizeof(d));
+	pump(50);
+	for(i=0;i<3;i++) {
+		fl=sizeof(from); n=recvfrom(s[i],buf,sizeof(buf),0,(struct sockaddr*)&from,&fl);
+		ok=n==1200;
+		for(k=0;ok && k<1200;k++) if(buf[k]!=(char)(k*13)) ok=0;
+		fl=sizeof(from); n2=recvfrom(s[i],buf,sizeof(buf),0,(struct sockaddr*)&from,&fl);
+		printf("socket %d: %d bytes%s, then %d\n",i,n,ok?"":" (wrong)",n2);
+		if(!ok || n2!=7) fails++;
+	}
+
+	// unicast to ourselves, not yet in the ARP cache: the first SGIP_ARP_MAXQUEUED wait on one request
+	d.sin_addr.s_addr=hw->ipaddr;
+	for(i=0;i<6;i++) { buf[0]=i; sendto(tx,buf,100,0,(struct sockaddr*)&d,sizeof(d)); }
+	pump(50);
+	n=0;
+	for(i=0;i<3;i++) for(;;n++) { fl=sizeof(from); if(recvfrom(s[i],buf,sizeof(buf),0,(struct sockaddr*)&from,&fl)<=0) break; }
+	printf("unicast datagrams through ARP: %d of 6 (want %d)\n",n,SGIP_ARP_MAXQUEUED);
+	if(n!=SGIP_ARP_MAXQUEUED) fails++;
+
+	// a slow reader: 100 datagrams of 500 bytes, nothing read until the end
+	for(pol=0;pol<2;pol++) {
+		r=socket(AF_INET,SOCK_DGRAM,0);
+		ra=mkaddr(6000+pol);
+		bind(r,(struct sockaddr*)&ra,sizeof(ra));
+		ioctl(r,FIONBIO,&one);
+		setsockopt(r,SOL_SOCKET,SO_RCVDROPOLDEST,&pol,sizeof(int));
+		if(pol) { v=4000; setsockopt(r,SOL_SOCKET,SO_RCVBUF,&v,sizeof(int)); }
+		d.sin_port=htons(6000+pol);
+		m0=malloc_bytes; peak=0;
+		for(i=0;i<100;i++) {
+			buf[0]=i;
+			sendto(tx,buf,500,0,(struct sockaddr*)&d,sizeof(d));
+			if(i%5==4) { pump(20); if(malloc_bytes-m0>peak) peak=malloc_bytes-m0; }
+		}
+		pump(50);
+		vl=sizeof(int); getsockopt(r,SOL_SOCKET,SO_RCVDROPPED,&dropped,&vl);
+		vl=sizeof(int); getsockopt(r,SOL_SOCKET,SO_RCVBUF,&v,&vl);
+		got=0; first=last=-1;
+		for(;;) {
+			fl=sizeof(from); n=recvfrom(r,buf,sizeof(buf),0,(struct sockaddr*)&from,&fl);
+			if(n<=0) break;
+			if(first<0) first=(unsigned char)buf[0];
+			last=(unsigned char)buf[0];
+			got++;
+		}
+		printf("%s, SO_RCVBUF %d: received %d (#%d..#%d), dropped %d, heap grew by up to %d bytes\n",pol?"drop oldest":"drop newest",v,got,first,last,dropped,peak);
+		if(got+dropped!=100 || got==0 || peak>2*v || (pol && last!=99) || (!pol && first!=0)) fails++;
+		closesocket(r);
+	}
+	for(i=0;i<3;i++) closesocket(s[i]);
+	closesocket(tx);
+	return fails?1:0;
+}
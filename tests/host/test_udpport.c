@@ -0,0 +1,62 @@
+// UDP ports: the ephemeral allocator finds the last free ports and then reports none, and many
+//  autobound sockets each get a distinct port and their own replies.
+#include "harness.h"
+
+void sgIP_UDP_PortMark(unsigned short nport, int used);
+
+int main(void) {
+	static const int want[3]={SGIP_UDP_FIRSTOUTGOINGPORT,SGIP_UDP_FIRSTOUTGOINGPORT+12345,SGIP_UDP_LASTOUTGOINGPORT};
+	int echo, t, p, i, j, n, fl, ml, uniq=1, ok=0, fails=0;
+	int got[4], c[24], ports[24];
+	unsigned long one=1;
+	char buf[64];
+	struct sockaddr_in e, from, me;
+	net_init();
+
+	// all but three ports taken
+	for(p=SGIP_UDP_FIRSTOUTGOINGPORT;p<=SGIP_UDP_LASTOUTGOINGPORT;p++)
+		if(p!=want[0] && p!=want[1] && p!=want[2]) sgIP_UDP_PortMark(htons(p),1);
+	for(i=0;i<4;i++) { got[i]=sgIP_UDP_GetUnusedOutgoingPort(); if(got[i]) sgIP_UDP_PortMark(htons(got[i]),1); }
+	printf("allocator with 3 free: %d %d %d, then %d\n",got[0],got[1],got[2],got[3]);
+	if(got[3]!=0 || got[0]+got[1]+got[2]!=want[0]+want[1]+want[2] || got[0]==got[1] || got[1]==got[2] || got[0]==got[2]) fails++;
+	e=mkaddr(5000);
+	t=socket(AF_INET,SOCK_DGRAM,0);
+	memset(buf,0,sizeof(buf));
+	n=sendto(t,buf,10,0,(struct sockaddr*)&e,sizeof(e));
+	printf("sendto with no free port: %d, errno %d\n",n,errno);
+	if(n>=0) fails++;
+	closesocket(t);
+	for(p=SGIP_UDP_FIRSTOUTGOINGPORT;p<=SGIP_UDP_LASTOUTGOINGPORT;p++) sgIP_UDP_PortMark(htons(p),0);
+
+	// an echo server on 5000 answers 24 autobound clients
+	echo=socket(AF_INET,SOCK_DGRAM,0);
+	bind(echo,(struct sockaddr*)&e,sizeof(e));
+	ioctl(echo,FIONBIO,&one);
+	for(i=0;i<24;i++) {
+		c[i]=socket(AF_INET,SOCK_DGRAM,0);
+		ioctl(c[i],FIONBIO,&one);
+		buf[0]=i;
+		sendto(c[i],buf,20,0,(struct sockaddr*)&e,sizeof(e));
+		ml=sizeof(me); getsockname(c[i],(struct sockaddr*)&me,&ml);
+		ports[i]=me.sin_port;
+		for(j=0;j<i;j++) if(ports[j]==ports[i]) uniq=0;
+		pump(5);
+		for(;;) {
+			fl=sizeof(from); n=recvfrom(echo,buf,sizeof(buf),0,(struct sockaddr*)&from,&fl);
+			if(n<=0) break;
+			buf[1]=buf[0];
+			sendto(echo,buf,n,0,(struct sockaddr*)&from,fl);
+			pump(5);
+		}
+	}
+	pump(100);
+	for(i=0;i<24;i++) {
+		fl=sizeof(from); n=recvfrom(c[i],buf,sizeof(buf),0,(struct sockaddr*)&from,&fl);
+		if(n==20 && buf[1]==i) ok++;
+		closesocket(c[i]);
+	}
+	closesocket(echo);
+	printf("24 autobound sockets: ports %s, %d replies delivered to the right one\n",uniq?"distinct":"shared",ok);
+	if(!uniq || ok!=24) fails++;
+	return fails?1:0;
+}
@@ -0,0 +1,140 @@
+// UDP receive: the checksum checked on read (fused with the copy) over single blocks, chains and
+//  odd lengths, truncation and MSG_TRUNC, MSG_PEEK, broadcast clones peeked on one socket, and a
+//  full queue that corrupt datagrams neither take space in nor push good ones out of.
+#include "harness.h"
+
+static char buf[2000];
+
+// a datagram of len bytes, byte i of it (char)(i*seed+1); split>0 puts it in two blocks.
+//  chk: 0 no checksum, 1 a good one, -1 a bad one
+static void urx_inject(int port, int len, int seed, int split, int chk) {
+	sgIP_memblock * mb, * t;
+	sgIP_Header_UDP * u;
+	int i;
+	if(split && split<len) {
+		mb=sgIP_memblock_alloc(8+split); t=sgIP_memblock_alloc(len-split);
+		for(i=0;i<split;i++) mb->datastart[8+i]=(char)(i*seed+1);
+		for(i=split;i<len;i++) t->datastart[i-split]=(char)(i*seed+1);
+		sgIP_memblock_append(mb,t);
+	} else {
+		mb=sgIP_memblock_alloc(8+len);
+		for(i=0;i<len;i++) mb->datastart[8+i]=(char)(i*seed+1);
+	}
+	u=(sgIP_Header_UDP *)mb->datastart;
+	u->srcport=htons(9); u->destport=htons(port); u->length=htons(8+len); u->checksum=0;
+	if(chk) {
+		u->checksum=sgIP_UDP_CalcChecksum(mb,hw->ipaddr,hw->ipaddr,mb->totallength);
+		if(chk<0) u->checksum^=0x0100;
+	}
+	sgIP_UDP_ReceivePacket(mb,hw->ipaddr,hw->ipaddr);
+}
+static int urx_ok(int n, int seed) {
+	int i;
+	for(i=0;i<n;i++) if(buf[i]!=(char)(i*seed+1)) return 0;
+	return 1;
+}
+static int rf(int s, int flags, int len) {
+	struct sockaddr_in f;
+	int fl=sizeof(f);
+	return recvfrom(s,buf,len,flags,(struct sockaddr*)&f,&fl);
+}
+
+int main(void) {
+	int a, a2, b, n, n2, n3, n4, i, ok2, v, got, dropped, dl, fails=0;
+	unsigned long one=1;
+	unsigned short ck0, ck1;
+	struct sockaddr_in ba, any;
+	sgIP_memblock * mb;
+	sgIP_Header_UDP * u;
+	net_init();
+	a=socket(AF_INET,SOCK_DGRAM,0);
+	ba=mkaddr(5300);
+	bind(a,(struct sockaddr*)&ba,sizeof(ba));
+	ioctl(a,FIONBIO,&one);
+
+	// checksums: good, bad, good across two blocks, bad across two blocks, none
+	urx_inject(5300,700,3,0,1); urx_inject(5300,700,5,0,-1); urx_inject(5300,900,7,333,1);
+	urx_inject(5300,900,11,333,-1); urx_inject(5300,50,13,0,0);
+	n=rf(a,0,2000);
+	printf("good: %d%s\n",n,urx_ok(n,3)?"":" (wrong)");
+	if(n!=700 || !urx_ok(n,3)) fails++;
+	n=rf(a,0,2000);
+	printf("bad one skipped, good chain: %d%s\n",n,urx_ok(n,7)?"":" (wrong)");
+	if(n!=900 || !urx_ok(n,7)) fails++;
+	n=rf(a,0,2000);
+	printf("bad chain skipped, no checksum: %d%s\n",n,urx_ok(n,13)?"":" (wrong)");
+	if(n!=50 || !urx_ok(n,13)) fails++;
+	if(rf(a,0,2000)!=-1) fails++;
+
+	// odd lengths and an odd split, checked on read
+	urx_inject(5300,701,3,0,1); urx_inject(5300,901,5,333,1); urx_inject(5300,901,5,334,1);
+	for(i=0;i<3;i++) {
+		n=rf(a,0,2000);
+		if(n!=(i?901:701) || !urx_ok(n,i?5:3)) { printf("odd length %d: %d\n",i,n); fails++; }
+	}
+
+	// truncation
+	urx_inject(5300,1000,3,0,1); urx_inject(5300,1000,5,400,1); urx_inject(5300,1000,7,0,-1); urx_inject(5300,300,9,0,1);
+	n=rf(a,0,100);
+	printf("truncated: %d%s\n",n,urx_ok(n,3)?"":" (wrong)");
+	if(n!=100 || !urx_ok(n,3)) fails++;
+	n=rf(a,MSG_TRUNC,100);
+	printf("truncated, MSG_TRUNC: %d%s\n",n,urx_ok(100,5)?"":" (wrong)");
+	if(n!=1000 || !urx_ok(100,5)) fails++;
+	n=rf(a,0,100);
+	printf("bad checksum skipped even when truncated: %d%s\n",n,urx_ok(n,9)?"":" (wrong)");
+	if(n!=100 || !urx_ok(n,9)) fails++;
+	if(rf(a,MSG_TRUNC,0)!=-1) fails++;
+
+	// peek
+	urx_inject(5300,600,3,0,-1); urx_inject(5300,600,5,200,1);
+	n=rf(a,MSG_PEEK,2000); n2=rf(a,MSG_PEEK|MSG_TRUNC,10); n3=rf(a,0,2000); ok2=urx_ok(n3,5); n4=rf(a,0,2000);
+	printf("peek %d, peek truncated %d, recv %d%s, then %d\n",n,n2,n3,ok2?"":" (wrong)",n4);
+	if(n!=600 || n2!=600 || n3!=600 || !ok2 || n4!=-1) fails++;
+	closesocket(a);
+
+	// broadcast clones, peeked on one socket then read on both
+	any=mkaddr(5301);
+	any.sin_addr.s_addr=0;
+	a2=socket(AF_INET,SOCK_DGRAM,0); bind(a2,(struct sockaddr*)&any,sizeof(any)); ioctl(a2,FIONBIO,&one);
+	b=socket(AF_INET,SOCK_DGRAM,0); bind(b,(struct sockaddr*)&any,sizeof(any)); ioctl(b,FIONBIO,&one);
+	mb=sgIP_memblock_alloc(8+500);
+	for(i=0;i<500;i++) mb->datastart[8+i]=(char)(i*3+1);
+	u=(sgIP_Header_UDP *)mb->datastart;
+	u->srcport=htons(9); u->destport=htons(5301); u->length=htons(508); u->checksum=0;
+	u->checksum=sgIP_UDP_CalcChecksum(mb,hw->ipaddr,0xFFFFFFFF,mb->totallength);
+	sgIP_UDP_ReceivePacket(mb,hw->ipaddr,0xFFFFFFFF);
+	sgIP_memblock_CopyToLinear(udp_rec(a2)->incoming_queue,&ck0,SGIP_UDP_PAYLOADOFFSET-2,2);
+	n=rf(b,MSG_PEEK,2000);
+	sgIP_memblock_CopyToLinear(udp_rec(a2)->incoming_queue,&ck1,SGIP_UDP_PAYLOADOFFSET-2,2);
+	printf("peek leaves the shared header alone: %04x %04x\n",ck0,ck1);
+	if(ck0!=ck1) fails++;
+	n2=rf(a2,0,2000); ok2=urx_ok(n2,3);
+	n3=rf(b,0,2000);
+	printf("broadcast: peek %d, a %d%s, b %d%s\n",n,n2,ok2?"":" (wrong)",n3,urx_ok(n3,3)?"":" (wrong)");
+	if(n!=500 || n2!=500 || n3!=500 || !ok2 || !urx_ok(n3,3)) fails++;
+	closesocket(b); closesocket(a2);
+
+	// a full queue: corrupt datagrams neither hold space nor push good ones out
+	b=socket(AF_INET,SOCK_DGRAM,0);
+	ba=mkaddr(5302);
+	bind(b,(struct sockaddr*)&ba,sizeof(ba));
+	ioctl(b,FIONBIO,&one);
+	for(i=0;i<SGIP_UDP_MAXQUEUED;i++) urx_inject(5302,100,5,0,-1);
+	urx_inject(5302,100,3,0,1);
+	dl=sizeof(dropped); getsockopt(b,SOL_SOCKET,SO_RCVDROPPED,&dropped,&dl);
+	n=rf(b,0,2000);
+	printf("queue full of corrupt ones, then a good one: %d%s, %d dropped\n",n,urx_ok(n,3)?"":" (wrong)",dropped);
+	if(n!=100 || !urx_ok(n,3) || dropped) fails++;
+	v=1;
+	setsockopt(b,SOL_SOCKET,SO_RCVDROPOLDEST,&v,sizeof(int));
+	for(i=0;i<SGIP_UDP_MAXQUEUED;i++) urx_inject(5302,100,3,0,1);
+	for(i=0;i<5;i++) urx_inject(5302,100,5,0,-1);
+	dl=sizeof(dropped); getsockopt(b,SOL_SOCKET,SO_RCVDROPPED,&dropped,&dl);
+	got=0;
+	while((n=rf(b,0,2000))>=0) if(n==100 && urx_ok(n,3)) got++;
+	printf("drop oldest, then corrupt arrivals: %d of %d good ones kept, %d dropped\n",got,SGIP_UDP_MAXQUEUED,dropped);
+	if(got!=SGIP_UDP_MAXQUEUED || dropped) fails++;
+	closesocket(b);
+	return fails?1:0;
+}
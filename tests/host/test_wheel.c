@@ -0,0 +1,52 @@
+// timers on the wheel: a closed connection and its TIME_WAIT are freed after 2MSL, an unanswered
+//  ARP request is resent SGIP_ARP_MAXRETRY times and then given up, and an unanswered SYN keeps
+//  being resent with backoff.
+#include "harness.h"
+
+static int count_arp, count_syn;
+static void count_hook(unsigned char * d, int len) {
+	if(d[12]==0x08 && d[13]==0x06) count_arp++;
+	if(len>=54 && d[12]==0x08 && d[13]==0 && d[23]==6 && (d[47]&SGIP_TCP_FLAG_SYN)) count_syn++;
+}
+
+int main(void) {
+	int fails=0, i, n, r, base, cs, ss, ls, us;
+	char b[16];
+	unsigned long one=1;
+	struct sockaddr_in a;
+	net_init();
+	tx_hook=count_hook;
+	base=malloc_count;
+	// a full close on both sides; everything is freed after 2MSL
+	ls=tcp_pair(81,&cs,&ss);
+	send(cs,"hello",5,0); pump(200);
+	r=recv(ss,b,16,0);
+	closesocket(cs); pump(200);
+	closesocket(ss); closesocket(ls);
+	pump(SGIP_TCP_TIMEMS_2MSL+10000);
+	n=0; for(i=0;i<SGIP_SOCKET_MAXSOCKETS;i++) if(socketlist[i].flags) n++;
+	printf("after close and 2MSL: received %d, %d sockets in use, malloc delta %d\n",r,n,malloc_count-base);
+	if(r!=5 || n) fails++;
+	// ARP for an address nobody answers
+	count_arp=0;
+	us=socket(AF_INET,SOCK_DGRAM,0);
+	a=mkaddr(9); a.sin_addr.s_addr=10|(77<<24);
+	sendto(us,"x",1,0,(struct sockaddr*)&a,sizeof(a));
+	pump(30000);
+	printf("arp requests for a dead address: %d (want %d)\n",count_arp,1+SGIP_ARP_MAXRETRY);
+	if(count_arp!=1+SGIP_ARP_MAXRETRY) fails++;
+	closesocket(us);
+	// SYN to a port whose answers are all lost
+	a=mkaddr(82);
+	ls=socket(AF_INET,SOCK_STREAM,0); bind(ls,(struct sockaddr*)&a,sizeof(a)); listen(ls,4);
+	count_syn=0; drop_srcport=82;
+	cs=socket(AF_INET,SOCK_STREAM,0); ioctl(cs,FIONBIO,&one);
+	connect(cs,(struct sockaddr*)&a,sizeof(a));
+	pump(20000);
+	printf("syn and syn-ack frames in 20s with the syn-acks lost: %d, client state %d\n",count_syn,tcp_rec(cs)->tcpstate);
+	if(count_syn<8 || count_syn>30 || tcp_rec(cs)->tcpstate!=SGIP_TCP_STATE_SYN_SENT) fails++;
+	drop_srcport=-1;
+	closesocket(cs); closesocket(ls);
+	tx_hook=0;
+	return fails?1:0;
+}
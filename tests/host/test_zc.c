@@ -0,0 +1,68 @@
+// zero-copy UDP receive: datagrams read in place, over single blocks, chains and broadcast clones,
+//  an empty datagram, an empty queue, and no memory held once every datagram is released.
+#include "harness.h"
+#include "zc.h"
+
+static int zc_check(int s, int len, int seed, const char * what) {
+	dgram_t dg;
+	struct sockaddr_in f;
+	int fl=sizeof(f), i, k, l, n, tot=0, bad=0, spans=0;
+	const void * p;
+	n=recvfrom_zc(s,&dg,0,(struct sockaddr*)&f,&fl);
+	if(n!=len) {
+		printf("%s: recvfrom_zc %d, errno %d, want %d\n",what,n,errno,len);
+		if(n>=0) dgram_release(dg);
+		return 1;
+	}
+	for(i=0;(l=dgram_getspan(dg,i,&p))>0;i++) {
+		spans++;
+		for(k=0;k<l;k++) if(((const unsigned char*)p)[k]!=(unsigned char)((tot+k)*seed)) bad++;
+		tot+=l;
+	}
+	dgram_release(dg);
+	printf("%s: %d bytes in %d spans, %d bad, from port %d\n",what,tot,spans,bad,ntohs(f.sin_port));
+	return (tot!=len || bad)?1:0;
+}
+
+int main(void) {
+	int a, b, tx, n, i, fl, before, fails=0;
+	unsigned long one=1;
+	char buf[1500];
+	struct sockaddr_in ba, d, f;
+	dgram_t dg;
+	net_init();
+	ba=mkaddr(5200);
+	ba.sin_addr.s_addr=0;
+	a=socket(AF_INET,SOCK_DGRAM,0); b=socket(AF_INET,SOCK_DGRAM,0);
+	bind(a,(struct sockaddr*)&ba,sizeof(ba)); bind(b,(struct sockaddr*)&ba,sizeof(ba));
+	ioctl(a,FIONBIO,&one); ioctl(b,FIONBIO,&one);
+	tx=socket(AF_INET,SOCK_DGRAM,0);
+	d=mkaddr(5200);
+	for(i=0;i<1400;i++) buf[i]=(char)(i*3);
+	sendto(tx,buf,1,0,(struct sockaddr*)&d,sizeof(d)); // resolve our address first
+	pump(50);
+	fl=sizeof(f); recvfrom(a,buf+1400,10,0,(struct sockaddr*)&f,&fl);
+	fl=sizeof(f); recvfrom(b,buf+1400,10,0,(struct sockaddr*)&f,&fl);
+	before=malloc_count;
+
+	sendto(tx,buf,1400,0,(struct sockaddr*)&d,sizeof(d));
+	pump(50);
+	fails+=zc_check(b,1400,3,"unicast 1400");
+	d.sin_addr.s_addr=0xFFFFFFFF;
+	sendto(tx,buf,1000,0,(struct sockaddr*)&d,sizeof(d));
+	pump(50);
+	fails+=zc_check(a,1000,3,"broadcast, socket a");
+	fails+=zc_check(b,1000,3,"broadcast, socket b");
+	zc_inject(5200,1200,5,500);
+	fails+=zc_check(b,1200,5,"two-block chain");
+	zc_inject(5200,0,5,0);
+	fails+=zc_check(b,0,5,"empty datagram");
+	n=recvfrom_zc(b,&dg,0,0,0);
+	printf("empty queue: %d, errno %d, %s datagram\n",n,errno,dg?"a":"no");
+	if(n!=-1 || errno!=EWOULDBLOCK || dg) fails++;
+	closesocket(a); closesocket(b); closesocket(tx);
+	pump(50);
+	printf("malloc_count %d (before %d)\n",malloc_count,before);
+	if(malloc_count>before) fails++;
+	return fails?1:0;
+}
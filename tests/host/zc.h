@@ -0,0 +1,25 @@
+// hand a udp datagram of len bytes straight to sgIP_UDP_ReceivePacket, byte i of it (char)(i*seed);
+//  split>0 puts it in two blocks, the second starting at payload byte split.  shared by test_zc
+//  and bench_zc.
+#ifndef ZC_H
+#define ZC_H
+
+static void zc_inject(int port, int len, int seed, int split) {
+	sgIP_memblock * mb, * t;
+	sgIP_Header_UDP * u;
+	int i;
+	if(split && split<len) {
+		mb=sgIP_memblock_alloc(8+split); t=sgIP_memblock_alloc(len-split);
+		for(i=0;i<split;i++) mb->datastart[8+i]=(char)(i*seed);
+		for(i=split;i<len;i++) t->datastart[i-split]=(char)(i*seed);
+		sgIP_memblock_append(mb,t);
+	} else {
+		mb=sgIP_memblock_alloc(8+len);
+		for(i=0;i<len;i++) mb->datastart[8+i]=(char)(i*seed);
+	}
+	u=(sgIP_Header_UDP *)mb->datastart;
+	u->srcport=htons(9); u->destport=htons(port); u->length=htons(8+len); u->checksum=0;
+	sgIP_UDP_ReceivePacket(mb,hw->ipaddr,hw->ipaddr);
+}
+
+#endif